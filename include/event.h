@@ -0,0 +1,33 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+
+#define EVENT_ERROR -1
+#define EVENT_OK 0
+
+// events reported by waitForEvents (bit flags)
+#define EVENT_SOCKET_READABLE 0x1   // the ping socket has packets waiting to be received (io_uring: completions are waiting)
+#define EVENT_TIMER_EXPIRED 0x2     // the deadline set with armEventTimer is reached
+
+// @brief creates the event loop: an epoll instance watching sock_fd (readable), a CLOCK_MONOTONIC timerfd and the signals'
+// wake up fd (see signals.h);
+// with the io_uring backend (see uring.h), its completion queue is waited on instead, and a transport that waits its own way
+// (see transport.h) is left to it (sock_fd is ignored, nothing is created)
+// @return EVENT_ERROR to indicate error (errno is set), EVENT_OK otherwise
+int createEventLoop(int sock_fd);
+
+// @brief (re)arms the timer to expire at the absolute CLOCK_MONOTONIC deadline (in nanoseconds, see get_nanoseconds),
+// a deadline already in the past expires immediately
+// @return EVENT_ERROR to indicate error, EVENT_OK otherwise
+int armEventTimer(uint64_t deadline_ns);
+
+// @brief sleeps until the socket is readable, the timer expires or a signal comes in (no polling: the process only wakes up
+// when one of them happens)
+// @return a combination of EVENT_SOCKET_READABLE and EVENT_TIMER_EXPIRED, 0 if woken up by a signal, EVENT_ERROR in case of error
+int waitForEvents(void);
+
+// @brief closes the epoll instance and the timerfd
+void closeEventLoop(void);
+
+#endif
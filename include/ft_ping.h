@@ -3,6 +3,11 @@
 
 #include <netinet/in.h>
 #include <stdint.h>
+#include <time.h>
+#include "histogram.h"
+#include "mock.h"
+#include "selfstats.h"
+#include "timerwheel.h"
 
 // ICMP echo header structure
 typedef struct {
@@ -16,51 +21,153 @@ typedef struct {
 // ICMP echo request structure
 typedef struct {
     icmp_echo_header_t header;
-    uint8_t *data;           // pointer to data
-    size_t data_len;         // data length
+    size_t data_len;         // data length (the payload is zeros, but for the timestamp and probe index of each probe)
+    uint32_t base_sum;       // ones' complement sum of the constant words (identifier, sequence and timestamp excluded)
 } icmp_echo_t;
 
-typedef struct ping_state {
-    uint16_t identifier;
-    uint16_t sequence;
-    int sock_fd;
-    char *display_address; // parsed IPv4 address (clean)
- 
-    // network addressing
+// received packet: one slot of the receive ring (filled by recvmmsg)
+typedef struct recv_slot {
+    uint8_t *data;                      // slot buffer (preallocated, state.recv_slot_size bytes)
+    size_t len;                         // number of bytes received
+    struct sockaddr_in sender_addr;     // sender's address
+    socklen_t sender_addr_len;          // sender's address length
+    struct timespec rx_time;            // kernel receive timestamp (CLOCK_REALTIME), zero if not available
+    uint8_t *control;                   // ancillary data buffer (timestamps)
+} recv_slot_t;
+
+// number of most recent sequences tracked per target for duplicate detection (multiple of 64)
+#define SEQUENCE_WINDOW 1024
+
+// max number of percentiles reported in the summary (--percentiles)
+#define MAX_PERCENTILES 16
+
+// classification of an echo reply against the probes of its target
+#define REPLY_ON_TIME 0                 // first reply of a probe still in the sequence window
+#define REPLY_DUPLICATE 1               // another reply of a probe already answered
+#define REPLY_LATE 2                    // reply of a probe older than the window (already given up on)
+#define REPLY_UNKNOWN 3                 // matches no probe we sent (index from the future, index and sequence disagree)
+
+// where the resolution of a target's host name stands (see resolver.h)
+#define RESOLUTION_PENDING 0            // no address yet: the target isn't pinged
+#define RESOLUTION_DONE 1               // dest_addr is set
+#define RESOLUTION_FAILED 2             // unknown host
+
+// per-target record: every destination pinged by the process owns one of these,
+// all of them live in one contiguous arena (state.targets)
+typedef struct ping_target {
     struct sockaddr_in dest_addr;       // destination socket address
     char *hostname;                     // hostname/IPv4 address input
- 
+    char display_address[INET_ADDRSTRLEN]; // parsed IPv4 address (clean)
+    int resolution;                     // RESOLUTION_PENDING, RESOLUTION_DONE or RESOLUTION_FAILED
+
+    uint16_t identifier;                // ICMP identifier used for this target (SOCK_RAW only)
+    uint16_t sequence;                  // next sequence to be sent to this target (low 16 bits of probes)
+    uint64_t probes;                    // probes sent so far: index of the next one (carried in the payload, tells wrapped sequences apart)
+
+    // statistics tracking
+    unsigned long num_sent;             // packets sent
+    unsigned long num_recv;             // packets received
+    unsigned long num_rept;             // duplicate packets
+    unsigned long num_late;             // replies of probes older than the sequence window
+    unsigned long num_unknown;          // replies routed to this target that match none of its probes
+    unsigned long num_send_errors;      // probes the kernel refused to send (EHOSTUNREACH, EPERM...), not counted as sent
+    unsigned long num_unreach;          // ICMP errors about its probes: destination unreachable, time exceeded, redirect
+    unsigned long num_exceeded;
+    unsigned long num_redirect;
+    double rrt_sum;                     // sum of all RTTs
+    double rrt_sum_sq;                  // sum of (rrt^2) for variance
+    double rrt_min;                     // minimum rrt
+    double rrt_max;                     // maximum rrt
+    latency_histogram_t *histogram;     // RTT distribution (NULL unless percentiles are reported)
+    wheel_timer_t *timeouts;            // state.timeout_slots timers the probes take turns on for their timeout (NULL unless -W is set)
+    uint64_t *send_times;               // send time (CLOCK_REALTIME ns) of each probe of the sequence window (NULL unless --probe-log)
+
+    // sequence window: bit (sequence % SEQUENCE_WINDOW) is set once an echo reply with that sequence is received (duplicate detection)
+    uint64_t received[SEQUENCE_WINDOW / 64];
+    // same window: bit set if the kernel refused to send the probe with that sequence (it's neither awaited nor lost)
+    uint64_t unsent[SEQUENCE_WINDOW / 64];
+} ping_target_t;
+
+typedef struct ping_state {
+    uint16_t identifier;                // base ICMP identifier (target i uses identifier + i)
+    int sock_fd;
+
+    // targets (contiguous arena of num_targets records)
+    ping_target_t *targets;
+    size_t num_targets;
+
     // packet structure & pre-allocated and sized
-    icmp_echo_t packet;        // contains header + data pointer + data length
+    icmp_echo_t packet;        // contains header + data length
     size_t packet_size;                // Total packet size (constant = sizeof(icmp_echo_header_t) + packet.data_len)
 
     // Socket configuration
     int socket_type;                   // SOCK_RAW or SOCK_DGRAM
     int useless_identifier;            // 1 if kernel overrides ICMP ID, 0 otherwise (1 if the created socket's type is SOCK_DGRAM, 0 if it's SOCK_RAW)
 
-    // statistics tracking
+    // aggregated statistics (sum over all targets)
     unsigned long num_sent;             // packets sent
     unsigned long num_recv;             // packets received
     unsigned long num_rept;             // duplicate packets
-    double rrt_sum;                     // sum of all RTTs
-    double rrt_sum_sq;                  // sum of (rrt^2) for variance
-    double rrt_min;                     // minimum rrt 
-    double rrt_max;                     // maximum rrt 
+    uint64_t first_send_ns;             // time of the first successful send (CLOCK_MONOTONIC, 0 = none yet)
+    uint64_t last_send_ns;              // time of the last successful send
+    unsigned long recv_calls;           // recvmmsg() calls that returned packets
+    unsigned long recv_packets;         // packets returned by those calls (noise included)
+    unsigned long noise_packets;        // packets read but not about our probes (dropped in userspace)
+    unsigned long icmp_in_start;        // host ICMP messages received (Icmp InMsgs) when the socket was set up
+    unsigned long ring_overflows;       // receiver thread: events lost because the ring was full
+    size_t ring_max_occupancy;          // receiver thread: ring occupancy, highest and sum over the samples (one per batch)
+    unsigned long ring_occupancy_sum;
+    unsigned long ring_samples;
+    unsigned long packet_ring_blocks;   // packet ring: blocks handed over to us, and the kernel's counters (PACKET_STATISTICS)
+    unsigned long packet_ring_packets;
+    unsigned long packet_ring_drops;
+    unsigned long packet_ring_freezes;
+    unsigned long uring_enters;         // io_uring backend: io_uring_enter calls, sends submitted, receive re-arms (buffers ran out)
+    unsigned long uring_sends;
+    unsigned long uring_rearms;
+    unsigned long pacer_wakeups;        // rate mode: send deadlines met, and how late (nanoseconds) we were for them
+    double pacer_lateness_sum;
+    double pacer_lateness_sum_sq;
+    uint64_t pacer_lateness_max;
+    self_stats_t self;                  // --self-stats: the loop's own stage timings and send lateness
 
     // runtime control
-    size_t count;                      // number of packets to send (0 = infinite)
+    size_t count;                      // number of packets to send to each target (0 = infinite)
 
     float wait;                           // seconds to wait between sending each packet
+    double probe_timeout;               // seconds each probe is waited for before it's declared lost (-W), 0 = until the end of the run
+    size_t timeout_slots;               // -W: timers per target (a power of two), probe i takes timer i % timeout_slots
+    double deadline;                    // seconds after which the run stops, whatever is left to send or receive (-w), 0 = no limit
     int flood;                          // send ECHO requests as fast as possible and display them as they come
+    size_t batch;                       // max number of ECHO requests sent per sendmmsg() call
+    double rate;                        // probes per second (--rate, token bucket pacing), 0 to use the interval
+    size_t burst;                       // max probes sent back to back in rate mode (token bucket depth)
+    double percentiles[MAX_PERCENTILES]; // percentiles of the RTT reported in the summary (--percentiles)
+    size_t num_percentiles;
+    size_t workers;                     // number of worker processes, each with its own socket and identifiers (--workers)
+    int recv_thread;                    // 1 to receive and parse on a dedicated thread (--recv-thread)
+    int packet_ring;                    // 1 to receive from an AF_PACKET TPACKET_V3 ring instead of the ping socket (--packet-ring)
+    int io_uring;                       // 1 to send and receive through io_uring (--io-uring), 0 for sendmmsg/recvmmsg
+    int icmp_filter;                    // 1 to attach the BPF filter to the raw socket (default, --no-filter turns it off)
+    int kernel_timestamps;              // 1 to take RTTs from kernel timestamps (SO_TIMESTAMPNS / SO_TIMESTAMPING) instead of userspace clocks
+    int simulate;                       // 1 to answer the probes in memory on a virtual clock, no socket (--simulate)
+    mock_script_t simulation;           // what the simulated network does to the probes
+    int self_stats;                     // 1 to time the stages of the ping loop and report them with the summary (--self-stats)
 
     int verbose;                        // default is 0 (set to 1 if -v is specified)
     int quiet;                           // quiet output. nothing is displayed except the summary lines at startup time and when finished.
+    int output_format;                  // OUTPUT_TEXT, OUTPUT_JSONL or OUTPUT_CSV (see output.h)
+    char *probe_log;                    // path of the binary probe log (--probe-log), NULL if none
+    char *hosts_file;                   // hosts file looked up before DNS (--hosts-file), NULL for /etc/hosts
+    struct sockaddr_in dns_server;      // DNS server queried instead of those of /etc/resolv.conf (--dns-server), sin_family 0 if none
+    struct sockaddr_in metrics_addr;    // where the /metrics HTTP endpoint listens (--metrics), sin_family 0 if none
     char *program_name;
-
-    uint8_t *received;                     // given a sequence you get whether an echo reply packet with the same sequence has been already received (duplicate) 
 } ping_state_t;
 
-// @brief ping loop
+// @brief pings the targets (in this process, or in state.workers worker processes), then prints the statistics
 void start_pinging(void);
 
+// @brief ping loop: sends state.count rounds (forever if 0) and handles the replies until the last chance wait is over
+void run_ping_loop(void);
+
 #endif
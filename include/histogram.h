@@ -0,0 +1,33 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// log-bucketed (HDR-style) latency histogram: each power of two range is split into 2^HISTOGRAM_SUB_BITS linear buckets,
+// so every recorded value is known within 1/32 (~3%) whatever its magnitude, in constant memory
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_MAX_BITS 40   // values (nanoseconds) up to 2^40 ns (~18 minutes), larger ones are clamped
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct latency_histogram {
+    uint64_t total;                         // number of recorded values
+    uint64_t counts[HISTOGRAM_BUCKETS];
+} latency_histogram_t;
+
+// @brief records a value (in nanoseconds) in O(1)
+void histogramRecord(latency_histogram_t *histogram, uint64_t value_ns);
+
+// @brief returns the value (in nanoseconds) at the given percentile (0-100): the highest value equivalent to the bucket
+// holding it, 0 if the histogram is empty
+uint64_t histogramPercentile(const latency_histogram_t *histogram, double percentile);
+
+// @brief adds every count of src to dst
+void histogramMerge(latency_histogram_t *dst, const latency_histogram_t *src);
+
+// @brief returns the index of the bucket a value (in nanoseconds) is recorded in
+uint32_t histogramBucketIndex(uint64_t value_ns);
+
+// @brief returns the highest value (in nanoseconds) recorded in the bucket of the given index
+uint64_t histogramBucketUpperBound(uint32_t index);
+
+#endif
@@ -16,13 +16,66 @@ typedef enum {
     PARSE_ERROR,        // failed to parse the packet
 } parse_status_t;
 
-// @brief fills the state request with an ICMP packet 
+#define ICMP_MAX_ORIG_HEADER 60 // largest IP header quoted by an ICMP error message
+
+// an ICMP message about an echo request (one of our probes once routed), as extracted from the packet by the parse stage (parseIcmpMessage),
+// to be accounted for and reported by the handling stage (handleIcmpEvent)
+typedef struct icmp_event {
+    ping_target_t *target;              // set by the handling stage (NULL until then)
+    uint16_t identifier;                // identifier of the probe (the original one for an error message)
+    in_addr_t route_addr;               // address the message is routed by: the sender of an echo reply, the destination
+                                        // of the original probe for an error message
+    int64_t sent_ns;                    // echo reply: send time from the payload (CLOCK_REALTIME nanoseconds), 0 if none
+    uint64_t probe_index;               // echo reply: probe index from the payload (valid if has_probe_index)
+    int has_probe_index;
+    int64_t reply_ns;                   // reception time (CLOCK_REALTIME nanoseconds)
+    size_t message_len;                 // ICMP message size
+    struct in_addr from;                // sender of the message
+    uint16_t sequence;                  // sequence of the probe (the original one for an error message)
+    uint8_t type;                       // ICMP_ECHOREPLY or the type of the error message
+    uint8_t code;
+    uint8_t ttl;                        // 0 if unknown (SOCK_DGRAM)
+
+    // error messages only: the original (quoted) probe, for the verbose dump
+    uint8_t orig_type;
+    uint8_t orig_code;
+    uint8_t orig_header_len;
+    uint8_t orig_header[ICMP_MAX_ORIG_HEADER];
+} icmp_event_t;
+
+// @brief prepares the constant part of the echo request (state.packet): fixed header fields, payload fill
+// and the partial checksum of those, computed once so that each probe only sums the words it changes
 // @return returns ICMP_ERROR in case of error, ICMP_OK otherwise
-int createIcmpEchoRequestMessage(void);
+int initIcmpEchoRequestTemplate(void);
+
+// @brief copies the echo request template (see initIcmpEchoRequestTemplate) into a wire buffer of state.packet_size bytes,
+// done once per buffer: the buffer can then be reused for any number of probes
+void copyIcmpEchoRequestTemplate(void *wire);
+
+// @brief builds, in place, the ICMP echo request addressed to target (target's identifier and next sequence) in the wire buffer,
+// which must hold the template: only identifier, sequence, timestamp and checksum are written
+// @return returns ICMP_ERROR in case of error, ICMP_OK otherwise
+int createIcmpEchoRequestMessage(ping_target_t *target, void *wire);
+
+// @brief parse stage: checks that the incoming message is an ICMP message about an echo request and extracts it into event,
+// without reading or writing any shared state (safe to call from the receiving thread); the event isn't routed to its target yet
+// @return PARSE_OK if event was filled, NETWORK_NOISE if the packet is to be ignored, ICMP_ERROR to indicate error
+// @param rx_time is the kernel receive timestamp of the packet, NULL (or zero) to take the reply time now
+int parseIcmpMessage(void *packet, size_t packet_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len, const struct timespec *rx_time, icmp_event_t *event);
+
+// @brief handling stage (main thread): routes the event to its target, accounts it in the target's statistics and reports it
+// (printf, structured output, probe log); an event that belongs to none of the targets is counted as noise
+// @return PARSE_OK if handled, NETWORK_NOISE if the event is to be ignored, ICMP_ERROR to indicate error
+int handleIcmpEvent(icmp_event_t *event);
 
 // @brief parses the incoming ICMP message and it either calls the handler of the ICMP message (or type of messages) or ignores the packet
 // @return returns NETWORK_NOISE in case of network noise (the received packet is to be ignored), ICMP_ERROR to indicate error, ICMP_OK if the ICMP message 
 // was parsed and the result was logged successfully
-int parseIcmpMessageAndLogResult(void *packet, size_t packet_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len);
+// @param rx_time is the kernel receive timestamp of the packet, NULL (or zero) to take the reply time when parsing
+int parseIcmpMessageAndLogResult(void *packet, size_t packet_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len, const struct timespec *rx_time);
+
+// @brief parses (and logs the result of) every packet of a batch received in the receive ring
+// @return the number of packets that were ours (parsed with PARSE_OK)
+size_t parseIcmpMessageBatch(recv_slot_t *slots, size_t count);
 
 #endif
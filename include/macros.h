@@ -19,8 +19,95 @@
 #define DEFAULT_DATALEN 56
 #define DEFAULT_PING_COUNT 0
 #define DEFAULT_PING_WAIT 1 // 1 second 
+#define DEFAULT_SEND_BATCH 1
 
-#define MAX_SEQUENCE 65535
+// sendmmsg() accepts at most UIO_MAXIOV messages per call
+#define MAX_SEND_BATCH 1024
+
+// receive ring: packets read per recvmmsg() call, and minimum slot size
+// (ICMP errors quote the original datagram and may be up to 576 bytes, RFC 1812)
+#define RECV_RING_SLOTS 64
+#define MIN_RECV_SLOT_SIZE 576
+#define MAX_IP_HEADER_SIZE 60
+
+// kernel timestamps: ancillary data space per receive slot, transmit timestamps kept per target (most recent sequences)
+// and sent probes remembered to match the kernel's transmit timestamp keys
+#define RECV_CONTROL_SIZE 256
+#define TX_STAMP_WINDOW 64
+#define TX_LOG_SIZE 4096
+
+// machine readable output: buffer size, max length of a record (and of an escaped field in it),
+// flushed when the buffer holds OUTPUT_FLUSH_THRESHOLD bytes or OUTPUT_FLUSH_INTERVAL_NS after the last flush
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define OUTPUT_MAX_RECORD 1024
+#define OUTPUT_MAX_FIELD 300
+#define OUTPUT_FLUSH_THRESHOLD (OUTPUT_BUFFER_SIZE / 2)
+#define OUTPUT_FLUSH_INTERVAL_NS 200000000ULL
+
+// receiver thread (--recv-thread): events the ring holds, events handled per wake up of the main thread,
+// and how often (microseconds) the thread checks whether it's asked to stop
+#define RECEIVER_RING_SIZE 16384
+#define RECEIVER_DRAIN_BUDGET 256
+#define RECEIVER_STOP_CHECK_US 50000
+
+// rate mode (--rate): the timer wakes the loop PACER_SPIN_NS before a send deadline, the rest is a busy-wait;
+// --burst is at most MAX_PACER_BURST probes
+#define PACER_SPIN_NS 100000ULL
+#define MAX_PACER_BURST 4096
+
+// multi-core mode (--workers)
+#define MAX_WORKERS 256
+
+// resolver: up to RESOLVER_THREADS lookups at once; answers without a TTL of their own (hosts file, getaddrinfo) are kept
+// RESOLVER_DEFAULT_TTL seconds, a failed refresh is retried after RESOLVER_RETRY_TTL and no answer is kept less than RESOLVER_MIN_TTL
+#define RESOLVER_THREADS 16
+#define RESOLVER_DEFAULT_TTL 60
+#define RESOLVER_RETRY_TTL 10
+#define RESOLVER_MIN_TTL 1
+#define RESOLVER_ANSWER_SIZE 4096
+#define RESOLVER_WAIT_SLICE_MS 100      // longest wait for an answer in one go (the main thread checks for signals in between)
+#define DEFAULT_HOSTS_FILE "/etc/hosts"
+
+// packet ring (--packet-ring): PACKET_RING_BLOCKS blocks of PACKET_RING_BLOCK_SIZE bytes, a block is handed over to us once
+// it's full or PACKET_RING_RETIRE_MS milliseconds after its first packet
+#define PACKET_RING_BLOCK_SIZE (1 << 18)
+#define PACKET_RING_BLOCKS 64
+#define PACKET_RING_FRAME_SIZE 2048
+#define PACKET_RING_RETIRE_MS 1
+
+// io_uring backend (--io-uring): submission and completion queue entries, and up to URING_BUFFERS provided receive
+// buffers (a power of two) taking no more than URING_BUFFERS_MAX_BYTES
+#define URING_SQ_ENTRIES 2048
+#define URING_CQ_ENTRIES 16384
+#define URING_BUFFERS 4096
+#define URING_BUFFERS_MAX_BYTES (64 << 20)
+#define URING_BUFFER_GROUP 0
+
+// simulation (--simulate): the virtual clock's wall time starts at SIMULATION_EPOCH (seconds, fixed so that the same script
+// gives the same output), ICMP errors come from SIMULATION_ROUTER and replies have SIMULATION_TTL unless the script says otherwise
+#define SIMULATION_EPOCH 1700000000LL
+#define SIMULATION_ROUTER "192.0.2.1"
+#define SIMULATION_TTL 64
+#define SIMULATION_SEED 1
+
+// metrics endpoint (--metrics): the ping loop publishes a snapshot every METRICS_PUBLISH_INTERVAL_NS, requests are read
+// into METRICS_REQUEST_SIZE bytes, and a client gets METRICS_IO_TIMEOUT_MS to send its request and take the response
+#define METRICS_PUBLISH_INTERVAL_NS 100000000ULL
+#define METRICS_REQUEST_SIZE 4096
+#define METRICS_IO_TIMEOUT_MS 1000
+#define METRICS_DEFAULT_ADDRESS "127.0.0.1"
+
+// per-probe timeouts (-W): the timer wheel has TIMER_WHEEL_SLOTS buckets, of at least TIMER_WHEEL_MIN_TICK_NS each;
+// each target has at least MIN_TIMEOUT_SLOTS timers (see createTargets)
+#define TIMER_WHEEL_SLOTS 4096
+#define TIMER_WHEEL_MIN_TICK_NS 100000ULL
+#define MIN_TIMEOUT_SLOTS 64
+
+// binary probe log: room for this many records at first (the file doubles when full)
+#define PROBELOG_INITIAL_RECORDS 4096
+
+// one ICMP identifier per target (identifiers are 16 bits)
+#define MAX_TARGETS 65536
 
 #define PROD 1
 
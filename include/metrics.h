@@ -0,0 +1,28 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include "ft_ping.h"
+
+// metrics endpoint (--metrics): a thread serves the targets' counters and RTT histograms over HTTP (GET /metrics, Prometheus
+// text format 0.0.4); the ping loop publishes a snapshot of them now and then, and never waits for a scrape to publish
+// (a scrape copies the last published snapshot, consistent across every target, and formats it on its own thread)
+
+#define METRICS_ERROR -1
+#define METRICS_OK 0
+
+// @brief binds state.metrics_addr and starts the server thread
+// @return METRICS_ERROR in case of error (errno is set), METRICS_OK otherwise
+int startMetricsServer(void);
+
+// @brief counts an RTT (nanoseconds) of the target's on time replies in its histogram's buckets (main thread)
+void recordMetricsRtt(ping_target_t *target, uint64_t rtt_ns);
+
+// @brief publishes a snapshot of the counters once METRICS_PUBLISH_INTERVAL_NS have elapsed since the last one
+// (called from the ping loop; skipped, and retried on the next call, while a scrape is copying the previous one)
+void metricsTick(void);
+
+// @brief stops and joins the server thread
+void stopMetricsServer(void);
+
+#endif
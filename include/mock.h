@@ -0,0 +1,47 @@
+#ifndef MOCK_H
+#define MOCK_H
+
+#include <stdint.h>
+
+// mock transport (--simulate): no socket, the probes are answered in memory as a raw socket would hand the answers over
+// (IP header included), on a virtual clock that jumps from one event to the next; a run takes the CPU time of the engine
+// alone (scheduling, matching, duplicate tracking, statistics, output), and with the same script it's the same run
+
+#define MOCK_ERROR -1
+#define MOCK_OK 0
+
+// what the network does to each probe (fates are drawn from a generator seeded with 'seed')
+typedef struct mock_script {
+    double delay_ms;                    // round trip time of every reply
+    double jitter_ms;                   // uniform in [-jitter, +jitter] around the delay
+    double loss_pct;                    // requests left unanswered
+    double dup_pct;                     // replies sent twice
+    double unreach_pct;                 // requests answered by a router's destination unreachable (after half the delay)
+    double exceeded_pct;                // requests answered by a router's time exceeded (after half the delay)
+    uint8_t ttl;                        // TTL of the replies
+    long seed;
+} mock_script_t;
+
+// what the mock did, and how fast
+typedef struct mock_stats {
+    unsigned long requests;             // echo requests sent through the mock
+    unsigned long replies;              // echo replies handed over (copies excluded)
+    unsigned long dropped;              // requests left unanswered
+    unsigned long duplicated;           // extra copies
+    unsigned long errors;               // ICMP error messages
+    uint64_t virtual_ns;                // virtual time elapsed
+    uint64_t real_ns;                   // real time elapsed
+} mock_stats_t;
+
+// @brief sets the mock transport and its virtual clock in place of the kernel's (see transport.h, utils.h), with state.packet_size
+// known: the clock starts at SIMULATION_EPOCH (CLOCK_REALTIME)
+// @return MOCK_ERROR in case of allocation failure, MOCK_OK otherwise
+int openMockTransport(const mock_script_t *script);
+
+// @brief fills stats with the mock's counters so far
+void getMockStats(mock_stats_t *stats);
+
+// @brief restores the kernel's transport and the system clocks, frees the packets still in flight
+void closeMockTransport(void);
+
+#endif
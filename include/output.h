@@ -0,0 +1,42 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include "ft_ping.h"
+
+// output formats (state.output_format)
+#define OUTPUT_TEXT 0       // classic ping output (printf)
+#define OUTPUT_JSONL 1      // one JSON object per line and per event
+#define OUTPUT_CSV 2        // one CSV row per event (header row first)
+
+#define OUTPUT_ERROR -1
+#define OUTPUT_OK 0
+
+// @brief sets up the buffered record writer on fd (written only when it polls writable, so that a slow consumer never stalls
+// the ping loop: records that don't fit in the buffer are dropped and counted); writes the CSV header row if needed
+// @return OUTPUT_ERROR in case of allocation failure, OUTPUT_OK otherwise
+int createOutput(int fd, int format);
+
+// @brief echo reply record (event reply, duplicate or late, after classification: REPLY_* in ft_ping.h);
+// rtt_ms < 0 when the payload carried no timestamp; reply_ns is when the reply was received (CLOCK_REALTIME nanoseconds),
+// the record's time
+void outputReply(ping_target_t *target, uint16_t sequence, size_t bytes, uint8_t ttl, double rtt_ms, int classification, int64_t reply_ns);
+
+// @brief ICMP error message record (about one of our probes to target), received at reply_ns (CLOCK_REALTIME nanoseconds)
+void outputIcmpError(ping_target_t *target, struct in_addr from, uint8_t type, uint8_t code, uint16_t sequence, const char *message,
+                     int64_t reply_ns);
+
+// @brief probe declared lost (no reply)
+void outputTimeout(ping_target_t *target, uint16_t sequence);
+
+// @brief summary record of a target: the final one, or an interim one (event snapshot, SIGQUIT / SIGUSR1) if 'interim' is set
+void outputSummary(ping_target_t *target, int interim);
+
+// @brief flushes the buffer when the flush interval has elapsed since the last flush (called from the ping loop)
+void outputTick(void);
+
+// @brief writes whatever is left (blocking) and frees the buffer
+void closeOutput(void);
+
+#endif
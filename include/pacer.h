@@ -0,0 +1,25 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// token bucket pacer (--rate / --burst): tokens accrue at state.rate per second up to state.burst,
+// a probe is sent per token; deadlines are absolute CLOCK_MONOTONIC nanoseconds (see get_nanoseconds)
+
+// @brief starts the bucket at now_ns with a single token (the first probe goes out right away)
+void initPacer(uint64_t now_ns);
+
+// @brief refills the bucket up to now_ns and takes every whole token out of it
+// @return the number of probes that may be sent now (at most state.burst)
+size_t takePacerTokens(uint64_t now_ns);
+
+// @brief returns the time at which the next token will be there
+uint64_t nextPacerDeadline(uint64_t now_ns);
+
+// @brief busy-waits until deadline_ns (for the last stretch, shorter than the timer's wake up latency)
+// and records how late that leaves us (state.pacer_* statistics)
+// @return the current time
+uint64_t spinUntilDeadline(uint64_t deadline_ns);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+// packet ring receive backend (--packet-ring): an AF_PACKET socket with a TPACKET_V3 ring mapped in our memory,
+// the kernel writes the IPv4 packets that pass the ICMP filter into blocks of the ring and hands a block over once it's
+// full or PACKET_RING_RETIRE_MS old; frames are parsed in place, with no copy and no system call per packet
+
+#define PACKET_RING_ERROR -1
+#define PACKET_RING_OK 0
+
+// @brief opens the packet socket (every interface, loopback included), maps its ring and attaches the ICMP filter
+// for the targets' identifiers; the ping socket is left for sending (a filter keeps it from queueing anything)
+// @return PACKET_RING_ERROR in case of error (errno is set), PACKET_RING_OK otherwise
+int openPacketRing(void);
+
+// @brief returns the packet socket, readable (poll) when a block is handed over to us, -1 if no ring is open
+int packetRingFd(void);
+
+// @brief parses and logs the packets of every block handed over to us, then gives the blocks back to the kernel
+void drainPacketRing(void);
+
+// @brief adds the kernel's ring statistics (PACKET_STATISTICS: packets, drops, queue freezes) to state.packet_ring_*
+// (the kernel resets them once read)
+void collectPacketRingStats(void);
+
+// @brief unmaps the ring and closes the packet socket
+void closePacketRing(void);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef PROBELOG_H
+#define PROBELOG_H
+
+#include <stdint.h>
+#include "ft_ping.h"
+
+// binary probe log: a header, a table of targets, then fixed-size records appended in time order
+// (read back by the ft_ping_analyze tool)
+
+#define PROBELOG_MAGIC "FTPLOG1"
+#define PROBELOG_VERSION 1
+#define PROBELOG_NAME_LEN 56
+
+#define PROBELOG_ERROR -1
+#define PROBELOG_OK 0
+
+// record kinds
+#define PROBE_REPLY 1          // first echo reply of a probe
+#define PROBE_DUPLICATE 2      // another echo reply of an already answered probe
+#define PROBE_ERROR 3          // ICMP error message about a probe
+#define PROBE_TIMEOUT 4        // probe that never got a reply
+#define PROBE_LATE 5           // echo reply of a probe already given up on (older than the sequence window)
+
+typedef struct probelog_header {
+    char magic[8];              // PROBELOG_MAGIC
+    uint32_t version;
+    uint32_t record_size;       // sizeof(probe_record_t)
+    uint32_t num_targets;       // entries in the targets table (right after the header)
+    uint32_t data_len;          // ICMP payload size of the probes
+    uint64_t num_records;       // records written so far (updated after each record)
+    uint64_t start_ns;          // start of the run (CLOCK_REALTIME nanoseconds)
+    uint8_t reserved[24];
+} probelog_header_t;            // 64 bytes
+
+typedef struct probelog_target {
+    uint32_t address;           // IPv4 address (network byte order), the last one the name resolved to (0 if it never did)
+    uint32_t reserved;
+    char name[PROBELOG_NAME_LEN]; // hostname as given (truncated, NUL terminated)
+} probelog_target_t;            // 64 bytes
+
+typedef struct probe_record {
+    uint64_t sent_ns;           // send time (CLOCK_REALTIME nanoseconds), 0 if unknown
+    uint64_t reply_ns;          // reply (or error) time, 0 for timeouts
+    uint32_t target;            // index in the targets table
+    uint16_t sequence;
+    uint16_t size;              // ICMP message size (bytes)
+    uint8_t kind;               // PROBE_REPLY, PROBE_DUPLICATE, PROBE_ERROR, PROBE_TIMEOUT or PROBE_LATE
+    uint8_t ttl;                // 0 if unknown (SOCK_DGRAM)
+    uint8_t icmp_type;          // PROBE_ERROR only
+    uint8_t icmp_code;          // PROBE_ERROR only
+    uint32_t reserved;
+} probe_record_t;               // 32 bytes
+
+// @brief creates (truncates) the log file at path, maps it and writes the header and the targets table
+// @return PROBELOG_ERROR in case of error (errno is set), PROBELOG_OK otherwise
+int openProbeLog(const char *path);
+
+// @brief writes the target's current address (dest_addr) into the targets table, once it's resolved or has moved;
+// no-op if no log is open
+void updateProbeLogTarget(ping_target_t *target);
+
+// @brief appends a record (the file grows, and is remapped, as needed); no-op if no log is open
+void appendProbeRecord(ping_target_t *target, uint8_t kind, uint16_t sequence, uint64_t sent_ns, uint64_t reply_ns,
+                       uint16_t size, uint8_t ttl, uint8_t icmp_type, uint8_t icmp_code);
+
+// @brief trims the file to the records written, unmaps and closes it
+void closeProbeLog(void);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+// receiver thread (--recv-thread): reads and timestamps the packets and runs the parse stage,
+// then hands the resulting ICMP events over to the main thread through a lock-free SPSC ring;
+// the main thread keeps sending, accounting and printing; the thread's own counters (receive calls, noise, ring usage)
+// are atomics only it writes, the main thread folds them into the state when it drains the ring
+
+#define RECEIVER_ERROR -1
+#define RECEIVER_OK 0
+
+// @brief starts the receiver thread (it reads state.sock_fd from now on)
+// @return RECEIVER_ERROR in case of error (errno is set), RECEIVER_OK otherwise
+int startReceiver(void);
+
+// @brief returns the file descriptor (eventfd) that is readable when events are waiting in the ring, -1 if no receiver runs
+int receiverEventFd(void);
+
+// @brief main thread: handles up to RECEIVER_DRAIN_BUDGET waiting events (handleIcmpEvent), so that sends are not held back
+// by a long backlog; the event fd stays readable while some are left
+void drainReceiver(void);
+
+// @brief stops and joins the receiver thread, then handles the events left in the ring and folds its last counters in
+void stopReceiver(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ft_ping.h"
+
+// asynchronous resolver: a pool of threads looks the host names up (hosts file, then DNS, then getaddrinfo) while the
+// main thread pings the targets that already have an address; answers are cached per name (a name given several times
+// is resolved once) and looked up again when their TTL runs out, moving the targets if the address changed
+
+#define RESOLVER_ERROR -1
+#define RESOLVER_OK 0
+
+// @brief names state.targets[i] after names[i] and starts resolving them: IP addresses are parsed right away,
+// host names are queued to the resolver threads (their targets stay RESOLUTION_PENDING until collected)
+// @return RESOLVER_ERROR in case of error (errno is set), RESOLVER_OK otherwise
+int startResolver(char **names, size_t num_names);
+
+// @brief main thread: applies the answers that came in to their targets (address, display address, routing)
+// and queues the lookups whose TTL ran out; resolved is called for each target that got its first answer
+// (RESOLUTION_DONE) or none at all (RESOLUTION_FAILED)
+// @return the number of answers applied
+size_t collectResolutions(uint64_t now_ns, void (*resolved)(ping_target_t *target));
+
+// @brief blocks until an answer is waiting to be collected, RESOLVER_WAIT_SLICE_MS at most (returns right away if no lookup
+// is in flight)
+void waitForResolutions(void);
+
+// @return the number of targets still waiting for their first answer
+size_t pendingResolutions(void);
+
+// @brief stops and joins the resolver threads (the targets keep their last answer)
+void stopResolver(void);
+
+#endif
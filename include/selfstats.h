@@ -0,0 +1,60 @@
+#ifndef SELFSTATS_H
+#define SELFSTATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// self-instrumentation (--self-stats): where the ping loop's own time goes, stage by stage, and how late the sends were
+// against their schedule; stage times are real CLOCK_MONOTONIC time (a simulation's virtual clock doesn't move while we work),
+// lateness is against the engine's clock (see get_nanoseconds)
+
+// stages of the ping loop
+#define SELF_STAGE_BUILD 0              // createIcmpEchoRequestMessage, one call per probe
+#define SELF_STAGE_SEND 1               // flushIcmpEchoMessages: the batch's sendmmsg() (io_uring: queueing the sends)
+#define SELF_STAGE_WAIT 2               // waitForEvents: asleep in epoll_wait() (io_uring: io_uring_enter, mock: its own wait)
+#define SELF_STAGE_SPIN 3               // rate mode: busy-waiting the last stretch before a send deadline (see pacer.h)
+#define SELF_STAGE_RECV 4               // recvmmsg() calls, the last empty one included
+#define SELF_STAGE_PARSE 5              // parsing and accounting of the received packets
+#define SELF_STAGE_DRAIN 6              // receive and parse together (--recv-thread, --packet-ring and --io-uring drains)
+#define SELF_STAGES 7
+
+typedef struct self_stage {
+    unsigned long calls;
+    unsigned long items;                // probes built or sent, packets received or parsed (0 for the wait, spin and drain stages)
+    uint64_t total_ns;
+    uint64_t max_ns;                    // longest call
+} self_stage_t;
+
+typedef struct self_stats {
+    self_stage_t stages[SELF_STAGES];
+    unsigned long wakeups_socket;       // waitForEvents returns: packets only, timer only, both, neither (signal)
+    unsigned long wakeups_timer;
+    unsigned long wakeups_both;
+    unsigned long wakeups_none;
+    unsigned long ticks;                // send ticks, and how late (nanoseconds) each one started after its deadline
+    double lateness_sum;
+    double lateness_sum_sq;
+    uint64_t lateness_max;
+    unsigned long schedule_resets;      // ticks more than an interval late: the schedule restarted from then
+    uint64_t loop_ns;                   // time spent in the ping loop
+} self_stats_t;
+
+// @brief returns the time a stage starts (CLOCK_MONOTONIC nanoseconds), 0 when --self-stats is off
+uint64_t selfStatsStart(void);
+
+// @brief records a call of the stage started at start_ns (see selfStatsStart) that handled 'items' items (nothing if start_ns is 0)
+void selfStatsRecord(int stage, uint64_t start_ns, unsigned long items);
+
+// @brief counts what a waitForEvents call returned
+void selfStatsWakeup(int events);
+
+// @brief records how late a send tick due at deadline_ns started (now_ns, engine clock)
+void selfStatsLateness(uint64_t deadline_ns, uint64_t now_ns);
+
+// @brief adds the counters of 'from' to 'into' (worker shards)
+void mergeSelfStats(self_stats_t *into, const self_stats_t *from);
+
+// @brief prints the --self-stats block to 'out'
+void printSelfStats(FILE *out);
+
+#endif
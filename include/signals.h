@@ -0,0 +1,31 @@
+#ifndef SIGNALS_H
+#define SIGNALS_H
+
+// signal handling: the handlers only raise a flag and wake the event loop up through a self-pipe (an eventfd), the main
+// loop does the actual work (printing, stopping) between two packets, so the counters it prints are never half updated;
+// SIGINT stops the run (a second one kills the process), SIGQUIT and SIGUSR1 ask for an interim summary
+
+#define SIGNALS_ERROR -1
+#define SIGNALS_OK 0
+
+// signals waiting to be serviced (bit flags, see takeSignals)
+#define SIGNAL_STOP 0x1                 // SIGINT: the run is to end now, with its summary
+#define SIGNAL_SNAPSHOT 0x2             // SIGQUIT or SIGUSR1: print an interim summary and go on
+
+// @brief creates the wake up eventfd (in place of one inherited from the parent process) and installs the handlers
+// (SIGQUIT and SIGUSR1 are ignored unless 'snapshots' is set); signals only come to the main thread (the other threads block them)
+// @return SIGNALS_ERROR in case of error (errno is set), SIGNALS_OK otherwise
+int openSignals(int snapshots);
+
+// @brief returns the file descriptor that is readable while signals wait to be taken, -1 if none (for the event loop)
+int signalsFd(void);
+
+// @brief takes the signals that came in: SIGNAL_SNAPSHOT once per request (several before a call count as one),
+// SIGNAL_STOP from the first SIGINT on, at every call
+// @return a combination of SIGNAL_STOP and SIGNAL_SNAPSHOT, 0 if none
+int takeSignals(void);
+
+// @brief restores the default handlers and closes the eventfd
+void closeSignals(void);
+
+#endif
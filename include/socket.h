@@ -2,6 +2,7 @@
 #define SOCKET_H
 
 #include <sys/socket.h>
+#include "ft_ping.h"
 
 // @brief creates an ICMP socket: socket type is SOCK_RAW if the user is privileged (or the CAP_NET_RAW capability is set for the binary executable),
 // the type is SOCK_DGRAM otherwise (a fallback to enable less privileged users to use ping utility)
@@ -10,15 +11,81 @@
 // @return SOCKET_ERROR to indicate error, SOCKET_OK otherwise
 int createPingSocket(int *sock_fd, int *type, char *program_name);
 
-// @brief sends an ICMP Echo Request message to the destination address (a field in state)
-int sendIcmpEchoMessage();
+// @brief attaches a classic BPF filter to fd, a socket that reads whole IP packets (the SOCK_RAW ping socket or the packet ring):
+// the kernel then only queues the echo replies whose identifier is in [first_identifier, first_identifier + count) (modulo 2^16)
+// and the ICMP error messages (destination unreachable, time exceeded, redirect) quoting such an echo request;
+// with count 0, nothing gets through
+// @return SOCKET_ERROR if the filter can't be attached, SOCKET_OK otherwise
+int attachIcmpFilter(int fd, uint16_t first_identifier, size_t count);
+
+// @brief reads the number of ICMP messages received by the host (Icmp InMsgs of /proc/net/snmp): every one of them is
+// offered to every raw ICMP socket, so what a socket didn't read was dropped by its filter
+// @return SOCKET_ERROR if the counter can't be read, SOCKET_OK otherwise
+int readIcmpInMessages(unsigned long *count);
+
+// @brief turns on kernel timestamps on the ping socket: receive timestamps (SO_TIMESTAMPNS) and, when supported,
+// software transmit timestamps reported on the error queue (SO_TIMESTAMPING)
+// @return SOCKET_ERROR if receive timestamps can't be enabled, SOCKET_OK otherwise
+int enableKernelTimestamps(void);
+
+// @brief frees the transmit timestamps table
+void disableKernelTimestamps(void);
+
+// @brief reads the transmit timestamps waiting on the socket error queue (non blocking) and files them under their probe
+void drainTxTimestamps(void);
+
+// @brief reads the kernel receive timestamp (SO_TIMESTAMPNS) out of the ancillary data of a received message (zero if there's none)
+void readRxTimestamp(struct msghdr *msg, struct timespec *rx_time);
+
+// @brief returns the kernel transmit timestamp (CLOCK_REALTIME nanoseconds) of the target's probe with the given sequence, 0 if unknown
+int64_t getTxTimestamp(ping_target_t *target, uint16_t sequence);
+
+// @brief allocates the send batch: batch_size wire buffers of state.packet_size bytes and their sendmmsg() headers
+// @return SOCKET_ERROR in case of allocation failure, SOCKET_OK otherwise
+int createSendBatch(size_t batch_size);
+
+// @brief frees the send batch
+void destroySendBatch(void);
+
+// @brief returns the wire buffer of the next free slot of the send batch (the echo request is to be built there, in place),
+// NULL if the batch is full
+void *nextIcmpEchoSlot(void);
+
+// @brief queues the next free slot of the send batch (built with createIcmpEchoRequestMessage, no copy is made),
+// addressed to the target (the target's sequence is consumed)
+// @return the number of queued messages, SOCKET_ERROR if the batch is full
+ssize_t queueIcmpEchoMessage(ping_target_t *target);
+
+// @brief returns the number of messages queued and not yet sent
+size_t pendingIcmpEchoMessages(void);
+
+// @brief sends every queued message with sendmmsg() (one syscall per batch) and empties the batch; with the io_uring backend,
+// the messages are queued as submissions instead (sent with the next waitForEvents)
+// @return the number of messages sent (messages that couldn't be sent are dropped)
+ssize_t flushIcmpEchoMessages(void);
 
 // @brief closes sock_fd
 // @return SOCKET_ERROR to indicate error, SOCKET_OK otherwise
 int closePingSocket(int sock_fd);
 
-// @brief waits until a message is received, it is then read into buffer, the sender's address is set into sender_addr param
-// @return the number of bytes received in case of success, SOCKET_ERROR otherwise
-ssize_t recvMessage(void *buffer, size_t buffer_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len);
+// @brief allocates the receive ring: num_slots buffers sized for our replies (and ICMP errors) and their recvmmsg() headers
+// @return SOCKET_ERROR in case of allocation failure, SOCKET_OK otherwise
+int createRecvRing(size_t num_slots);
+
+// @brief frees the receive ring
+void destroyRecvRing(void);
+
+// @brief reads the packets waiting on the socket (without blocking) into the ring with a single recvmmsg() call
+// @param *slots is set to the first slot of the ring, the received packets are in slots 0 .. (returned value - 1)
+// @return the number of packets received (0 if none is waiting), SOCKET_ERROR in case of error
+ssize_t recvIcmpMessages(recv_slot_t **slots);
+
+// @brief same as recvIcmpMessages, but waits for the first packet (up to the socket's SO_RCVTIMEO); the call isn't counted
+// in state.recv_calls and recv_packets (the receiver thread, its only user, keeps its own counters)
+// @return the number of packets received, SOCKET_ERROR in case of error (errno is EAGAIN on timeout)
+ssize_t waitIcmpMessages(recv_slot_t **slots);
+
+// @brief returns the number of slots of the receive ring (max packets per recvIcmpMessages call)
+size_t recvRingCapacity(void);
 
 #endif
@@ -0,0 +1,49 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// lock-free single producer / single consumer ring of fixed-size records:
+// the producer only writes head, the consumer only writes tail (each on its own cache line),
+// and each side keeps a cached copy of the other's index so it only touches the shared line when it has to
+
+#define SPSC_OK 0
+#define SPSC_FULL 1
+#define SPSC_ERROR -1
+
+#define SPSC_CACHE_LINE 64
+
+typedef struct spsc_ring {
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t head;     // next record to write (producer)
+    size_t cached_tail;                                 // producer's copy of tail
+    _Alignas(SPSC_CACHE_LINE) _Atomic size_t tail;     // next record to read (consumer)
+    size_t cached_head;                                 // consumer's copy of head
+    _Alignas(SPSC_CACHE_LINE) size_t mask;             // capacity - 1 (capacity is a power of two)
+    size_t record_size;
+    uint8_t *records;
+} spsc_ring_t;
+
+// @brief allocates a ring of capacity records (rounded up to a power of two) of record_size bytes each
+// @return SPSC_ERROR in case of error, SPSC_OK otherwise
+int createSpscRing(spsc_ring_t *ring, size_t capacity, size_t record_size);
+
+// @brief frees the records of the ring
+void destroySpscRing(spsc_ring_t *ring);
+
+// @brief producer: copies record into the ring
+// @return SPSC_FULL if there's no room (nothing is written), SPSC_OK otherwise
+int spscRingPush(spsc_ring_t *ring, const void *record);
+
+// @brief consumer: copies the oldest record out of the ring
+// @return 1 if a record was read, 0 if the ring is empty
+int spscRingPop(spsc_ring_t *ring, void *record);
+
+// @brief number of records in the ring (a snapshot: either side may move right after)
+size_t spscRingOccupancy(spsc_ring_t *ring);
+
+// @brief number of records the ring holds
+size_t spscRingCapacity(const spsc_ring_t *ring);
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef STATISTICS_H
 #define STATISTICS_H
 
-void signal_handler(int sig);
+// @brief prints the final summary (statistics of every target, then the run's own figures)
 void print_statistics(void);
 
+// @brief prints an interim summary (statistics of every target) while the run goes on (SIGQUIT / SIGUSR1, see signals.h)
+void print_interim_statistics(void);
+
 #endif
@@ -0,0 +1,57 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include "ft_ping.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define TARGET_ERROR -1
+#define TARGET_OK 0
+
+// @brief allocates the targets arena (state.targets) with num_targets zeroed records and the address lookup table
+// @return TARGET_ERROR in case of allocation failure, TARGET_OK otherwise
+int createTargets(size_t num_targets);
+
+// @brief registers state.targets[index] into the address lookup table (dest_addr must already be set)
+void registerTargetAddress(size_t index);
+
+// @brief removes state.targets[index] from the address lookup table (before its dest_addr changes); another target with
+// the same address takes its route over
+void unregisterTargetAddress(size_t index);
+
+// @brief returns the timer the probe with the given index takes for its timeout (-W), NULL if probes have no timeout
+wheel_timer_t *probeTimer(ping_target_t *target, uint64_t index);
+
+// @return 1 if the timeout (-W) of the probe with the given index is still running (its timer wasn't handed over to a newer
+// probe meanwhile), 0 otherwise
+int probeTimeoutPending(ping_target_t *target, uint64_t index);
+
+// @brief records that the kernel refused to send the probe with the given sequence (a send error, the probe is
+// neither awaited nor reported lost)
+void markProbeUnsent(ping_target_t *target, uint16_t sequence);
+
+// @return 1 if the probe with the given index (one of the last SEQUENCE_WINDOW) was refused by the kernel, 0 otherwise
+int probeUnsent(ping_target_t *target, uint64_t index);
+
+// @brief probes of the target still waited for: sent among the last SEQUENCE_WINDOW, not answered, and within their
+// timeout (-W) if probes have one (an interim summary counts them apart, neither received nor lost yet)
+size_t countProbesInFlight(ping_target_t *target);
+
+// @brief send time (CLOCK_REALTIME nanoseconds) of the probe with the given sequence, among the last SEQUENCE_WINDOW ones
+// @return 0 if it isn't kept (send times are only kept for the probe log)
+uint64_t probeSendTime(ping_target_t *target, uint16_t sequence);
+
+// @brief frees the targets arena and the address lookup table
+void destroyTargets(void);
+
+// @brief routes an incoming packet to its target: by ICMP identifier when the socket is SOCK_RAW (the address must
+// match the target's too), by address otherwise (the kernel overrides the identifier of SOCK_DGRAM sockets, so it tells
+// nothing about the target)
+// @return the target the packet belongs to, NULL if it belongs to none of them
+ping_target_t *findTarget(uint16_t identifier, in_addr_t s_addr);
+
+// @brief looks up a target by its destination address
+// @return the first target with the given address, NULL if none
+ping_target_t *findTargetByAddress(in_addr_t s_addr);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// hashed timer wheel: TIMER_WHEEL_SLOTS buckets of tick_ns each, a timer sits in the bucket of its expiry tick
+// (modulo the number of slots) on an intrusive doubly linked list, so that adding, cancelling and expiring a timer is O(1);
+// deadlines are absolute CLOCK_MONOTONIC nanoseconds (see get_nanoseconds)
+
+#define WHEEL_OK 0
+#define WHEEL_ERROR -1
+
+typedef struct wheel_timer {
+    struct wheel_timer *next;
+    struct wheel_timer **pprev;         // link pointing to this timer (NULL while the timer isn't pending)
+    uint64_t expires_tick;
+    void *owner;                        // left to the user (given back on expiry)
+    uint64_t id;
+} wheel_timer_t;
+
+// @brief sets up the wheel at now_ns, with a tick such that a timer of timeout_ns lands within one turn of the wheel
+// @return WHEEL_ERROR in case of error, WHEEL_OK otherwise
+int initTimerWheel(uint64_t now_ns, uint64_t timeout_ns);
+
+// @brief (re)schedules timer to expire at expires_ns (rounded up to the next tick)
+void addWheelTimer(wheel_timer_t *timer, uint64_t expires_ns);
+
+// @brief unschedules timer (no-op if it isn't pending)
+void cancelWheelTimer(wheel_timer_t *timer);
+
+// @return 1 if timer is scheduled and hasn't expired yet, 0 otherwise
+int wheelTimerPending(const wheel_timer_t *timer);
+
+// @brief turns the wheel up to now_ns, unscheduling every timer that expired and calling expire on it
+// @return the number of expired timers
+size_t expireWheelTimers(uint64_t now_ns, void (*expire)(wheel_timer_t *timer));
+
+// @brief returns the start of the next tick that has a timer in its bucket (0 if no timer is pending);
+// it's a lower bound (the timer may be due on a later turn of the wheel)
+uint64_t nextWheelExpiry(void);
+
+// @return the number of pending timers
+size_t pendingWheelTimers(void);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+
+// transport: how the ping loop's packets go out and come in, and how it sleeps until they do; the kernel's (the ping socket)
+// by default, the in-memory mock in simulations (see mock.h)
+
+struct mmsghdr; // <sys/socket.h> only declares it with _GNU_SOURCE
+
+typedef struct ping_transport {
+    const char *name;
+
+    // @brief sendmmsg() semantics: sends up to count messages (their msg_len is set)
+    // @return the number of messages sent, -1 in case of error (errno is set)
+    int (*send)(struct mmsghdr *msgs, unsigned int count);
+
+    // @brief recvmmsg() semantics, flags MSG_DONTWAIT or MSG_WAITFORONE: fills up to count messages (msg_len, msg_namelen
+    // and msg_controllen are set)
+    // @return the number of messages received, -1 in case of error (errno is EAGAIN if nothing is waiting)
+    int (*recv)(struct mmsghdr *msgs, unsigned int count, int flags);
+
+    // @brief sleeps until packets are waiting or the absolute CLOCK_MONOTONIC deadline (nanoseconds) is reached;
+    // NULL if the event loop waits on the ping socket itself (epoll, see event.h)
+    // @return a combination of EVENT_SOCKET_READABLE and EVENT_TIMER_EXPIRED, 0 if interrupted, EVENT_ERROR in case of error
+    int (*wait)(uint64_t deadline_ns);
+} ping_transport_t;
+
+// @brief returns the transport in use
+const ping_transport_t *getTransport(void);
+
+// @brief makes the ping loop use 'transport' (NULL restores the kernel's: sendmmsg/recvmmsg on state.sock_fd)
+void setTransport(const ping_transport_t *transport);
+
+#endif
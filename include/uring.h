@@ -0,0 +1,46 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "ft_ping.h"
+
+// io_uring I/O backend (--io-uring): a multishot recvmsg stays posted on the ping socket and picks its buffers from a ring
+// of provided buffers, sends are queued as sendmsg submissions; both are handed to the kernel by the io_uring_enter that
+// waits for the next event, so a whole tick (sends, receives, sleep) costs a single system call
+
+#define URING_ERROR -1
+#define URING_OK 0
+
+// @brief sets up the ring (raw io_uring_setup / io_uring_register, no liburing), registers the provided receive buffers
+// and queues the multishot receive on state.sock_fd
+// @return URING_ERROR if io_uring (or a feature we need: multishot receive, provided buffer rings, wait timeouts)
+// isn't available (errno is set), URING_OK otherwise
+int openUring(void);
+
+// @brief returns 1 once the ring is set up (the ping socket is then only read and written through it), 0 otherwise
+int uringActive(void);
+
+// @brief queues a sendmsg submission for the target's probe with the given sequence (no copy: the header and its buffer
+// must stay untouched until the send completes, see completeUringSends)
+// @return URING_ERROR if the submission queue can't be flushed to make room, URING_OK otherwise
+int queueUringSend(struct msghdr *msg, ping_target_t *target, uint16_t sequence);
+
+// @brief waits until every queued send is completed (their buffers are free again), the completions met on the way are handled
+void completeUringSends(void);
+
+// @brief submits what is queued and sleeps until a completion comes in or the absolute CLOCK_MONOTONIC deadline
+// (nanoseconds, see get_nanoseconds) is reached, with a single io_uring_enter
+// @return a combination of EVENT_SOCKET_READABLE (completions are waiting) and EVENT_TIMER_EXPIRED, 0 if interrupted
+// by a signal, URING_ERROR in case of error
+int waitUringEvents(uint64_t deadline_ns);
+
+// @brief handles the completions waiting in the completion queue: received packets are parsed and logged (their buffers
+// go back to the kernel), failed sends are taken back, and the receive is posted again if it stopped
+void drainUring(void);
+
+// @brief unmaps the rings and closes the io_uring instance (what's in flight is cancelled)
+void closeUring(void);
+
+#endif
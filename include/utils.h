@@ -3,6 +3,14 @@
 
 #include <stdint.h>
 
+// clock read by the engine (get_nanoseconds, get_realtime_nanoseconds, wait_until_nanoseconds): the system clocks by default,
+// a virtual clock in simulations (see mock.h)
+typedef struct ping_clock {
+    uint64_t (*monotonic_ns)(void);         // CLOCK_MONOTONIC nanoseconds
+    int64_t (*realtime_ns)(void);           // CLOCK_REALTIME nanoseconds
+    void (*advance)(uint64_t monotonic_ns); // moves the clock forward to the given time (instead of busy-waiting for it)
+} ping_clock_t;
+
 char   *ft_strjoin(char const *s1, char const *s2);
 
 // @brief logs the error message and exits with the exit status in 'status' argument
@@ -17,7 +25,17 @@ void   infoLogger(char *message);
 // @brief displays ping results
 void   resultLogger(char *result);
 
-// @brief returns current time in milliseconds
-uint32_t get_milliseconds();
+// @brief returns current CLOCK_MONOTONIC time in nanoseconds
+uint64_t get_nanoseconds();
+
+// @brief returns current CLOCK_REALTIME time in nanoseconds (send and receive times of the probes)
+int64_t get_realtime_nanoseconds();
+
+// @brief busy-waits until the CLOCK_MONOTONIC deadline (nanoseconds), a virtual clock jumps there instead
+// @return the time it is then (the deadline or later)
+uint64_t wait_until_nanoseconds(uint64_t deadline_ns);
+
+// @brief makes the clock functions read 'clock' (NULL restores the system clocks)
+void set_clock(const ping_clock_t *clock);
 
 #endif
@@ -0,0 +1,15 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+// multi-core mode (--workers): state.workers processes, each pinned to a core, pinging the targets with their own socket,
+// their own range of identifiers (a BPF filter makes the kernel deliver each socket its own replies only)
+// and their own statistics (a shard, merged into state once they're done)
+
+#define WORKERS_ERROR -1
+#define WORKERS_OK 0
+
+// @brief forks the workers and waits for them (SIGINT is forwarded), then merges their statistics into state and state.targets
+// (exits on failure to start them)
+void runWorkers(void);
+
+#endif
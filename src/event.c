@@ -0,0 +1,130 @@
+// event loop: epoll over the ping socket, a timerfd holding the next deadline and the signals' wake up fd (or the io_uring
+// backend's completion queue, or the transport's own wait)
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "event.h"
+#include "signals.h"
+#include "transport.h"
+#include "uring.h"
+
+static int epoll_fd = -1;
+static int timer_fd = -1;
+static int socket_fd = -1;
+static int (*wait_hook)(uint64_t deadline_ns) = NULL; // waits in place of epoll (io_uring backend, mock transport)
+static uint64_t timer_deadline = 0;
+
+int createEventLoop(int sock_fd) {
+    // io_uring backend: waiting is part of the tick's io_uring_enter, the deadline is its timeout
+    // (a transport without a socket, the mock, waits its own way too)
+    wait_hook = uringActive() ? waitUringEvents : getTransport()->wait;
+    if (wait_hook) {
+        return (EVENT_OK);
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        return (EVENT_ERROR);
+    }
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        closeEventLoop();
+        return (EVENT_ERROR);
+    }
+
+    struct epoll_event ev = {0};
+
+    ev.events = EPOLLIN;
+    ev.data.fd = sock_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock_fd, &ev) < 0) {
+        closeEventLoop();
+        return (EVENT_ERROR);
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = timer_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) < 0) {
+        closeEventLoop();
+        return (EVENT_ERROR);
+    }
+
+    // a signal wakes the loop up (it's taken by the loop, see takeSignals)
+    ev.events = EPOLLIN;
+    ev.data.fd = signalsFd();
+    if (ev.data.fd >= 0 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+        closeEventLoop();
+        return (EVENT_ERROR);
+    }
+
+    socket_fd = sock_fd;
+    return (EVENT_OK);
+}
+
+int armEventTimer(uint64_t deadline_ns) {
+    struct itimerspec its = {0};
+
+    timer_deadline = deadline_ns;
+    if (wait_hook) {
+        return (EVENT_OK);
+    }
+
+    // a zero it_value would disarm the timer (deadline 0 means "now")
+    if (deadline_ns == 0) {
+        deadline_ns = 1;
+    }
+
+    its.it_value.tv_sec = deadline_ns / 1000000000ULL;
+    its.it_value.tv_nsec = deadline_ns % 1000000000ULL;
+
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        return (EVENT_ERROR);
+    }
+
+    return (EVENT_OK);
+}
+
+int waitForEvents(void) {
+    struct epoll_event events[3];
+
+    if (wait_hook) {
+        return (wait_hook(timer_deadline));
+    }
+
+    int n = epoll_wait(epoll_fd, events, 3, -1);
+    if (n < 0) {
+        return (errno == EINTR) ? 0 : EVENT_ERROR;
+    }
+
+    int ret = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == socket_fd) {
+            ret |= EVENT_SOCKET_READABLE;
+        } else if (events[i].data.fd == timer_fd) {
+            // consume the expiration count so the timerfd stops being readable
+            uint64_t expirations;
+            if (read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                ret |= EVENT_TIMER_EXPIRED;
+            }
+        }
+    }
+
+    return (ret);
+}
+
+void closeEventLoop(void) {
+    if (timer_fd >= 0) {
+        close(timer_fd);
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+    }
+    timer_fd = -1;
+    epoll_fd = -1;
+    socket_fd = -1;
+    wait_hook = NULL;
+}
@@ -0,0 +1,70 @@
+// HDR-style latency histogram (log-bucketed, constant memory, O(1) recording)
+
+#include <stdint.h>
+#include "histogram.h"
+
+#define SUB_BUCKETS (1u << HISTOGRAM_SUB_BITS)
+
+uint32_t histogramBucketIndex(uint64_t value_ns) {
+    if (value_ns >> HISTOGRAM_MAX_BITS) {
+        value_ns = ((uint64_t)1 << HISTOGRAM_MAX_BITS) - 1; // clamp
+    }
+
+    // values below 2 * SUB_BUCKETS get a bucket each; above, the range [2^msb, 2^(msb+1)) is split into SUB_BUCKETS buckets
+    // of width 2^shift, and each range starts SUB_BUCKETS buckets after the previous one
+    uint32_t msb = 63 - __builtin_clzll(value_ns | 1);
+    uint32_t shift = (msb > HISTOGRAM_SUB_BITS) ? msb - HISTOGRAM_SUB_BITS : 0;
+
+    return ((shift << HISTOGRAM_SUB_BITS) + (uint32_t)(value_ns >> shift));
+}
+
+uint64_t histogramBucketUpperBound(uint32_t index) {
+    if (index < 2 * SUB_BUCKETS) {
+        return (index);
+    }
+
+    uint32_t shift = index / SUB_BUCKETS - 1;
+    uint64_t mantissa = index - shift * SUB_BUCKETS; // in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+
+    return ((mantissa << shift) + ((uint64_t)1 << shift) - 1);
+}
+
+void histogramRecord(latency_histogram_t *histogram, uint64_t value_ns) {
+    histogram->counts[histogramBucketIndex(value_ns)] += 1;
+    histogram->total += 1;
+}
+
+uint64_t histogramPercentile(const latency_histogram_t *histogram, double percentile) {
+    if (histogram->total == 0) {
+        return (0);
+    }
+
+    if (percentile < 0.0) {
+        percentile = 0.0;
+    } else if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+
+    // rank of the value we're looking for (at least the first one)
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            return (histogramBucketUpperBound(i));
+        }
+    }
+
+    return (histogramBucketUpperBound(HISTOGRAM_BUCKETS - 1));
+}
+
+void histogramMerge(latency_histogram_t *dst, const latency_histogram_t *src) {
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+}
@@ -8,6 +8,11 @@
 #include <arpa/inet.h>
 #include <stdint.h>
 #include "icmp.h"
+#include "target.h"
+#include "socket.h"
+#include "output.h"
+#include "probelog.h"
+#include "metrics.h"
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
@@ -17,173 +22,100 @@
 
 extern ping_state_t state;
 
-// @brief calculates the checksum of the ICMP ECHO message 
-// @param request is expected to have all fields set and checksum field is zero
-static uint16_t calculateChecksum(void) {
+// payload layout: struct timeval send time, then (if the payload is big enough) the probe index
+#define PROBE_INDEX_OFFSET sizeof(struct timeval)
+
+// @brief ones' complement sum (not folded) of the big-endian 16-bit words of bytes (an odd trailing byte is padded with zero)
+static uint32_t sum_words(const uint8_t *bytes, size_t len) {
     uint32_t sum = 0;
- 
-    // Checksum header
-    uint8_t bytes[sizeof(state.packet.header)];
-    memcpy(bytes, &(state.packet.header), sizeof(state.packet.header));
-    for (size_t i = 0; i < sizeof(icmp_echo_header_t); i += 2) {
-        uint16_t word = (bytes[i] << 8) + bytes[i + 1];
-        sum += word;
-    }
- 
-    // Checksum data
-    if (state.packet.data && state.packet.data_len) {
-        uint8_t *bytes = state.packet.data;
-        for (size_t i = 0; i < state.packet.data_len; i += 2) {
-            uint16_t word;
-            if (i + 1 < state.packet.data_len) {
-                word = (bytes[i] << 8) + bytes[i + 1];
-            } else {
-                word = bytes[i] << 8;  // odd byte handling
-            }
-            sum += word;
-        }
+
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (bytes[i] << 8) + bytes[i + 1];
+    }
+    if (len & 1) {
+        sum += bytes[len - 1] << 8;  // odd byte handling
     }
 
+    return (sum);
+}
+
+// @brief folds a 32-bit ones' complement sum into 16 bits
+static uint16_t fold_sum(uint32_t sum) {
     while (sum >> 16) {
         sum = (sum & 0xFFFF) + (sum >> 16);
     }
-
-    // return negation of the sum (1's complement)
-    return (~sum);
+    return (sum);
 }
 
-
-int createIcmpEchoRequestMessage() {
-    // (*) header
+int initIcmpEchoRequestTemplate(void) {
+    // (*) constant header fields
     state.packet.header.type = ICMP_ECHO;
     state.packet.header.code = 0;
-    state.packet.header.identifier = htons(state.identifier); // overwritten by the kernel in case of SOCK_DGRAM socket (user lacking privileges)
-    state.packet.header.sequence = htons(state.sequence);
-    state.packet.header.checksum = 0;  // Will be calculated
-
-    // (*) data
-    if (state.packet.data && state.packet.data_len) {
-        size_t off = 0;
-        size_t len = state.packet.data_len;
-        if (state.packet.data_len >= sizeof(struct timeval)) {
-            // timestamp
-            len -= sizeof(struct timeval);
-            off += sizeof(struct timeval);
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
-            tv.tv_sec = tv.tv_sec; // not interpreted by the receiver (so no need to convert it into network byte order)
-            tv.tv_usec = tv.tv_usec; // same as above
-            memcpy(state.packet.data, &tv, sizeof(tv));
-        }
+    state.packet.header.identifier = 0;
+    state.packet.header.sequence = 0;
+    state.packet.header.checksum = 0;
 
-        // filling remaining data with zeros
-        memset(state.packet.data + off, 0, len);
-    }
-
-    // (*) checksum
-
-    // now we're ready to calculate the checksum
-    state.packet.header.checksum = htons(calculateChecksum());
+    // (*) partial checksum of everything that never changes (identifier, sequence and timestamp are zero here, and so is the
+    // rest of the payload), each probe only adds its own words to it (RFC 1071 / RFC 1624: the sum is order independent)
+    uint8_t bytes[sizeof(state.packet.header)];
+    memcpy(bytes, &(state.packet.header), sizeof(state.packet.header));
+    state.packet.base_sum = fold_sum(sum_words(bytes, sizeof(bytes)));
 
     return (ICMP_OK);
 }
 
-
-// (*) parsing incoming packets
-
-// @returns ICMP_ERROR in case of error, ICMP_OK in case everything went successfully, NETWORK_NOISE in case of the network packet isn't meant for our Process
-static int handle_echo_reply(struct icmphdr *icmp_header, void *data, size_t data_len, size_t icmp_message_len, uint8_t ttl) {
-    if (!icmp_header) {
-        debugLogger("handle_echo_reply: pointer args cannot be null");
+int createIcmpEchoRequestMessage(ping_target_t *target, void *wire) {
+    if (!target || !wire) {
+        debugLogger("createIcmpEchoRequestMessage: pointer args cannot be NULL");
         return (ICMP_ERROR);
     }
 
-    // validating the identifier only if the socket type is SOCK_RAW (useless_identifier is set to 0)
-    if (state.useless_identifier == 0 && state.identifier != ntohs(icmp_header->un.echo.id)) {
-        // infoLogger("handle_echo_reply: received packet has a different ID (to be ignored)");
-        return (PARSE_NETWORK_NOISE); // ignore
-    }
-
-    uint16_t packet_sequence = ntohs(icmp_header->un.echo.sequence);
-    int isDuplicate = 0;
-
-    if (state.received[packet_sequence] == 1) {
-        isDuplicate = 1;
-        state.num_rept += 1; // increment number of duplicates
-    }
-
-    // RRT (round-trip time)
-    float rrt = -1;
+    // the wire buffer already holds the template (header constants + payload fill), only the per-probe words are written
+    uint8_t *bytes = wire;
+    icmp_echo_header_t header = state.packet.header;
 
-    if (data_len >= sizeof(struct timeval)) {
-        struct timeval sent_time;
-        struct timeval reply_time;
+    // (*) header
+    header.identifier = htons(target->identifier); // overwritten by the kernel in case of SOCK_DGRAM socket (user lacking privileges)
+    header.sequence = htons(target->sequence);
 
-        // using memcpy to prevent alignment issues in some systems (good practice)
-        memcpy(&sent_time, data, sizeof(sent_time));
+    uint32_t sum = state.packet.base_sum + target->identifier + target->sequence;
 
-        gettimeofday(&reply_time, NULL);
-        long seconds_diff = reply_time.tv_sec - sent_time.tv_sec; // sent_time fields are not sent in network byte order (so they are fine)
-        long useconds_diff = reply_time.tv_usec - sent_time.tv_usec;
+    int64_t now_ns = 0;
 
-        if (useconds_diff < 0) {
-            seconds_diff -= 1;
-            useconds_diff += 1000000;
-        }
-        rrt = (seconds_diff * 1000.0) + (useconds_diff / 1000.0);
+    // (*) data: timestamp, then the 64 bits probe index when there's room for it
+    if (state.packet.data_len >= sizeof(struct timeval)) {
+        now_ns = get_realtime_nanoseconds();
+        struct timeval tv = { .tv_sec = now_ns / 1000000000LL, .tv_usec = (now_ns % 1000000000LL) / 1000 };
+        size_t stamped_len = sizeof(tv);
 
-        if (!isDuplicate) {
-            // update statistics trackers (store in seconds to protect from overflow)
-            double rrt_s = seconds_diff + useconds_diff / 1000000.0;
+        // not interpreted by the receiver (so no need to convert it into network byte order)
+        memcpy(bytes + sizeof(icmp_echo_header_t), &tv, sizeof(tv));
 
-            state.rrt_sum += rrt_s;
-            state.rrt_sum_sq += rrt_s * rrt_s;
-            if (state.num_recv == 0) {
-                state.rrt_max = rrt_s;
-                state.rrt_min = rrt_s;
-            } else {
-                if (state.rrt_max < rrt_s) {
-                    state.rrt_max = rrt_s;
-                }
-                if (rrt_s < state.rrt_min) {
-                    state.rrt_min = rrt_s;
-                }
-            }
+        if (state.packet.data_len >= PROBE_INDEX_OFFSET + sizeof(uint64_t)) {
+            memcpy(bytes + sizeof(icmp_echo_header_t) + PROBE_INDEX_OFFSET, &target->probes, sizeof(uint64_t));
+            stamped_len = PROBE_INDEX_OFFSET + sizeof(uint64_t);
         }
+        sum += sum_words(bytes + sizeof(icmp_echo_header_t), stamped_len);
     }
 
-    // (*) printing result
-    if (state.quiet == 0 && state.flood == 0) {
-        printf("%zu bytes from %s: icmp_seq=%u", icmp_message_len, state.display_address, packet_sequence);
-        // include ttl only in case of SOCK_RAW
-        if (ttl != 0) {
-            printf(" ttl=%u", ttl);
-        }
-        if (rrt >= 0) {
-            printf(" time=%.3f ms", rrt);
-        }
-        if (isDuplicate) {
-            printf (" (DUP!)");
-        }
-        printf("\n");
-    }
+    // (*) checksum: O(1) whatever the payload size
+    header.checksum = htons(~fold_sum(sum));
+    memcpy(bytes, &header, sizeof(header));
 
-    // backspace when the packet is received back
-    if (state.flood == 1 && state.quiet == 0) {
-        printf("\b");
-        fflush(stdout);
+    // the probe log's records of probes without reply (timeouts, ICMP errors) take their send time from here
+    if (target->send_times) {
+        target->send_times[target->sequence % SEQUENCE_WINDOW] = now_ns ? now_ns : get_realtime_nanoseconds();
     }
 
-    // packet's sequence is consumed
-    state.received[packet_sequence] = 1; // mark sequence as received
-
-    if (!isDuplicate) {
-        state.num_recv += 1; // increment number of received packets
-    }
+    return (ICMP_OK);
+}
 
-    return (PARSE_OK);
+void copyIcmpEchoRequestTemplate(void *wire) {
+    memcpy(wire, &state.packet.header, sizeof(icmp_echo_header_t));
+    memset((uint8_t *)wire + sizeof(icmp_echo_header_t), 0, state.packet.data_len);
 }
 
+
 // helper
 // @brief given the icmp code of the ICMP dest unreachable error message, it returns the correspondent result or NULL if no such code is supported
 static const char *get_unreach_message(uint8_t icmp_code) {
@@ -245,16 +177,41 @@ static const char *get_time_exceeded_message(uint8_t icmp_code) {
     return (NULL);
 }
 
-// @returns ICMP_ERROR in case of error, ICMP_OK in case everything went successfully, NETWORK_NOISE in case of the network packet isn't meant for our Process
-static int handle_error_message(struct sockaddr_in *saddr, void *data, size_t data_len, size_t icmp_message_len, struct icmphdr *icmp_header) {
-    if (!saddr || !icmp_header) {
-        debugLogger("handle_error_message: pointer args cannot be NULL");
-        return (ICMP_ERROR);
+// (*) parsing incoming packets (parse stage: packet -> icmp_event_t, no shared state is read or written: the targets, whose
+// addresses the resolver may change, are only looked up by the handling stage)
+
+// @returns PARSE_OK if the echo reply is for one of our probes (event filled), NETWORK_NOISE otherwise
+static int parse_echo_reply(struct icmphdr *icmp_header, struct sockaddr_in *saddr, void *data, size_t data_len, icmp_event_t *event) {
+    // routed to its target by the handling stage (by identifier if the socket type is SOCK_RAW, by sender's address otherwise)
+    event->identifier = ntohs(icmp_header->un.echo.id);
+    event->route_addr = saddr->sin_addr.s_addr;
+    event->sequence = ntohs(icmp_header->un.echo.sequence);
+    event->sent_ns = 0;
+    event->has_probe_index = 0;
+
+    if (data_len >= PROBE_INDEX_OFFSET + sizeof(uint64_t)) {
+        memcpy(&event->probe_index, (uint8_t *)data + PROBE_INDEX_OFFSET, sizeof(uint64_t));
+        event->has_probe_index = 1;
     }
 
+    if (data_len >= sizeof(struct timeval)) {
+        struct timeval sent_time;
+
+        // using memcpy to prevent alignment issues in some systems (good practice)
+        memcpy(&sent_time, data, sizeof(sent_time));
+
+        // sent_time fields are not sent in network byte order (so they are fine)
+        event->sent_ns = (int64_t)sent_time.tv_sec * 1000000000LL + (int64_t)sent_time.tv_usec * 1000;
+    }
+
+    return (PARSE_OK);
+}
+
+// @returns PARSE_OK if the error message is about one of our probes (event filled), NETWORK_NOISE otherwise
+static int parse_error_message(void *data, size_t data_len, icmp_event_t *event) {
     // check if payload size matches the minimum size of an ip header and the size of icmp header (64 bits of original data)
     if (!data || data_len < sizeof(struct ip)) {
-        // infoLogger("handle_error_message: payload too small to include original ip header!"); 
+        // infoLogger("parse_error_message: payload too small to include original ip header!");
         return (PARSE_NETWORK_NOISE);
     }
 
@@ -264,14 +221,14 @@ static int handle_error_message(struct sockaddr_in *saddr, void *data, size_t da
 
     // ip header length should be between 5 and 15 (5 * 4 = 20; 15 * 4 = 60)
     if (!(orig_ip.ip_hl >= 5 && orig_ip.ip_hl <= 15)) {
-        // infoLogger("handle_error_message: invalid original IP header length");
+        // infoLogger("parse_error_message: invalid original IP header length");
         return (PARSE_NETWORK_NOISE);
     }
 
     size_t orig_ip_header_len = orig_ip.ip_hl << 2;
 
     if (data_len < orig_ip_header_len + sizeof(struct icmphdr)) {
-        // infoLogger("handle_error_message: payload too small to include original ip header and original icmp header (first 64 bits of original data)!");
+        // infoLogger("parse_error_message: payload too small to include original ip header and original icmp header (first 64 bits of original data)!");
         return (PARSE_NETWORK_NOISE);
     }
 
@@ -279,136 +236,29 @@ static int handle_error_message(struct sockaddr_in *saddr, void *data, size_t da
     struct icmphdr orig_icmp;
     memcpy(&orig_icmp, (uint8_t*)data + orig_ip_header_len, sizeof(struct icmphdr));
 
-    // check if the destination of the original message (the error is about) has the same destination as our ping destination
-    if (orig_ip.ip_dst.s_addr != state.dest_addr.sin_addr.s_addr) {
-        // infoLogger("handle_error_message: the original ip header has a different destination than ping's destination");
-        return (PARSE_NETWORK_NOISE); // ignore
-    }
-
     // check if it has the same protocol (ICMP)
     if (orig_ip.ip_p != IPPROTO_ICMP) {
-        // infoLogger("handle_error_message: the original ip header has a different protocol than ICMP");
+        // infoLogger("parse_error_message: the original ip header has a different protocol than ICMP");
         return (PARSE_NETWORK_NOISE); // ignore
     }
 
-    // check if the identifier is the same
-    if (state.useless_identifier == 0 && ntohs(orig_icmp.un.echo.id) != state.identifier) {
-        // infoLogger("handle_error_message: the original ip header has a different ICMP id");
-        return (PARSE_NETWORK_NOISE); // ignore (this error is for another process)
-    }
-
-    if (state.quiet == 0 && state.flood == 0) {
-        printf("%zu bytes from %s: ", icmp_message_len, inet_ntoa(saddr->sin_addr));
-    }
-
-    if (icmp_header->type == ICMP_DEST_UNREACH) {
-        const char *message = get_unreach_message(icmp_header->code);
-
-        if (state.quiet == 1) {
-            return (PARSE_OK);
-        } else if (state.flood == 1) {
-            printf("\b");
-            fflush(stdout);
-            return (PARSE_OK);
-        } else if (message) {
-            printf("%s\n", message);
-        } else {
-            printf("Destination Unreachable (unknown code: %d)\n", icmp_header->code);
-        }
-
-        // detailed error message if verbose mode on
-        size_t original_icmp_size = sizeof(struct icmphdr) + state.packet.data_len;
-        if (state.verbose) {
-            // IP header dump of the received packet
-            printf("IP Hdr Dump:\n");
-            uint8_t *ip_bytes = (uint8_t *)data;
-            for (size_t i = 0; i < orig_ip_header_len; i++) {
-                printf("%02x", ip_bytes[i]);
-                if (i % 2 == 1) printf(" "); // space every 2 bytes
-            }
-            if (orig_ip_header_len % 16 != 0) printf("\n");
-
-            // ICMP header info
-            printf("ICMP: type %d, code %d, size %zu, id 0x%x, seq 0x%04x\n", orig_icmp.type, orig_icmp.code, original_icmp_size, ntohs(orig_icmp.un.echo.id), ntohs(orig_icmp.un.echo.sequence));
-        }
+    // the handling stage checks that the original message (the error is about) was sent by us to one of our targets
+    // (same destination and same identifier)
+    event->identifier = ntohs(orig_icmp.un.echo.id);
+    event->route_addr = orig_ip.ip_dst.s_addr;
+    event->sequence = ntohs(orig_icmp.un.echo.sequence);
+    event->sent_ns = 0;
+    event->has_probe_index = 0;
+    event->orig_type = orig_icmp.type;
+    event->orig_code = orig_icmp.code;
+    event->orig_header_len = orig_ip_header_len;
+    memcpy(event->orig_header, data, orig_ip_header_len); // kept for the verbose dump
 
-
-        return (PARSE_OK);
-    }
-
-    // time exceeded message
-    if (icmp_header->type == ICMP_TIME_EXCEEDED) {
-        const char *message = get_time_exceeded_message(icmp_header->code);
-
-        if (state.quiet == 1) {
-            return (PARSE_OK);
-        } else if (state.flood == 1) {
-            printf("\b");
-            fflush(stdout);
-            return (PARSE_OK);
-        } else if (message) {
-            printf("%s\n", message);
-        } else {
-            printf("Time Exceeded (unknown code: %d)\n", icmp_header->code);
-        }
-
-        // detailed error message if verbose mode on
-        size_t original_icmp_size = sizeof(struct icmphdr) + state.packet.data_len;
-        if (state.verbose) {
-            // IP header dump of the received packet
-            printf("IP Hdr Dump:\n");
-            uint8_t *ip_bytes = (uint8_t *)data;
-            for (size_t i = 0; i < orig_ip_header_len; i++) {
-                printf("%02x", ip_bytes[i]);
-                if (i % 2 == 1) printf(" "); // space every 2 bytes
-            }
-            if (orig_ip_header_len % 16 != 0) printf("\n");
-
-            // ICMP header info
-            printf("ICMP: type %d, code %d, size %zu, id 0x%x, seq 0x%04x\n", orig_icmp.type, orig_icmp.code, original_icmp_size, ntohs(orig_icmp.un.echo.id), ntohs(orig_icmp.un.echo.sequence));
-        }
-
-        return (PARSE_OK);
-    }
-
-    // redirect message
-    if (icmp_header->type == ICMP_REDIRECT) {
-        const char *message = get_redirect_message(icmp_header->code);
-        if (state.quiet == 1) {
-            return (PARSE_OK);
-        } else if (state.flood == 1) {
-            printf("\b");
-            fflush(stdout);
-            return (PARSE_OK);
-        } else if (message) {
-            printf("%s\n", message); 
-        } else {
-            printf("Redirect (Unknown code: %d)\n", icmp_header->code);
-        }
-
-        // detailed error message if verbose mode on
-        size_t original_icmp_size = sizeof(struct icmphdr) + state.packet.data_len;
-        if (state.verbose) {
-            // IP header dump of the received packet
-            printf("IP Hdr Dump:\n");
-            uint8_t *ip_bytes = (uint8_t *)data;
-            for (size_t i = 0; i < orig_ip_header_len; i++) {
-                printf("%02x", ip_bytes[i]);
-                if (i % 2 == 1) printf(" "); // space every 2 bytes
-            }
-            if (orig_ip_header_len % 16 != 0) printf("\n");
-
-            // ICMP header info
-            printf("ICMP: type %d, code %d, size %zu, id 0x%x, seq 0x%04x\n", orig_icmp.type, orig_icmp.code, original_icmp_size, ntohs(orig_icmp.un.echo.id), ntohs(orig_icmp.un.echo.sequence));
-        }
-
-        return (PARSE_OK);
-    }
-    return (PARSE_NETWORK_NOISE); // ignore any other type
+    return (PARSE_OK);
 }
 
-int parseIcmpMessageAndLogResult(void *packet, size_t packet_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len) {
-    if (!packet || !sender_addr || !sender_addr_len) {
+int parseIcmpMessage(void *packet, size_t packet_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len, const struct timespec *rx_time, icmp_event_t *event) {
+    if (!packet || !sender_addr || !sender_addr_len || !event) {
         debugLogger("parseIcmpMessage: pointer args cannot be NULL");
         return (ICMP_ERROR);
     }
@@ -451,24 +301,312 @@ int parseIcmpMessageAndLogResult(void *packet, size_t packet_len, struct sockadd
     struct sockaddr_in *saddr = (struct sockaddr_in *)sender_addr;
     size_t data_len = packet_len - ip_header_len - sizeof(struct icmphdr);
     void *data = (uint8_t *)packet + ip_header_len + sizeof(struct icmphdr);
+    int status = PARSE_NETWORK_NOISE; // any other message type is to be ignored
 
     memcpy(&icmp_header, (uint8_t*)packet + ip_header_len, sizeof(icmp_header));
 
     if (icmp_header.type == ICMP_ECHOREPLY) {
-        // check if the sender's address is the same as the ping destination's address
-        if (state.dest_addr.sin_addr.s_addr != saddr->sin_addr.s_addr) {
-            debugLogger("parseIcmpMessage: received an ICMP echo reply packet from a different host than our destination (to be ignored)");
-            return (PARSE_NETWORK_NOISE); // ignore packet
+        status = parse_echo_reply(&icmp_header, saddr, data, data_len, event);
+    } else if (icmp_header.type == ICMP_DEST_UNREACH || icmp_header.type == ICMP_TIME_EXCEEDED || icmp_header.type == ICMP_REDIRECT) {
+        // ICMP error messages are handled and reported by default (unless suppressed by quiet mode)
+        status = parse_error_message(data, data_len, event);
+    }
+
+    if (status != PARSE_OK) {
+        return (status);
+    }
+
+    event->type = icmp_header.type;
+    event->code = icmp_header.code;
+    event->ttl = ttl;
+    event->message_len = packet_len - ip_header_len;
+    event->from = saddr->sin_addr;
+
+    // reception time: the kernel's when we have it, now otherwise (the parse stage runs right after the packet is read)
+    if (rx_time && (rx_time->tv_sec != 0 || rx_time->tv_nsec != 0)) {
+        event->reply_ns = (int64_t)rx_time->tv_sec * 1000000000LL + rx_time->tv_nsec;
+    } else {
+        event->reply_ns = get_realtime_nanoseconds() / 1000 * 1000; // microseconds, as the payload timestamp
+    }
+
+    return (PARSE_OK);
+}
+
+
+// (*) accounting and reporting (updates statistics and prints: runs on the thread that sends)
+
+// @brief finds the probe an echo reply answers (by the 64 bits index of the payload, or the most recent probe with that sequence
+// when the payload is too small to carry it) and tells whether it's its first reply, a duplicate, a late one or none of ours
+// @return REPLY_ON_TIME, REPLY_DUPLICATE, REPLY_LATE or REPLY_UNKNOWN (*probe is set to the probe's index but for the latter)
+static int classify_reply(ping_target_t *target, icmp_event_t *event, uint64_t *probe) {
+    if (target->probes == 0) {
+        return (REPLY_UNKNOWN);
+    }
+
+    uint64_t last = target->probes - 1;
+    uint64_t index;
+
+    if (event->has_probe_index) {
+        index = event->probe_index;
+        if ((uint16_t)index != event->sequence || index > last) {
+            return (REPLY_UNKNOWN);
+        }
+    } else {
+        index = last - (uint16_t)(last - event->sequence); // wraps below 0 (and is then > last) if no such probe was sent
+        if (index > last) {
+            return (REPLY_UNKNOWN);
+        }
+    }
+
+    *probe = index;
+
+    // the probe's window slot was reused by a newer probe: it was given up on
+    if (last - index >= SEQUENCE_WINDOW) {
+        return (REPLY_LATE);
+    }
+
+    uint16_t window_index = index % SEQUENCE_WINDOW;
+    if (target->received[window_index / 64] & ((uint64_t)1 << (window_index % 64))) {
+        return (REPLY_DUPLICATE);
+    }
+
+    // its timeout (-W) expired: it was already reported lost
+    if (target->timeouts && !probeTimeoutPending(target, index)) {
+        return (REPLY_LATE);
+    }
+    return (REPLY_ON_TIME);
+}
+
+static int handle_echo_reply(icmp_event_t *event) {
+    ping_target_t *target = event->target;
+    uint16_t packet_sequence = event->sequence;
+    uint16_t window_index = packet_sequence % SEQUENCE_WINDOW;
+    uint64_t window_bit = (uint64_t)1 << (window_index % 64);
+    uint64_t probe = 0;
+    int classification = classify_reply(target, event, &probe);
+
+    if (classification == REPLY_UNKNOWN) {
+        target->num_unknown += 1;
+        return (PARSE_NETWORK_NOISE); // ignore
+    }
+
+    int isDuplicate = (classification == REPLY_DUPLICATE);
+    int isLate = (classification == REPLY_LATE);
+
+    if (isDuplicate) {
+        target->num_rept += 1; // increment number of duplicates
+        state.num_rept += 1;
+    } else if (isLate) {
+        target->num_late += 1;
+    }
+
+    // RRT (round-trip time)
+    float rrt = -1;
+    int64_t sent_ns = event->sent_ns;
+
+    if (sent_ns != 0) {
+        // times in nanoseconds since the epoch: payload, kernel and userspace reply timestamps are all CLOCK_REALTIME
+        // the kernel transmit timestamp is preferred when it's consistent with the payload one (taken just before sending)
+        int64_t tx_ns = getTxTimestamp(target, packet_sequence);
+        if (tx_ns >= sent_ns && tx_ns - sent_ns < 1000000000LL) {
+            sent_ns = tx_ns;
         }
 
-        return (handle_echo_reply(&icmp_header, data, data_len, packet_len - ip_header_len, ttl));
+        int64_t diff_ns = event->reply_ns - sent_ns;
+        rrt = diff_ns / 1e6;
+
+        if (classification == REPLY_ON_TIME) {
+            // update statistics trackers (store in seconds to protect from overflow)
+            double rrt_s = diff_ns / 1e9;
+
+            if (target->histogram) {
+                histogramRecord(target->histogram, diff_ns > 0 ? (uint64_t)diff_ns : 0);
+            }
+            if (state.metrics_addr.sin_family) {
+                recordMetricsRtt(target, diff_ns > 0 ? (uint64_t)diff_ns : 0);
+            }
+
+            target->rrt_sum += rrt_s;
+            target->rrt_sum_sq += rrt_s * rrt_s;
+            if (target->num_recv == 0) {
+                target->rrt_max = rrt_s;
+                target->rrt_min = rrt_s;
+            } else {
+                if (target->rrt_max < rrt_s) {
+                    target->rrt_max = rrt_s;
+                }
+                if (rrt_s < target->rrt_min) {
+                    target->rrt_min = rrt_s;
+                }
+            }
+        }
     }
 
-    // ICMP error messages are handled and reported by default (unless suppressed by quiet mode)
-    if (icmp_header.type == ICMP_DEST_UNREACH || icmp_header.type == ICMP_TIME_EXCEEDED || icmp_header.type == ICMP_REDIRECT) {
-        return (handle_error_message(saddr, data, data_len, packet_len - ip_header_len, &icmp_header));
+    // (*) printing result
+    if (state.output_format != OUTPUT_TEXT) {
+        outputReply(target, packet_sequence, event->message_len, event->ttl, rrt, classification, event->reply_ns);
+    } else if (state.quiet == 0 && state.flood == 0) {
+        printf("%zu bytes from %s: icmp_seq=%u", event->message_len, target->display_address, packet_sequence);
+        // include ttl only in case of SOCK_RAW
+        if (event->ttl != 0) {
+            printf(" ttl=%u", event->ttl);
+        }
+        if (rrt >= 0) {
+            printf(" time=%.3f ms", rrt);
+        }
+        if (isDuplicate) {
+            printf (" (DUP!)");
+        } else if (isLate) {
+            printf (" (LATE!)");
+        }
+        printf("\n");
+    }
+
+    // backspace when the packet is received back
+    if (state.flood == 1 && state.quiet == 0 && state.output_format == OUTPUT_TEXT) {
+        printf("\b");
+        fflush(stdout);
+    }
+
+    appendProbeRecord(target, isDuplicate ? PROBE_DUPLICATE : (isLate ? PROBE_LATE : PROBE_REPLY), packet_sequence, event->sent_ns ? sent_ns : 0,
+                      event->sent_ns ? event->reply_ns : 0, event->message_len, event->ttl, 0, 0);
+
+    // a late reply's window slot belongs to a newer probe: it's left alone
+    if (isLate) {
+        return (PARSE_OK);
+    }
+
+    // packet's sequence is consumed
+    target->received[window_index / 64] |= window_bit; // mark sequence as received
+
+    if (!isDuplicate) {
+        target->num_recv += 1; // increment number of received packets
+        state.num_recv += 1;
+
+        // answered in time: its timeout (-W) is off
+        if (target->timeouts) {
+            cancelWheelTimer(probeTimer(target, probe));
+        }
+    }
+
+    return (PARSE_OK);
+}
+
+static int handle_error_message(icmp_event_t *event) {
+    const char *message = NULL;
+    const char *unknown_format = NULL;
+
+    if (event->type == ICMP_DEST_UNREACH) {
+        message = get_unreach_message(event->code);
+        unknown_format = "Destination Unreachable (unknown code: %d)\n";
+    } else if (event->type == ICMP_TIME_EXCEEDED) {
+        message = get_time_exceeded_message(event->code);
+        unknown_format = "Time Exceeded (unknown code: %d)\n";
+    } else if (event->type == ICMP_REDIRECT) {
+        message = get_redirect_message(event->code);
+        unknown_format = "Redirect (Unknown code: %d)\n";
+    } else {
+        return (PARSE_NETWORK_NOISE); // ignore any other type
+    }
+
+    ping_target_t *target = event->target;
+
+    target->num_unreach += (event->type == ICMP_DEST_UNREACH);
+    target->num_exceeded += (event->type == ICMP_TIME_EXCEEDED);
+    target->num_redirect += (event->type == ICMP_REDIRECT);
+
+    appendProbeRecord(event->target, PROBE_ERROR, event->sequence, probeSendTime(event->target, event->sequence), event->reply_ns,
+                      event->message_len, 0, event->type, event->code);
+
+    if (state.output_format != OUTPUT_TEXT) {
+        outputIcmpError(event->target, event->from, event->type, event->code, event->sequence, message, event->reply_ns);
+        return (PARSE_OK);
+    }
+
+    if (state.quiet == 1) {
+        return (PARSE_OK);
+    }
+
+    if (state.flood == 1) {
+        printf("\b");
+        fflush(stdout);
+        return (PARSE_OK);
+    }
+
+    printf("%zu bytes from %s: ", event->message_len, inet_ntoa(event->from));
+    if (message) {
+        printf("%s\n", message);
+    } else {
+        printf(unknown_format, event->code);
+    }
+
+    // detailed error message if verbose mode on
+    size_t original_icmp_size = sizeof(struct icmphdr) + state.packet.data_len;
+    if (state.verbose) {
+        // IP header dump of the received packet
+        printf("IP Hdr Dump:\n");
+        for (size_t i = 0; i < event->orig_header_len; i++) {
+            printf("%02x", event->orig_header[i]);
+            if (i % 2 == 1) printf(" "); // space every 2 bytes
+        }
+        if (event->orig_header_len % 16 != 0) printf("\n");
+
+        // ICMP header info
+        printf("ICMP: type %d, code %d, size %zu, id 0x%x, seq 0x%04x\n", event->orig_type, event->orig_code, original_icmp_size, event->identifier, event->sequence);
+    }
+
+    return (PARSE_OK);
+}
+
+int handleIcmpEvent(icmp_event_t *event) {
+    if (!event) {
+        debugLogger("handleIcmpEvent: event cannot be NULL");
+        return (ICMP_ERROR);
+    }
+
+    // routed here, on the main thread, where the targets' addresses change
+    event->target = findTarget(event->identifier, event->route_addr);
+    if (!event->target) {
+        // infoLogger("handleIcmpEvent: received packet doesn't belong to any of our targets (to be ignored)");
+        state.noise_packets += 1;
+        return (PARSE_NETWORK_NOISE); // ignore
+    }
+
+    if (event->type == ICMP_ECHOREPLY) {
+        return (handle_echo_reply(event));
+    }
+    return (handle_error_message(event));
+}
+
+int parseIcmpMessageAndLogResult(void *packet, size_t packet_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len, const struct timespec *rx_time) {
+    icmp_event_t event;
+    int status = parseIcmpMessage(packet, packet_len, sender_addr, sender_addr_len, rx_time, &event);
+
+    if (status != PARSE_OK) {
+        if (status == PARSE_NETWORK_NOISE) {
+            state.noise_packets += 1;
+        }
+        return (status);
+    }
+    return (handleIcmpEvent(&event));
+}
+
+size_t parseIcmpMessageBatch(recv_slot_t *slots, size_t count) {
+    size_t parsed = 0;
+
+    if (!slots) {
+        debugLogger("parseIcmpMessageBatch: slots cannot be NULL");
+        return (0);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (slots[i].len == 0) {
+            continue;
+        }
+        if (parseIcmpMessageAndLogResult(slots[i].data, slots[i].len, (struct sockaddr *)&slots[i].sender_addr, &slots[i].sender_addr_len, &slots[i].rx_time) == PARSE_OK) {
+            parsed += 1;
+        }
     }
 
-    // any other message type is to be ignored
-    return (PARSE_NETWORK_NOISE);
+    return (parsed);
 }
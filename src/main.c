@@ -1,11 +1,19 @@
+#include "icmp.h" // before macros.h (its PARSE_* macros would clash with the parse_status_t enum)
 #include "parsing.h"
 #include "macros.h"
 #include "socket.h"
 #include "ft_ping.h"
 #include "statistics.h"
 #include "utils.h"
-#include <float.h>
-#include <signal.h>
+#include "target.h"
+#include "output.h"
+#include "probelog.h"
+#include "resolver.h"
+#include "packetring.h"
+#include "uring.h"
+#include "mock.h"
+#include "metrics.h"
+#include "signals.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <netinet/in.h>
@@ -21,29 +29,45 @@ int main(int argc, char **argv) {
         errorLogger("missing host operand\nTry './ft_ping -h' for more information.", EX_USAGE);
     }
 
-    signal(SIGINT, signal_handler);
+    // SIGINT ends the run with its summary, SIGQUIT and SIGUSR1 print an interim one (all serviced by the ping loop)
+    if (openSignals(1) == SIGNALS_ERROR) {
+        errorLogger(ft_strjoin("signals: ", strerror(errno)), EXIT_FAILURE);
+    }
 
     // (*) input parsing
 
     // global state initialization
     state.program_name = argv[0];
-    state.identifier = getpid() & 0xFFFF;
-    state.sequence = 0;     // will increment for each packet
+    state.identifier = getpid() & 0xFFFF; // target i uses identifier + i
     state.count = 0;
     state.verbose = 0;
     state.quiet = 0;
     state.wait = DEFAULT_PING_WAIT;
+    state.probe_timeout = 0;
+    state.deadline = 0;
     state.flood = 0;
+    state.batch = DEFAULT_SEND_BATCH;
+    state.kernel_timestamps = 0;
+    state.icmp_filter = 1;
+    state.recv_thread = 0;
+    state.packet_ring = 0;
+    state.io_uring = 0;
+    state.simulate = 0;
+    state.self_stats = 0;
+    state.workers = 1;
+    state.rate = 0;
+    state.burst = 1;
+    state.output_format = OUTPUT_TEXT;
+    state.probe_log = NULL;
+    state.hosts_file = NULL;
+    memset(&state.dns_server, 0, sizeof(state.dns_server));
+    memset(&state.metrics_addr, 0, sizeof(state.metrics_addr));
     state.num_recv = 0;
     state.num_sent = 0;
     state.num_rept = 0;
     state.packet.data_len = DEFAULT_DATALEN;
-    state.rrt_max = 0.0;
-    state.rrt_min = DBL_MAX;
-    state.rrt_sum_sq = 0.0;
-    state.rrt_sum = 0.0;
-
-    char display_addr[MAX_IPV4_ADDR_LEN + 1] = {};
+    state.targets = NULL;
+    state.num_targets = 0;
 
     int host_index = parse_options(argc, argv);
 
@@ -51,62 +75,146 @@ int main(int argc, char **argv) {
         errorLogger("unknown host", EXIT_FAILURE);
     }
 
-    struct in_addr addr;
+    // (*) targets: every remaining argument is a host
+    size_t num_targets = argc - host_index;
 
-    char *input = argv[host_index];
-    if (parse_input_address(input, &addr, display_addr) == PARSE_ERROR) {
-        errorLogger("unknown host", EXIT_FAILURE);
+    if (num_targets > MAX_TARGETS) {
+        errorLogger("too many hosts", EX_USAGE);
+    }
+
+    // every worker takes its own range of identifiers
+    if (state.workers > 1) {
+        if (num_targets * state.workers > MAX_TARGETS) {
+            errorLogger("--workers: too many hosts for that many workers", EX_USAGE);
+        }
+        if (state.output_format != OUTPUT_TEXT || state.probe_log || state.metrics_addr.sin_family) {
+            errorLogger("--workers: not supported with --format, --probe-log or --metrics", EX_USAGE);
+        }
+    }
+
+    // the ring is read by the main thread of a single process
+    if (state.packet_ring && (state.workers > 1 || state.recv_thread)) {
+        errorLogger("--packet-ring: not supported with --workers or --recv-thread", EX_USAGE);
+    }
+
+    // the ring is set up and waited on by the main thread of a single process, and it reads the ping socket
+    if (state.io_uring && (state.workers > 1 || state.recv_thread || state.packet_ring)) {
+        errorLogger("--io-uring: not supported with --workers, --recv-thread or --packet-ring", EX_USAGE);
     }
 
-    struct sockaddr_in saddr;
+    // the simulation stands in for the ping socket, driven by the main thread of a single process
+    if (state.simulate && (state.workers > 1 || state.recv_thread || state.packet_ring || state.io_uring || state.kernel_timestamps)) {
+        errorLogger("--simulate: not supported with --workers, --recv-thread, --packet-ring, --io-uring or --kernel-timestamps", EX_USAGE);
+    }
 
-    memset(&saddr, 0, sizeof(saddr));
-    saddr.sin_family = AF_INET;
-    saddr.sin_port = 0;
-    saddr.sin_addr = addr;
-    state.hostname = input;
-    state.display_address = display_addr;
-    state.dest_addr = saddr;
+    if (createTargets(num_targets) == TARGET_ERROR) {
+        errorLogger(strerror(errno), EXIT_FAILURE);
+    }
+
+    // host names are resolved in the background (pinging starts with the first address known, see start_pinging)
+    if (startResolver(argv + host_index, num_targets) == RESOLVER_ERROR) {
+        errorLogger(ft_strjoin("resolver: ", strerror(errno)), EXIT_FAILURE);
+    }
 
-    // (*) raw ICMP socket creation
-    int sock_fd;
-    int sock_type;
+    // (*) raw ICMP socket creation (none in a simulation: the mock transport hands over what a raw socket would)
+    int sock_fd = -1;
+    int sock_type = SOCK_RAW;
 
-    if (createPingSocket(&sock_fd, &sock_type, argv[0]) == SOCKET_ERROR) {
+    if (!state.simulate && createPingSocket(&sock_fd, &sock_type, argv[0]) == SOCKET_ERROR) {
         int saved_errno = errno;
         const char *err_msg = (saved_errno != 0) ? strerror(saved_errno) : "socket creation error";
         errorLogger(ft_strjoin("socket: ", err_msg), EXIT_FAILURE);
     }
 
     // (*) initialize ping state
-    uint8_t received[MAX_SEQUENCE + 1] = {0};
-
     state.sock_fd = sock_fd;
     state.socket_type = sock_type;
     state.useless_identifier = (sock_type == SOCK_DGRAM); // if the created socket's type is SOCK_DGRAM then the kernel will override the ICMP ID (hence useless_identifier)
-    state.received = received;
 
-    state.packet.data = NULL;
+    state.packet_size = sizeof(icmp_echo_header_t) + state.packet.data_len;
 
-    if (state.packet.data_len) {
-        state.packet.data = malloc(state.packet.data_len);
+    if (createOutput(STDOUT_FILENO, state.output_format) == OUTPUT_ERROR) {
+        errorLogger(strerror(errno), EXIT_FAILURE);
+    }
 
-        if (!state.packet.data) {
-            errorLogger(strerror(errno), EXIT_FAILURE);
-        }
+    if (initIcmpEchoRequestTemplate() == ICMP_ERROR) {
+        errorLogger("unable to prepare ICMP echo request", EXIT_FAILURE);
+    }
+
+    if (createSendBatch(state.batch) == SOCKET_ERROR || createRecvRing(RECV_RING_SLOTS) == SOCKET_ERROR) {
+        errorLogger(strerror(errno), EXIT_FAILURE);
     }
 
     if (sock_type == SOCK_DGRAM) {
         infoLogger("Note: raw socket not permitted, using SOCK_DGRAM as a fallback");
     }
 
+    if (state.simulate) {
+        state.icmp_filter = 0;
+        if (openMockTransport(&state.simulation) == MOCK_ERROR) {
+            errorLogger(strerror(errno), EXIT_FAILURE);
+        }
+    } else {
+        // the raw socket gets a copy of every ICMP packet of the host: the noise is dropped in the kernel
+        // (ping sockets, SOCK_DGRAM, are already demultiplexed by the kernel)
+        if (sock_type == SOCK_RAW && state.icmp_filter && attachIcmpFilter(sock_fd, state.identifier, num_targets) == SOCKET_ERROR) {
+            infoLogger("Note: socket filter not supported, ICMP noise is dropped in userspace");
+            state.icmp_filter = 0;
+        }
+        if (readIcmpInMessages(&state.icmp_in_start) == SOCKET_ERROR) {
+            state.icmp_in_start = 0;
+        }
+    }
+
+    if (state.packet_ring) {
+        // frames carry the IP header and our identifiers: that's the raw socket's view of the replies
+        if (sock_type != SOCK_RAW) {
+            errorLogger("--packet-ring: requires a raw socket (root privileges)", EX_NOPERM);
+        }
+        if (openPacketRing() == PACKET_RING_ERROR) {
+            errorLogger(ft_strjoin("--packet-ring: ", strerror(errno)), EXIT_FAILURE);
+        }
+    }
+
+    if (state.kernel_timestamps && enableKernelTimestamps() == SOCKET_ERROR) {
+        infoLogger("Note: kernel timestamps not supported, measuring RTT in userspace");
+        state.kernel_timestamps = 0;
+    }
+
+    // the receive buffers have room for the timestamps, so the ring comes after them
+    if (state.io_uring && openUring() == URING_ERROR) {
+        infoLogger("Note: io_uring not available, using sendmmsg/recvmmsg");
+        state.io_uring = 0;
+    }
+
+    if (state.probe_log && openProbeLog(state.probe_log) == PROBELOG_ERROR) {
+        errorLogger(ft_strjoin("--probe-log: ", strerror(errno)), EXIT_FAILURE);
+    }
+
+    // the endpoint serves the counters the ping loop publishes (targets are known, addresses may not be yet)
+    if (state.metrics_addr.sin_family && startMetricsServer() == METRICS_ERROR) {
+        errorLogger(ft_strjoin("--metrics: ", strerror(errno)), EXIT_FAILURE);
+    }
+
     // (*) start pinging (ping loop)
     start_pinging();
+    stopMetricsServer();
+    closeOutput();
+    closeProbeLog();
+    closePacketRing();
+    closeUring();
+    closeMockTransport();
 
     // (*) raw ICMP socket closing
-    if (closePingSocket(sock_fd) == SOCKET_ERROR) {
+    if (!state.simulate && state.sock_fd >= 0 && closePingSocket(state.sock_fd) == SOCKET_ERROR) {
         errorLogger(ft_strjoin("socket: ", strerror(errno)), EXIT_FAILURE);
     }
+
+    disableKernelTimestamps();
+    destroyRecvRing();
+    destroySendBatch();
+    destroyTargets();
+    closeSignals();
  
     return (0);
 }
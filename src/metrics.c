@@ -0,0 +1,426 @@
+// metrics endpoint: HTTP server thread serving the last published snapshot of the counters (see metrics.h)
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "ft_ping.h"
+#include "macros.h"
+#include "metrics.h"
+#include "utils.h"
+
+extern ping_state_t state;
+
+// upper bounds (nanoseconds) of the RTT histogram buckets, a last one (+Inf) takes the rest
+static const uint64_t rtt_bounds_ns[] = {
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000, 1000000000, 2500000000, 5000000000, 10000000000,
+};
+#define RTT_BOUNDS (sizeof(rtt_bounds_ns) / sizeof(rtt_bounds_ns[0]))
+#define RTT_BUCKETS (RTT_BOUNDS + 1)
+
+// a target as published: its counters at one point of the ping loop
+typedef struct metrics_target {
+    const char *hostname;
+    char address[INET_ADDRSTRLEN];      // empty until the address is known
+    unsigned long sent;
+    unsigned long received;
+    unsigned long duplicates;
+    unsigned long late;
+    unsigned long unmatched;
+    unsigned long unreach;
+    unsigned long exceeded;
+    unsigned long redirect;
+    double rtt_sum;                     // seconds
+    uint64_t buckets[RTT_BUCKETS];      // RTTs per bucket (not cumulative)
+} metrics_target_t;
+
+// a text buffer that grows as the response is written
+typedef struct text_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+    int failed;                         // an allocation failed: the response is lost
+} text_buffer_t;
+
+static uint64_t *live_buckets = NULL;           // main thread: RTT_BUCKETS per target, bumped as replies come in
+static metrics_target_t *published = NULL;      // last snapshot (guarded by publish_lock)
+static unsigned long published_noise = 0;
+static metrics_target_t *scraped = NULL;        // server thread: its copy of the snapshot, formatted without the lock
+static unsigned long scraped_noise = 0;
+static pthread_mutex_t publish_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t last_publish_ns = 0;
+
+static pthread_t thread;
+static int listen_fd = -1;
+static atomic_int stop_requested = 0;
+static int running = 0;
+
+// (*) snapshot (main thread)
+
+// @brief copies the live counters into the published snapshot, unless a scrape is copying it right now
+// @return METRICS_ERROR if the snapshot is busy (nothing was published), METRICS_OK otherwise
+static int publish(void) {
+    if (pthread_mutex_trylock(&publish_lock) != 0) {
+        return (METRICS_ERROR);
+    }
+
+    for (size_t i = 0; i < state.num_targets; i++) {
+        ping_target_t *target = &state.targets[i];
+        metrics_target_t *snapshot = &published[i];
+
+        snapshot->hostname = target->hostname;
+        if (target->resolution == RESOLUTION_DONE) {
+            memcpy(snapshot->address, target->display_address, sizeof(snapshot->address));
+        } else {
+            snapshot->address[0] = '\0';
+        }
+        snapshot->sent = target->num_sent;
+        snapshot->received = target->num_recv;
+        snapshot->duplicates = target->num_rept;
+        snapshot->late = target->num_late;
+        snapshot->unmatched = target->num_unknown;
+        snapshot->unreach = target->num_unreach;
+        snapshot->exceeded = target->num_exceeded;
+        snapshot->redirect = target->num_redirect;
+        snapshot->rtt_sum = target->rrt_sum;
+        memcpy(snapshot->buckets, &live_buckets[i * RTT_BUCKETS], sizeof(snapshot->buckets));
+    }
+    published_noise = state.noise_packets;
+
+    pthread_mutex_unlock(&publish_lock);
+    return (METRICS_OK);
+}
+
+void recordMetricsRtt(ping_target_t *target, uint64_t rtt_ns) {
+    size_t bucket = 0;
+
+    while (bucket < RTT_BOUNDS && rtt_ns > rtt_bounds_ns[bucket]) {
+        bucket++;
+    }
+    live_buckets[(target - state.targets) * RTT_BUCKETS + bucket] += 1;
+}
+
+void metricsTick(void) {
+    if (!running) {
+        return ;
+    }
+
+    uint64_t now = get_nanoseconds();
+
+    if (now - last_publish_ns >= METRICS_PUBLISH_INTERVAL_NS && publish() == METRICS_OK) {
+        last_publish_ns = now;
+    }
+}
+
+// (*) response (server thread)
+
+static void append(text_buffer_t *buffer, const char *format, ...) {
+    while (!buffer->failed) {
+        va_list args;
+
+        va_start(args, format);
+        int written = vsnprintf(buffer->data + buffer->len, buffer->capacity - buffer->len, format, args);
+        va_end(args);
+
+        if (written < 0) {
+            buffer->failed = 1;
+            return ;
+        }
+        if (buffer->len + written < buffer->capacity) {
+            buffer->len += written;
+            return ;
+        }
+
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 65536;
+        char *grown = realloc(buffer->data, capacity);
+
+        if (!grown) {
+            buffer->failed = 1;
+            return ;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+}
+
+// @brief label value with its backslashes, double quotes and line feeds escaped (the text format's rules)
+static const char *escape_label(const char *value, char *out, size_t out_size) {
+    size_t len = 0;
+
+    for (; value && *value && len + 2 < out_size; value++) {
+        if (*value == '\\' || *value == '"') {
+            out[len++] = '\\';
+            out[len++] = *value;
+        } else if (*value == '\n') {
+            out[len++] = '\\';
+            out[len++] = 'n';
+        } else {
+            out[len++] = *value;
+        }
+    }
+    out[len] = '\0';
+    return (out);
+}
+
+// @brief one counter family: a sample per target, 'field' is the offset of its value in metrics_target_t
+static void append_counter(text_buffer_t *body, const char **labels, const char *name, const char *help, size_t field) {
+    append(body, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (size_t i = 0; i < state.num_targets; i++) {
+        unsigned long value;
+
+        memcpy(&value, (uint8_t *)&scraped[i] + field, sizeof(value));
+        append(body, "%s{%s} %lu\n", name, labels[i], value);
+    }
+}
+
+static void write_metrics(text_buffer_t *body) {
+    char **labels = malloc(state.num_targets * sizeof(char *));
+    char host[OUTPUT_MAX_FIELD];
+
+    if (!labels) {
+        body->failed = 1;
+        return ;
+    }
+    for (size_t i = 0; i < state.num_targets; i++) {
+        labels[i] = NULL;
+        if (asprintf(&labels[i], "host=\"%s\",address=\"%s\"", escape_label(scraped[i].hostname, host, sizeof(host)), scraped[i].address) < 0) {
+            labels[i] = NULL;
+            body->failed = 1;
+        }
+    }
+
+    if (!body->failed) {
+        const char **l = (const char **)labels;
+
+        append_counter(body, l, "ft_ping_sent_total", "Echo requests sent.", offsetof(metrics_target_t, sent));
+        append_counter(body, l, "ft_ping_received_total", "Echo replies received (first reply of each probe).", offsetof(metrics_target_t, received));
+        append_counter(body, l, "ft_ping_duplicates_total", "Duplicate echo replies.", offsetof(metrics_target_t, duplicates));
+        append_counter(body, l, "ft_ping_late_total", "Echo replies of probes already given up on.", offsetof(metrics_target_t, late));
+        append_counter(body, l, "ft_ping_unmatched_total", "Echo replies matching none of the probes sent.", offsetof(metrics_target_t, unmatched));
+
+        append(body, "# HELP ft_ping_icmp_errors_total ICMP error messages about the probes, by type.\n# TYPE ft_ping_icmp_errors_total counter\n");
+        for (size_t i = 0; i < state.num_targets; i++) {
+            append(body, "ft_ping_icmp_errors_total{%s,type=\"destination_unreachable\"} %lu\n", labels[i], scraped[i].unreach);
+            append(body, "ft_ping_icmp_errors_total{%s,type=\"time_exceeded\"} %lu\n", labels[i], scraped[i].exceeded);
+            append(body, "ft_ping_icmp_errors_total{%s,type=\"redirect\"} %lu\n", labels[i], scraped[i].redirect);
+        }
+
+        append(body, "# HELP ft_ping_rtt_seconds Round trip time of the echo replies.\n# TYPE ft_ping_rtt_seconds histogram\n");
+        for (size_t i = 0; i < state.num_targets; i++) {
+            unsigned long cumulative = 0;
+
+            for (size_t b = 0; b < RTT_BOUNDS; b++) {
+                cumulative += scraped[i].buckets[b];
+                append(body, "ft_ping_rtt_seconds_bucket{%s,le=\"%g\"} %lu\n", labels[i], rtt_bounds_ns[b] / 1e9, cumulative);
+            }
+            cumulative += scraped[i].buckets[RTT_BOUNDS];
+            append(body, "ft_ping_rtt_seconds_bucket{%s,le=\"+Inf\"} %lu\n", labels[i], cumulative);
+            append(body, "ft_ping_rtt_seconds_sum{%s} %.9f\n", labels[i], scraped[i].rtt_sum);
+            append(body, "ft_ping_rtt_seconds_count{%s} %lu\n", labels[i], cumulative);
+        }
+
+        append(body, "# HELP ft_ping_noise_packets_total Packets read that were not about our probes.\n# TYPE ft_ping_noise_packets_total counter\n");
+        append(body, "ft_ping_noise_packets_total %lu\n", scraped_noise);
+    }
+
+    for (size_t i = 0; i < state.num_targets; i++) {
+        free(labels[i]);
+    }
+    free(labels);
+}
+
+static void send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+
+        if (sent <= 0) {
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            return ; // the client is gone (or too slow)
+        }
+        data += sent;
+        len -= sent;
+    }
+}
+
+static void respond(int fd, const char *status, const char *content_type, const char *body, size_t body_len) {
+    char header[256];
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                              status, content_type, body_len);
+
+    send_all(fd, header, header_len);
+    send_all(fd, body, body_len);
+}
+
+// @brief reads a request (up to the end of its headers) and answers it: GET /metrics, anything else is an error
+static void serve_client(int fd) {
+    struct timeval timeout = { .tv_sec = METRICS_IO_TIMEOUT_MS / 1000, .tv_usec = (METRICS_IO_TIMEOUT_MS % 1000) * 1000 };
+    char request[METRICS_REQUEST_SIZE];
+    size_t len = 0;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    while (len < sizeof(request) - 1) {
+        ssize_t received = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        len += received;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+    request[len] = '\0';
+
+    char method[16];
+    char path[256];
+
+    if (sscanf(request, "%15s %255s", method, path) != 2) {
+        respond(fd, "400 Bad Request", "text/plain", "bad request\n", 12);
+        return ;
+    }
+    if (strcmp(method, "GET") != 0) {
+        respond(fd, "405 Method Not Allowed", "text/plain", "method not allowed\n", 19);
+        return ;
+    }
+
+    char *query = strchr(path, '?');
+    if (query) {
+        *query = '\0';
+    }
+    if (strcmp(path, "/metrics") != 0) {
+        respond(fd, "404 Not Found", "text/plain", "not found, try /metrics\n", 24);
+        return ;
+    }
+
+    // the copy is all the lock covers: the ping loop skips at most one publication meanwhile
+    pthread_mutex_lock(&publish_lock);
+    memcpy(scraped, published, state.num_targets * sizeof(metrics_target_t));
+    scraped_noise = published_noise;
+    pthread_mutex_unlock(&publish_lock);
+
+    text_buffer_t body = {0};
+
+    write_metrics(&body);
+    if (body.failed) {
+        respond(fd, "500 Internal Server Error", "text/plain", "out of memory\n", 14);
+    } else {
+        respond(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", body.data, body.len);
+    }
+    free(body.data);
+}
+
+static void *server_loop(void *arg) {
+    (void)arg;
+
+    while (!atomic_load_explicit(&stop_requested, memory_order_relaxed)) {
+        int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+        if (client < 0) {
+            continue; // interrupted, or the socket was shut down to stop us
+        }
+        serve_client(client);
+        close(client);
+    }
+
+    return (NULL);
+}
+
+// (*) server
+
+static void free_snapshots(void) {
+    free(live_buckets);
+    free(published);
+    free(scraped);
+    live_buckets = NULL;
+    published = NULL;
+    scraped = NULL;
+}
+
+int startMetricsServer(void) {
+    live_buckets = calloc(state.num_targets * RTT_BUCKETS, sizeof(uint64_t));
+    published = calloc(state.num_targets, sizeof(metrics_target_t));
+    scraped = calloc(state.num_targets, sizeof(metrics_target_t));
+    if (!live_buckets || !published || !scraped) {
+        free_snapshots();
+        return (METRICS_ERROR);
+    }
+
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        free_snapshots();
+        return (METRICS_ERROR);
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(listen_fd, (struct sockaddr *)&state.metrics_addr, sizeof(state.metrics_addr)) < 0 || listen(listen_fd, 16) < 0) {
+        int saved_errno = errno;
+
+        close(listen_fd);
+        listen_fd = -1;
+        free_snapshots();
+        errno = saved_errno;
+        return (METRICS_ERROR);
+    }
+
+    publish();
+    last_publish_ns = get_nanoseconds();
+
+    // signals are for the main thread (its loop services them, see signals.h)
+    sigset_t all_signals, previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous_mask);
+
+    atomic_store(&stop_requested, 0);
+    int err = pthread_create(&thread, NULL, server_loop, NULL);
+
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+
+    if (err != 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        free_snapshots();
+        errno = err;
+        return (METRICS_ERROR);
+    }
+
+    running = 1;
+    return (METRICS_OK);
+}
+
+void stopMetricsServer(void) {
+    if (!running) {
+        return ;
+    }
+
+    // shutting the listening socket down wakes the thread up from accept()
+    atomic_store(&stop_requested, 1);
+    shutdown(listen_fd, SHUT_RDWR);
+    pthread_join(thread, NULL);
+    running = 0;
+
+    close(listen_fd);
+    listen_fd = -1;
+    free_snapshots();
+}
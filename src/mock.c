@@ -0,0 +1,424 @@
+// mock transport: in-memory answers to the probes on a virtual clock, for simulations (see mock.h)
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "event.h"
+#include "ft_ping.h"
+#include "macros.h"
+#include "mock.h"
+#include "transport.h"
+#include "utils.h"
+
+extern ping_state_t state;
+
+#define MOCK_IP_HEADER_SIZE 20
+#define MOCK_QUOTED_SIZE (MOCK_IP_HEADER_SIZE + 8) // an ICMP error quotes the IP header and 64 bits of the probe
+
+// a packet in flight: handed over once the virtual clock reaches due_ns (min heap ordered by due_ns, then by sending order)
+typedef struct mock_packet {
+    uint64_t due_ns;
+    uint64_t order;
+    uint8_t *data;                      // IP header + ICMP message (a pool buffer)
+    size_t len;
+    struct in_addr from;
+} mock_packet_t;
+
+static mock_script_t script;
+static mock_stats_t stats;
+static unsigned short random_state[3];
+static uint64_t virtual_ns = 0;         // the virtual CLOCK_MONOTONIC
+static uint64_t start_ns = 0;
+static uint64_t real_start_ns = 0;
+static uint64_t next_order = 0;
+static uint16_t next_ip_id = 0;
+static struct in_addr router;           // sender of the ICMP errors
+
+static mock_packet_t *heap = NULL;
+static size_t heap_len = 0;
+static size_t heap_capacity = 0;
+
+static uint8_t **free_buffers = NULL;   // pool of packet buffers (buffer_size bytes each), reused once handed over
+static size_t free_len = 0;
+static size_t free_capacity = 0;
+static size_t buffer_size = 0;
+
+// (*) virtual clock
+
+static uint64_t mock_monotonic_ns(void) {
+    return (virtual_ns);
+}
+
+static int64_t mock_realtime_ns(void) {
+    return (SIMULATION_EPOCH * 1000000000LL + (int64_t)(virtual_ns - start_ns));
+}
+
+static void mock_advance(uint64_t monotonic_ns) {
+    if (monotonic_ns > virtual_ns) {
+        virtual_ns = monotonic_ns;
+    }
+}
+
+static const ping_clock_t mock_clock = {
+    .monotonic_ns = mock_monotonic_ns,
+    .realtime_ns = mock_realtime_ns,
+    .advance = mock_advance,
+};
+
+// (*) packets in flight
+
+static int before(const mock_packet_t *a, const mock_packet_t *b) {
+    return (a->due_ns < b->due_ns || (a->due_ns == b->due_ns && a->order < b->order));
+}
+
+static int heap_push(mock_packet_t packet) {
+    if (heap_len == heap_capacity) {
+        size_t capacity = heap_capacity ? heap_capacity * 2 : 1024;
+        mock_packet_t *grown = realloc(heap, capacity * sizeof(mock_packet_t));
+
+        if (!grown) {
+            return (MOCK_ERROR);
+        }
+        heap = grown;
+        heap_capacity = capacity;
+    }
+
+    size_t i = heap_len++;
+
+    packet.order = next_order++;
+    while (i > 0 && before(&packet, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = packet;
+    return (MOCK_OK);
+}
+
+static mock_packet_t heap_pop(void) {
+    mock_packet_t top = heap[0];
+    mock_packet_t last = heap[--heap_len];
+    size_t i = 0;
+
+    while (2 * i + 1 < heap_len) {
+        size_t child = 2 * i + 1;
+
+        if (child + 1 < heap_len && before(&heap[child + 1], &heap[child])) {
+            child += 1;
+        }
+        if (!before(&heap[child], &last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heap_len) {
+        heap[i] = last;
+    }
+    return (top);
+}
+
+static uint8_t *take_buffer(void) {
+    if (free_len) {
+        return (free_buffers[--free_len]);
+    }
+    return (malloc(buffer_size));
+}
+
+static void give_buffer(uint8_t *buffer) {
+    if (free_len == free_capacity) {
+        size_t capacity = free_capacity ? free_capacity * 2 : 1024;
+        uint8_t **grown = realloc(free_buffers, capacity * sizeof(uint8_t *));
+
+        if (!grown) {
+            free(buffer);
+            return ;
+        }
+        free_buffers = grown;
+        free_capacity = capacity;
+    }
+    free_buffers[free_len++] = buffer;
+}
+
+// (*) packets
+
+// @brief ones' complement sum of the 16 bits words of bytes, folded (RFC 1071)
+static uint16_t fold_words(const uint8_t *bytes, size_t len, uint32_t sum) {
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (bytes[i] << 8) | bytes[i + 1];
+    }
+    if (len & 1) {
+        sum += bytes[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (sum);
+}
+
+static void write_ip_header(uint8_t *packet, size_t len, uint8_t ttl, struct in_addr src, struct in_addr dst) {
+    struct ip header = {0};
+
+    header.ip_v = 4;
+    header.ip_hl = MOCK_IP_HEADER_SIZE >> 2;
+    header.ip_len = htons(len);
+    header.ip_id = htons(next_ip_id++);
+    header.ip_ttl = ttl;
+    header.ip_p = IPPROTO_ICMP;
+    header.ip_src = src;
+    header.ip_dst = dst;
+    header.ip_sum = htons(~fold_words((uint8_t *)&header, sizeof(header), 0));
+    memcpy(packet, &header, sizeof(header));
+}
+
+// @brief queues the echo reply to the request (the request sent back with its type changed), due after the delay
+static int queue_reply(const uint8_t *request, size_t len, struct in_addr target, uint64_t due_ns) {
+    uint8_t *packet = take_buffer();
+
+    if (!packet) {
+        return (MOCK_ERROR);
+    }
+
+    uint8_t *icmp = packet + MOCK_IP_HEADER_SIZE;
+    uint16_t checksum;
+
+    write_ip_header(packet, MOCK_IP_HEADER_SIZE + len, script.ttl, target, (struct in_addr){ htonl(INADDR_LOOPBACK) });
+    memcpy(icmp, request, len);
+
+    // type 8 -> 0: the checksum is updated for that word alone (RFC 1624)
+    memcpy(&checksum, icmp + 2, sizeof(checksum));
+    checksum = htons(~fold_words(NULL, 0, (uint16_t)~ntohs(checksum) + (uint16_t)~(ICMP_ECHO << 8) + (ICMP_ECHOREPLY << 8)));
+    icmp[0] = ICMP_ECHOREPLY;
+    memcpy(icmp + 2, &checksum, sizeof(checksum));
+
+    mock_packet_t reply = { .due_ns = due_ns, .data = packet, .len = MOCK_IP_HEADER_SIZE + len, .from = target };
+
+    if (heap_push(reply) == MOCK_ERROR) {
+        give_buffer(packet);
+        return (MOCK_ERROR);
+    }
+    return (MOCK_OK);
+}
+
+// @brief queues an ICMP error from the router about the request (quoting its IP header and first 64 bits), due after half the delay
+static int queue_error(const uint8_t *request, size_t len, struct in_addr target, uint8_t type, uint8_t code, uint64_t due_ns) {
+    uint8_t *packet = take_buffer();
+
+    if (!packet) {
+        return (MOCK_ERROR);
+    }
+
+    uint8_t *icmp = packet + MOCK_IP_HEADER_SIZE;
+    size_t message_len = sizeof(struct icmphdr) + MOCK_QUOTED_SIZE;
+    size_t quoted_len = (len < 8) ? len : 8;
+
+    // the probe as it was on the wire (its TTL ran out or it couldn't be delivered)
+    memset(icmp, 0, message_len);
+    write_ip_header(icmp + sizeof(struct icmphdr), MOCK_IP_HEADER_SIZE + len, 1, (struct in_addr){ htonl(INADDR_LOOPBACK) }, target);
+    memcpy(icmp + sizeof(struct icmphdr) + MOCK_IP_HEADER_SIZE, request, quoted_len);
+
+    icmp[0] = type;
+    icmp[1] = code;
+    uint16_t checksum = htons(~fold_words(icmp, message_len, 0));
+    memcpy(icmp + 2, &checksum, sizeof(checksum));
+    write_ip_header(packet, MOCK_IP_HEADER_SIZE + message_len, script.ttl, router, (struct in_addr){ htonl(INADDR_LOOPBACK) });
+
+    mock_packet_t error = { .due_ns = due_ns, .data = packet, .len = MOCK_IP_HEADER_SIZE + message_len, .from = router };
+
+    if (heap_push(error) == MOCK_ERROR) {
+        give_buffer(packet);
+        return (MOCK_ERROR);
+    }
+    return (MOCK_OK);
+}
+
+// @brief decides the fate of an echo request (the script's percentages) and queues what comes back
+static void answer(const uint8_t *request, size_t len, struct in_addr target) {
+    double draw = erand48(random_state) * 100.0;
+    double delay_ms = script.delay_ms;
+
+    stats.requests += 1;
+
+    if (len < sizeof(struct icmphdr) || request[0] != ICMP_ECHO) {
+        stats.dropped += 1;
+        return ;
+    }
+
+    if (draw < script.loss_pct) {
+        stats.dropped += 1;
+        return ;
+    }
+
+    if (script.jitter_ms > 0) {
+        delay_ms += (erand48(random_state) * 2.0 - 1.0) * script.jitter_ms;
+    }
+    if (delay_ms < 0) {
+        delay_ms = 0;
+    }
+
+    draw -= script.loss_pct;
+    if (draw < script.unreach_pct + script.exceeded_pct) {
+        uint8_t type = (draw < script.unreach_pct) ? ICMP_DEST_UNREACH : ICMP_TIME_EXCEEDED;
+        uint8_t code = (type == ICMP_DEST_UNREACH) ? ICMP_HOST_UNREACH : ICMP_EXC_TTL;
+
+        if (queue_error(request, len, target, type, code, virtual_ns + (uint64_t)(delay_ms * 1e6 / 2)) == MOCK_OK) {
+            stats.errors += 1;
+        }
+        return ;
+    }
+
+    uint64_t due = virtual_ns + (uint64_t)(delay_ms * 1e6);
+    int copies = 1 + (script.dup_pct > 0 && erand48(random_state) * 100.0 < script.dup_pct);
+
+    for (int i = 0; i < copies; i++) {
+        if (queue_reply(request, len, target, due) == MOCK_OK) {
+            stats.replies += (i == 0);
+            stats.duplicated += (i > 0);
+        }
+    }
+}
+
+// (*) transport
+
+static int mock_send(struct mmsghdr *msgs, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        struct msghdr *msg = &msgs[i].msg_hdr;
+        struct sockaddr_in *to = msg->msg_name;
+
+        // the engine sends each probe from a single buffer
+        answer(msg->msg_iov[0].iov_base, msg->msg_iov[0].iov_len, to->sin_addr);
+        msgs[i].msg_len = msg->msg_iov[0].iov_len;
+    }
+    return (count);
+}
+
+static int mock_recv(struct mmsghdr *msgs, unsigned int count, int flags) {
+    unsigned int received = 0;
+
+    (void)flags;
+    while (received < count && heap_len && heap[0].due_ns <= virtual_ns) {
+        mock_packet_t packet = heap_pop();
+        struct msghdr *msg = &msgs[received].msg_hdr;
+        size_t len = (packet.len < msg->msg_iov[0].iov_len) ? packet.len : msg->msg_iov[0].iov_len;
+
+        memcpy(msg->msg_iov[0].iov_base, packet.data, len);
+        msg->msg_flags = (len < packet.len) ? MSG_TRUNC : 0;
+        msg->msg_controllen = 0;
+        if (msg->msg_name && msg->msg_namelen >= sizeof(struct sockaddr_in)) {
+            struct sockaddr_in from = { .sin_family = AF_INET, .sin_addr = packet.from };
+
+            memcpy(msg->msg_name, &from, sizeof(from));
+        }
+        msg->msg_namelen = sizeof(struct sockaddr_in);
+        msgs[received].msg_len = len;
+
+        give_buffer(packet.data);
+        received += 1;
+    }
+
+    if (received == 0) {
+        errno = EAGAIN;
+        return (-1);
+    }
+    return (received);
+}
+
+// @brief no sleeping: the clock jumps to the next packet's arrival or the deadline, whichever comes first
+static int mock_wait(uint64_t deadline_ns) {
+    uint64_t wake = deadline_ns;
+
+    if (heap_len && heap[0].due_ns < wake) {
+        wake = heap[0].due_ns;
+    }
+    mock_advance(wake);
+
+    int events = 0;
+
+    if (heap_len && heap[0].due_ns <= virtual_ns) {
+        events |= EVENT_SOCKET_READABLE;
+    }
+    if (virtual_ns >= deadline_ns) {
+        events |= EVENT_TIMER_EXPIRED;
+    }
+    return (events);
+}
+
+static const ping_transport_t mock_transport = {
+    .name = "mock",
+    .send = mock_send,
+    .recv = mock_recv,
+    .wait = mock_wait,
+};
+
+static uint64_t real_nanoseconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+int openMockTransport(const mock_script_t *new_script) {
+    script = *new_script;
+    memset(&stats, 0, sizeof(stats));
+    random_state[0] = 0x330E;
+    random_state[1] = script.seed & 0xFFFF;
+    random_state[2] = (script.seed >> 16) & 0xFFFF;
+    inet_aton(SIMULATION_ROUTER, &router);
+
+    // big enough for an echo reply and for an ICMP error
+    buffer_size = MOCK_IP_HEADER_SIZE + state.packet_size;
+    if (buffer_size < MOCK_IP_HEADER_SIZE + sizeof(struct icmphdr) + MOCK_QUOTED_SIZE) {
+        buffer_size = MOCK_IP_HEADER_SIZE + sizeof(struct icmphdr) + MOCK_QUOTED_SIZE;
+    }
+
+    heap = malloc(1024 * sizeof(mock_packet_t));
+    if (!heap) {
+        return (MOCK_ERROR);
+    }
+    heap_capacity = 1024;
+    heap_len = 0;
+    next_order = 0;
+
+    // the virtual clock starts one second in (a deadline of 0 means "now" to the event loop)
+    virtual_ns = 1000000000ULL;
+    start_ns = virtual_ns;
+    real_start_ns = real_nanoseconds();
+
+    set_clock(&mock_clock);
+    setTransport(&mock_transport);
+    return (MOCK_OK);
+}
+
+void getMockStats(mock_stats_t *out) {
+    *out = stats;
+    out->virtual_ns = virtual_ns - start_ns;
+    out->real_ns = real_nanoseconds() - real_start_ns;
+}
+
+void closeMockTransport(void) {
+    if (!heap) {
+        return ;
+    }
+
+    setTransport(NULL);
+    set_clock(NULL);
+
+    while (heap_len) {
+        free(heap_pop().data);
+    }
+    while (free_len) {
+        free(free_buffers[--free_len]);
+    }
+    free(heap);
+    free(free_buffers);
+    heap = NULL;
+    free_buffers = NULL;
+    heap_capacity = 0;
+    free_capacity = 0;
+}
@@ -0,0 +1,288 @@
+// machine readable output (JSON Lines / CSV) through a large userspace buffer, flushed on size or time
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "ft_ping.h"
+#include "macros.h"
+#include "output.h"
+#include "target.h"
+#include "utils.h"
+
+extern ping_state_t state;
+
+static char *buffer = NULL;
+static size_t buffer_len = 0;           // bytes waiting to be written
+static int output_fd = -1;
+static int format = OUTPUT_TEXT;
+static uint64_t last_flush_ns = 0;
+static unsigned long dropped = 0;
+static unsigned long truncated = 0;
+
+// @brief tells whether fd can take a write right now (the fd itself is left blocking: O_NONBLOCK would be set on the open
+// file description, shared with the shell, the terminal and the other end of a pipeline, and outlive us if we're killed)
+static int is_writable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+    return (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLOUT));
+}
+
+// @brief writes as much of the buffer as the consumer takes without blocking, keeps the rest (or, if 'wait' is set,
+// writes it all, blocking); chunks of PIPE_BUF bytes fit in a pipe that polls writable, so they don't block
+static void flush_buffer(int wait) {
+    size_t written = 0;
+
+    while (written < buffer_len) {
+        size_t chunk = buffer_len - written;
+
+        if (!wait) {
+            if (!is_writable(output_fd)) {
+                break; // the consumer is slow, retried on next flush
+            }
+            if (chunk > PIPE_BUF) {
+                chunk = PIPE_BUF;
+            }
+        }
+
+        ssize_t ret = write(output_fd, buffer + written, chunk);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += ret;
+    }
+
+    if (written > 0) {
+        memmove(buffer, buffer + written, buffer_len - written);
+        buffer_len -= written;
+    }
+    last_flush_ns = get_nanoseconds();
+}
+
+int createOutput(int fd, int output_format) {
+    format = output_format;
+    output_fd = fd;
+
+    if (format == OUTPUT_TEXT) {
+        return (OUTPUT_OK);
+    }
+
+    buffer = malloc(OUTPUT_BUFFER_SIZE);
+    if (!buffer) {
+        return (OUTPUT_ERROR);
+    }
+
+    last_flush_ns = get_nanoseconds();
+
+    if (format == OUTPUT_CSV) {
+        const char *header = "event,time,host,address,seq,bytes,ttl,rtt_ms,from,type,code,message,"
+                             "sent,received,duplicates,loss_pct,min_ms,avg_ms,max_ms,stddev_ms,in_flight,dropped_records,truncated_records\n";
+        buffer_len = strlen(header);
+        memcpy(buffer, header, buffer_len);
+    }
+
+    return (OUTPUT_OK);
+}
+
+// @brief appends one formatted record to the buffer (records never straddle a flush: they're either whole or dropped)
+__attribute__((format(printf, 1, 2)))
+static void append_record(const char *fmt, ...) {
+    if (!buffer) {
+        return ;
+    }
+
+    if (OUTPUT_BUFFER_SIZE - buffer_len < OUTPUT_MAX_RECORD) {
+        flush_buffer(0);
+        if (OUTPUT_BUFFER_SIZE - buffer_len < OUTPUT_MAX_RECORD) {
+            dropped += 1;
+            return ;
+        }
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(buffer + buffer_len, OUTPUT_MAX_RECORD, fmt, ap);
+    va_end(ap);
+
+    if (len < 0) {
+        dropped += 1;
+        return ;
+    }
+
+    if (len >= OUTPUT_MAX_RECORD) {
+        // cut, but still one record per line
+        truncated += 1;
+        len = OUTPUT_MAX_RECORD - 1;
+        buffer[buffer_len + len - 1] = '\n';
+    }
+    buffer_len += len;
+
+    if (buffer_len >= OUTPUT_FLUSH_THRESHOLD) {
+        flush_buffer(0);
+    }
+}
+
+// @brief copies a string, escaped for the current format, into a static buffer (JSON: quotes, backslashes and
+// control characters; CSV: the field is quoted if needed)
+static const char *escape(const char *str) {
+    static char escaped[2][OUTPUT_MAX_FIELD];
+    static int which = 0;
+    char *out = escaped[which];
+    size_t len = 0;
+
+    which ^= 1; // two fields can be escaped for the same record
+    if (!str) {
+        str = "";
+    }
+
+    int quote = (format == OUTPUT_CSV && strpbrk(str, ",\"\n") != NULL);
+    if (quote) {
+        out[len++] = '"';
+    }
+
+    for (; *str && len + 3 < OUTPUT_MAX_FIELD; str++) {
+        unsigned char c = *str;
+
+        if (format == OUTPUT_JSONL && (c == '"' || c == '\\')) {
+            out[len++] = '\\';
+            out[len++] = c;
+        } else if (format == OUTPUT_CSV && c == '"') {
+            out[len++] = '"';
+            out[len++] = '"';
+        } else if (c < 0x20) {
+            out[len++] = ' ';
+        } else {
+            out[len++] = c;
+        }
+    }
+
+    if (quote) {
+        out[len++] = '"';
+    }
+    out[len] = '\0';
+    return (out);
+}
+
+// @brief wall clock time of the event (seconds since the epoch): time_ns (CLOCK_REALTIME nanoseconds) when the event
+// carries its own time, now if it's 0
+static double event_time(int64_t time_ns) {
+    return ((time_ns ? time_ns : get_realtime_nanoseconds()) / 1e9);
+}
+
+void outputReply(ping_target_t *target, uint16_t sequence, size_t bytes, uint8_t ttl, double rtt_ms, int classification, int64_t reply_ns) {
+    const char *event = (classification == REPLY_DUPLICATE) ? "duplicate" : (classification == REPLY_LATE) ? "late" : "reply";
+    char ttl_str[16] = "";      // optional fields (ttl only with SOCK_RAW, rtt only if the payload holds a timestamp)
+    char rtt_str[32] = "";
+
+    if (format == OUTPUT_JSONL) {
+        if (ttl != 0) {
+            snprintf(ttl_str, sizeof(ttl_str), ",\"ttl\":%u", ttl);
+        }
+        if (rtt_ms >= 0) {
+            snprintf(rtt_str, sizeof(rtt_str), ",\"rtt_ms\":%.3f", rtt_ms);
+        }
+        append_record("{\"event\":\"%s\",\"time\":%.6f,\"host\":\"%s\",\"address\":\"%s\",\"seq\":%u,\"bytes\":%zu%s%s}\n",
+                      event, event_time(reply_ns), escape(target->hostname), target->display_address, sequence, bytes, ttl_str, rtt_str);
+    } else if (format == OUTPUT_CSV) {
+        if (ttl != 0) {
+            snprintf(ttl_str, sizeof(ttl_str), "%u", ttl);
+        }
+        if (rtt_ms >= 0) {
+            snprintf(rtt_str, sizeof(rtt_str), "%.3f", rtt_ms);
+        }
+        append_record("%s,%.6f,%s,%s,%u,%zu,%s,%s,,,,,,,,,,,,,,,\n",
+                      event, event_time(reply_ns), escape(target->hostname), target->display_address, sequence, bytes, ttl_str, rtt_str);
+    }
+}
+
+void outputIcmpError(ping_target_t *target, struct in_addr from, uint8_t type, uint8_t code, uint16_t sequence, const char *message,
+                     int64_t reply_ns) {
+    char from_str[INET_ADDRSTRLEN];
+
+    inet_ntop(AF_INET, &from, from_str, sizeof(from_str));
+
+    if (format == OUTPUT_JSONL) {
+        append_record("{\"event\":\"icmp_error\",\"time\":%.6f,\"host\":\"%s\",\"address\":\"%s\",\"seq\":%u,"
+                      "\"from\":\"%s\",\"type\":%u,\"code\":%u,\"message\":\"%s\"}\n",
+                      event_time(reply_ns), escape(target->hostname), target->display_address, sequence, from_str, type, code, escape(message));
+    } else if (format == OUTPUT_CSV) {
+        append_record("icmp_error,%.6f,%s,%s,%u,,,,%s,%u,%u,%s,,,,,,,,,,,\n",
+                      event_time(reply_ns), escape(target->hostname), target->display_address, sequence, from_str, type, code, escape(message));
+    }
+}
+
+void outputTimeout(ping_target_t *target, uint16_t sequence) {
+    if (format == OUTPUT_JSONL) {
+        append_record("{\"event\":\"timeout\",\"time\":%.6f,\"host\":\"%s\",\"address\":\"%s\",\"seq\":%u}\n",
+                      event_time(0), escape(target->hostname), target->display_address, sequence);
+    } else if (format == OUTPUT_CSV) {
+        append_record("timeout,%.6f,%s,%s,%u,,,,,,,,,,,,,,,,,,\n",
+                      event_time(0), escape(target->hostname), target->display_address, sequence);
+    }
+}
+
+void outputSummary(ping_target_t *target, int interim) {
+    double loss = 0.0;
+    double min_ms = 0.0, avg_ms = 0.0, max_ms = 0.0, stddev_ms = 0.0;
+
+    // a snapshot leaves the probes still in flight out of the loss (they're neither received nor lost yet)
+    unsigned long in_flight = interim ? countProbesInFlight(target) : 0;
+    unsigned long settled = (target->num_sent > in_flight) ? target->num_sent - in_flight : 0;
+
+    if (settled > target->num_recv) {
+        loss = (settled - target->num_recv) * 100.0 / settled;
+    }
+    if (target->num_recv > 0 && target->rrt_max >= target->rrt_min) {
+        double avg_sec = target->rrt_sum / target->num_recv;
+        double variance = (target->rrt_sum_sq / target->num_recv) - (avg_sec * avg_sec);
+
+        min_ms = target->rrt_min * 1000.0;
+        avg_ms = avg_sec * 1000.0;
+        max_ms = target->rrt_max * 1000.0;
+        stddev_ms = sqrt(fmax(0.0, variance)) * 1000.0;
+    }
+
+    // records dropped so far are reported (this record itself is never counted)
+    if (format == OUTPUT_JSONL) {
+        append_record("{\"event\":\"%s\",\"time\":%.6f,\"host\":\"%s\",\"address\":\"%s\",\"sent\":%lu,\"received\":%lu,"
+                      "\"duplicates\":%lu,\"loss_pct\":%.3f,\"min_ms\":%.3f,\"avg_ms\":%.3f,\"max_ms\":%.3f,\"stddev_ms\":%.3f,"
+                      "\"in_flight\":%lu,\"dropped_records\":%lu,\"truncated_records\":%lu}\n",
+                      interim ? "snapshot" : "summary", event_time(0), escape(target->hostname), target->display_address,
+                      target->num_sent, target->num_recv, target->num_rept, loss, min_ms, avg_ms, max_ms, stddev_ms, in_flight,
+                      dropped, truncated);
+    } else if (format == OUTPUT_CSV) {
+        append_record("%s,%.6f,%s,%s,,,,,,,,,%lu,%lu,%lu,%.3f,%.3f,%.3f,%.3f,%.3f,%lu,%lu,%lu\n",
+                      interim ? "snapshot" : "summary", event_time(0), escape(target->hostname), target->display_address,
+                      target->num_sent, target->num_recv, target->num_rept, loss, min_ms, avg_ms, max_ms, stddev_ms, in_flight,
+                      dropped, truncated);
+    }
+}
+
+void outputTick(void) {
+    if (buffer && buffer_len > 0 && get_nanoseconds() - last_flush_ns >= OUTPUT_FLUSH_INTERVAL_NS) {
+        flush_buffer(0);
+    }
+}
+
+void closeOutput(void) {
+    if (!buffer) {
+        return ;
+    }
+
+    // the run is over: wait for the consumer
+    flush_buffer(1);
+
+    free(buffer);
+    buffer = NULL;
+    buffer_len = 0;
+}
@@ -0,0 +1,61 @@
+// token bucket pacer: hybrid sleep (timer armed PACER_SPIN_NS early) and spin until the exact send time
+
+#include <sys/prctl.h>
+#include "ft_ping.h"
+#include "macros.h"
+#include "pacer.h"
+#include "utils.h"
+
+extern ping_state_t state;
+
+static double tokens = 0.0;
+static uint64_t last_refill_ns = 0;
+
+void initPacer(uint64_t now_ns) {
+    tokens = 1.0;
+    last_refill_ns = now_ns;
+
+    // the default timer slack (50 us) would be added to every timer wake up
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+}
+
+size_t takePacerTokens(uint64_t now_ns) {
+    if (now_ns > last_refill_ns) {
+        tokens += (now_ns - last_refill_ns) * state.rate / 1e9;
+        last_refill_ns = now_ns;
+    }
+
+    // a full bucket doesn't fill any further: idle time is not made up for with a bigger burst
+    if (tokens > (double)state.burst) {
+        tokens = state.burst;
+    }
+
+    size_t taken = (size_t)tokens;
+    tokens -= taken;
+    return (taken);
+}
+
+uint64_t nextPacerDeadline(uint64_t now_ns) {
+    double missing = 1.0 - tokens; // tokens is below 1 right after takePacerTokens
+
+    if (missing <= 0.0) {
+        return (now_ns);
+    }
+    return (last_refill_ns + (uint64_t)(missing * 1e9 / state.rate + 0.5));
+}
+
+uint64_t spinUntilDeadline(uint64_t deadline_ns) {
+    uint64_t now = wait_until_nanoseconds(deadline_ns);
+
+    // lateness: the timer woke us up after the deadline (or the loop was busy handling replies)
+    double lateness = (double)(now - deadline_ns);
+
+    state.pacer_wakeups += 1;
+    state.pacer_lateness_sum += lateness;
+    state.pacer_lateness_sum_sq += lateness * lateness;
+    if (now - deadline_ns > state.pacer_lateness_max) {
+        state.pacer_lateness_max = now - deadline_ns;
+    }
+
+    return (now);
+}
@@ -0,0 +1,173 @@
+// packet ring receive backend: AF_PACKET + TPACKET_V3, blocks parsed in place (see packetring.h)
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <netinet/ip.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ft_ping.h"
+#include "icmp.h" // before macros.h (its PARSE_* macros would clash with the parse_status_t enum)
+#include "macros.h"
+#include "packetring.h"
+#include "socket.h"
+
+extern ping_state_t state;
+
+static int ring_fd = -1;
+static uint8_t *ring = NULL;
+static size_t ring_size = 0;
+static size_t current_block = 0;        // next block to be handed over to us (blocks are handed over in order)
+
+int openPacketRing(void) {
+    // SOCK_DGRAM: frames start at the IP header (the link layer header is left out), like the raw ICMP socket's packets
+    int fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (fd < 0) {
+        return (PACKET_RING_ERROR);
+    }
+
+    // on loopback, every packet is seen twice: going out and coming in (the kernel may not support leaving the first out,
+    // those are skipped while parsing then)
+    int one = 1;
+    setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+    int version = TPACKET_V3;
+    struct tpacket_req3 request = {
+        .tp_block_size = PACKET_RING_BLOCK_SIZE,
+        .tp_block_nr = PACKET_RING_BLOCKS,
+        .tp_frame_size = PACKET_RING_FRAME_SIZE,
+        .tp_frame_nr = (PACKET_RING_BLOCK_SIZE / PACKET_RING_FRAME_SIZE) * PACKET_RING_BLOCKS,
+        .tp_retire_blk_tov = PACKET_RING_RETIRE_MS,
+        .tp_sizeof_priv = 0,
+        .tp_feature_req_word = 0,
+    };
+
+    // the filter goes on before the ring (and the binding) so that no foreign packet makes it in
+    if (attachIcmpFilter(fd, state.identifier, state.num_targets) == SOCKET_ERROR
+        || setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0
+        || setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return (PACKET_RING_ERROR);
+    }
+
+    ring_size = (size_t)PACKET_RING_BLOCK_SIZE * PACKET_RING_BLOCKS;
+    ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
+    if (ring == MAP_FAILED) {
+        ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); // MAP_LOCKED is over the memlock limit
+    }
+
+    struct sockaddr_ll address = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(ETH_P_IP),
+        .sll_ifindex = 0, // every interface
+    };
+
+    if (ring == MAP_FAILED || bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        int saved_errno = errno;
+        if (ring != MAP_FAILED) {
+            munmap(ring, ring_size);
+        }
+        ring = NULL;
+        close(fd);
+        errno = saved_errno;
+        return (PACKET_RING_ERROR);
+    }
+
+    // replies are read from the ring only: the ping socket's filter lets nothing through
+    attachIcmpFilter(state.sock_fd, 0, 0);
+
+    ring_fd = fd;
+    current_block = 0;
+    return (PACKET_RING_OK);
+}
+
+int packetRingFd(void) {
+    return (ring_fd);
+}
+
+// @brief parses the frames of a block (in place)
+static void parse_block(struct tpacket_block_desc *block) {
+    uint32_t num_packets = block->hdr.bh1.num_pkts;
+    struct tpacket3_hdr *frame = (struct tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+
+    state.packet_ring_blocks += 1;
+
+    for (uint32_t i = 0; i < num_packets; i++) {
+        struct sockaddr_ll *link = (struct sockaddr_ll *)((uint8_t *)frame + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        uint8_t *packet = (uint8_t *)frame + frame->tp_net;
+
+        // packets on their way out are skipped (our probes, and on loopback the kernel's replies before they come back in)
+        if (link->sll_pkttype != PACKET_OUTGOING && frame->tp_snaplen >= sizeof(struct ip)) {
+            struct sockaddr_in sender_addr = {
+                .sin_family = AF_INET,
+                .sin_addr = ((struct ip *)packet)->ip_src,
+            };
+            socklen_t sender_addr_len = sizeof(sender_addr);
+
+            // the kernel's receive time: the block may be handed over up to PACKET_RING_RETIRE_MS after the packet came in
+            struct timespec rx_time = {
+                .tv_sec = frame->tp_sec,
+                .tv_nsec = frame->tp_nsec,
+            };
+
+            state.recv_packets += 1;
+            parseIcmpMessageAndLogResult(packet, frame->tp_snaplen, (struct sockaddr *)&sender_addr, &sender_addr_len, &rx_time);
+        }
+
+        frame = (struct tpacket3_hdr *)((uint8_t *)frame + frame->tp_next_offset);
+    }
+}
+
+void drainPacketRing(void) {
+    if (!ring) {
+        return ;
+    }
+
+    // transmit timestamps first, so that replies find the kernel send time of their probe
+    if (state.kernel_timestamps) {
+        drainTxTimestamps();
+    }
+
+    while (1) {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc *)(ring + current_block * PACKET_RING_BLOCK_SIZE);
+
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            break;
+        }
+
+        parse_block(block);
+
+        // the block is the kernel's again
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        current_block = (current_block + 1) % PACKET_RING_BLOCKS;
+    }
+}
+
+void collectPacketRingStats(void) {
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+
+    if (ring_fd < 0 || getsockopt(ring_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0) {
+        return ;
+    }
+
+    state.packet_ring_packets += stats.tp_packets;
+    state.packet_ring_drops += stats.tp_drops;
+    state.packet_ring_freezes += stats.tp_freeze_q_cnt;
+}
+
+void closePacketRing(void) {
+    if (ring_fd < 0) {
+        return ;
+    }
+
+    munmap(ring, ring_size);
+    close(ring_fd);
+    ring = NULL;
+    ring_fd = -1;
+}
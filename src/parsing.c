@@ -14,6 +14,7 @@
 #include <arpa/inet.h>
 #include "macros.h"
 #include "parsing.h"
+#include "output.h"
 
 extern ping_state_t state;
 
@@ -28,12 +29,133 @@ static int is_all_digits(const char *str) {
     return (1);
 }
 
+// @brief parses a comma separated list of percentiles (e.g. "50,90,99,99.9") into state.percentiles; exits on error
+static void parse_percentiles(char *list) {
+    state.num_percentiles = 0;
+
+    while (1) {
+        char *endptr;
+        double value = strtod(list, &endptr);
+
+        if (endptr == list || (*endptr != ',' && *endptr != '\0')) {
+            errorLogger("--percentiles: invalid percentile list", EX_USAGE);
+        }
+        if (value < 0.0 || value > 100.0) {
+            errorLogger("--percentiles: percentiles must be between 0 and 100", EX_USAGE);
+        }
+        if (state.num_percentiles == MAX_PERCENTILES) {
+            errorLogger("--percentiles: too many percentiles (16 at most)", EX_USAGE);
+        }
+
+        state.percentiles[state.num_percentiles++] = value;
+
+        if (*endptr == '\0') {
+            break;
+        }
+        list = endptr + 1;
+    }
+}
+
+// @brief parses "address[:port]" into state.dns_server (port 53 by default); exits on error
+static void parse_dns_server(char *value) {
+    char *colon = strchr(value, ':');
+    long port = 53;
+
+    if (colon) {
+        *colon = '\0';
+        if (!is_all_digits(colon + 1) || (port = strtol(colon + 1, NULL, 10)) < 1 || port > 65535) {
+            errorLogger("--dns-server: invalid port", EX_USAGE);
+        }
+    }
+
+    if (inet_aton(value, &state.dns_server.sin_addr) == 0) {
+        errorLogger("--dns-server: invalid IPv4 address", EX_USAGE);
+    }
+    state.dns_server.sin_family = AF_INET;
+    state.dns_server.sin_port = htons(port);
+}
+
+// @brief parses the simulated network's script, a comma separated list of key=value (e.g. "delay=10,jitter=2,loss=1"),
+// into state.simulation; exits on error
+static void parse_simulation(char *spec) {
+    static const char *keys[] = { "delay", "jitter", "loss", "dup", "unreach", "exceeded", "ttl", "seed" };
+    double values[] = { 0, 0, 0, 0, 0, 0, SIMULATION_TTL, SIMULATION_SEED };
+    size_t num_keys = sizeof(keys) / sizeof(keys[0]);
+
+    while (*spec) {
+        char *end = strchr(spec, ',');
+        char *equal = strchr(spec, '=');
+        size_t key = 0;
+
+        if (end) {
+            *end = '\0';
+        }
+        if (equal) {
+            *equal = '\0';
+            while (key < num_keys && strcmp(spec, keys[key]) != 0) {
+                key++;
+            }
+        }
+        if (!equal || key == num_keys) {
+            errorLogger("--simulate: unknown setting (delay, jitter, loss, dup, unreach, exceeded, ttl, seed)", EX_USAGE);
+        }
+
+        char *endptr;
+        values[key] = strtod(equal + 1, &endptr);
+        if (endptr == equal + 1 || *endptr != '\0' || values[key] < 0) {
+            errorLogger(ft_strjoin("--simulate: invalid value for ", keys[key]), EX_USAGE);
+        }
+
+        if (!end) {
+            break;
+        }
+        spec = end + 1;
+    }
+
+    if (values[2] + values[4] + values[5] > 100.0 || values[3] > 100.0) {
+        errorLogger("--simulate: loss, unreach and exceeded add up to more than 100%", EX_USAGE);
+    }
+    if (values[6] < 1 || values[6] > 255) {
+        errorLogger("--simulate: ttl must be between 1 and 255", EX_USAGE);
+    }
+
+    state.simulation.delay_ms = values[0];
+    state.simulation.jitter_ms = values[1];
+    state.simulation.loss_pct = values[2];
+    state.simulation.dup_pct = values[3];
+    state.simulation.unreach_pct = values[4];
+    state.simulation.exceeded_pct = values[5];
+    state.simulation.ttl = values[6];
+    state.simulation.seed = values[7];
+}
+
+// @brief parses "[address:]port" into state.metrics_addr (METRICS_DEFAULT_ADDRESS if no address is given); exits on error
+static void parse_metrics_address(char *value) {
+    char *colon = strrchr(value, ':');
+    char *port_str = colon ? colon + 1 : value;
+    const char *address = METRICS_DEFAULT_ADDRESS;
+    long port;
+
+    if (colon) {
+        *colon = '\0';
+        address = value;
+    }
+    if (!is_all_digits(port_str) || (port = strtol(port_str, NULL, 10)) < 1 || port > 65535) {
+        errorLogger("--metrics: invalid port", EX_USAGE);
+    }
+    if (inet_aton(address, &state.metrics_addr.sin_addr) == 0) {
+        errorLogger("--metrics: invalid IPv4 address", EX_USAGE);
+    }
+    state.metrics_addr.sin_family = AF_INET;
+    state.metrics_addr.sin_port = htons(port);
+}
+
 static void display_version() {
     printf("ft_ping (GNU inetutils) 2.0\n");
 }
 
 static void print_help(const char *program_name) {
-    printf("Usage: %s [options] <hostname/IP>\n\n", program_name);
+    printf("Usage: %s [options] <hostname/IP> [<hostname/IP>...]\n\n", program_name);
     printf("Options:\n");
     printf("  -c <count>    Stop after sending <count> packets\n");
     printf("  -s <size>     Packet data size (bytes)\n");
@@ -41,6 +163,26 @@ static void print_help(const char *program_name) {
     printf("  -q            Quiet mode\n");
     printf("  -f            Flood ping (send as fast as possible)\n");
     printf("  -i <number>   wait number seconds between sending each packet\n");
+    printf("  -W <timeout>  declare each probe lost <timeout> seconds after it's sent (reported right away)\n");
+    printf("  -w <deadline> stop after <deadline> seconds\n");
+    printf("  --batch <n>   send up to <n> packets per system call (sendmmsg)\n");
+    printf("  --rate <pps>  send <pps> packets per second (all targets together), overrides -i and -f pacing\n");
+    printf("  --burst <n>   in rate mode, send up to <n> packets back to back to catch up (default 1)\n");
+    printf("  --workers <n> ping from <n> processes pinned to cores, each with its own socket\n");
+    printf("  --hosts-file <file>  look host names up in <file> instead of /etc/hosts (before DNS)\n");
+    printf("  --dns-server <addr[:port]>  query that DNS server instead of those of /etc/resolv.conf\n");
+    printf("  --recv-thread        receive and parse replies on a dedicated thread\n");
+    printf("  --packet-ring        receive replies from a memory-mapped AF_PACKET ring (TPACKET_V3)\n");
+    printf("  --io-uring           send and receive through io_uring (falls back to sendmmsg/recvmmsg)\n");
+    printf("  --no-filter          don't attach the in-kernel ICMP filter to the raw socket (noise dropped in userspace)\n");
+    printf("  --kernel-timestamps  measure RTT with kernel send/receive timestamps\n");
+    printf("  --simulate <spec>    no network: answer the probes in memory on a virtual clock, as fast as the CPU goes\n");
+    printf("                       spec: delay=ms,jitter=ms,loss=%%,dup=%%,unreach=%%,exceeded=%%,ttl=n,seed=n\n");
+    printf("  --percentiles <list> report RTT percentiles, e.g. 50,90,99,99.9\n");
+    printf("  --format=<fmt>       output format: text (default), jsonl or csv (one record per event)\n");
+    printf("  --probe-log <file>   record every probe outcome in a binary log (see ft_ping_analyze)\n");
+    printf("  --metrics <[addr:]port>  serve the counters and RTT histograms on http://addr:port/metrics (Prometheus)\n");
+    printf("  --self-stats         report the ping loop's own costs: per-stage calls and times, wakeups, send lateness\n");
     printf("  -V            Display version information\n");
     printf("  -h, -?        Show this help message\n");
 }
@@ -176,6 +318,167 @@ int parse_options(int argc, char **argv) {
             }
 
             state.wait = value;
+        } else if (strcmp(arg, "-W") == 0 || strcmp(arg, "-w") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger(arg[1] == 'W' ? "-W: option requires an argument" : "-w: option requires an argument", EX_USAGE);
+            }
+
+            char *value_str = argv[++opt_index];
+            char *endptr;
+            double value = strtod(value_str, &endptr);
+
+            if (endptr == value_str || *endptr != '\0' || !(value > 0.0) || value > INT_MAX) {
+                errorLogger(arg[1] == 'W' ? "-W: invalid timeout" : "-w: invalid deadline", EX_USAGE);
+            }
+
+            if (arg[1] == 'W') {
+                state.probe_timeout = value;
+            } else {
+                state.deadline = value;
+            }
+        } else if (strcmp(arg, "--batch") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--batch: option requires an argument", EX_USAGE);
+            }
+
+            char *value_str = argv[++opt_index];
+
+            if (!is_all_digits(value_str)) {
+                errorLogger("--batch: invalid batch size", EX_USAGE);
+            }
+
+            long value = strtol(value_str, NULL, 10);
+
+            if (value < 1 || value > MAX_SEND_BATCH) {
+                errorLogger("--batch: batch size must be between 1 and 1024", EX_USAGE);
+            }
+
+            state.batch = value;
+        } else if (strcmp(arg, "--percentiles") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--percentiles: option requires an argument", EX_USAGE);
+            }
+
+            parse_percentiles(argv[++opt_index]);
+        } else if (strcmp(arg, "--probe-log") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--probe-log: option requires an argument", EX_USAGE);
+            }
+
+            state.probe_log = argv[++opt_index];
+        } else if (strncmp(arg, "--format=", 9) == 0) {
+            if (strcmp(arg + 9, "jsonl") == 0) {
+                state.output_format = OUTPUT_JSONL;
+            } else if (strcmp(arg + 9, "csv") == 0) {
+                state.output_format = OUTPUT_CSV;
+            } else if (strcmp(arg + 9, "text") == 0) {
+                state.output_format = OUTPUT_TEXT;
+            } else {
+                errorLogger("--format: format must be one of text, jsonl, csv", EX_USAGE);
+            }
+        } else if (strcmp(arg, "--rate") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--rate: option requires an argument", EX_USAGE);
+            }
+
+            char *value_str = argv[++opt_index];
+            char *endptr;
+            double value = strtod(value_str, &endptr);
+
+            if (endptr == value_str || *endptr != '\0' || !(value > 0.0) || value > 1e9) {
+                errorLogger("--rate: invalid rate", EX_USAGE);
+            }
+
+            // same privilege rule as -i (an interval under 0.2 s requires root)
+            if (value > 5.0 && geteuid() != 0) {
+                errorLogger("--rate: rate must be at most 5 packets/s; higher rates require root privileges", EX_USAGE);
+            }
+
+            state.rate = value;
+        } else if (strcmp(arg, "--burst") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--burst: option requires an argument", EX_USAGE);
+            }
+
+            char *value_str = argv[++opt_index];
+
+            if (!is_all_digits(value_str)) {
+                errorLogger("--burst: invalid burst size", EX_USAGE);
+            }
+
+            long value = strtol(value_str, NULL, 10);
+
+            if (value < 1 || value > MAX_PACER_BURST) {
+                errorLogger("--burst: burst size must be between 1 and 4096", EX_USAGE);
+            }
+
+            state.burst = value;
+        } else if (strcmp(arg, "--workers") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--workers: option requires an argument", EX_USAGE);
+            }
+
+            char *value_str = argv[++opt_index];
+
+            if (!is_all_digits(value_str)) {
+                errorLogger("--workers: invalid number of workers", EX_USAGE);
+            }
+
+            long value = strtol(value_str, NULL, 10);
+
+            if (value < 1 || value > MAX_WORKERS) {
+                errorLogger("--workers: number of workers must be between 1 and 256", EX_USAGE);
+            }
+
+            state.workers = value;
+        } else if (strcmp(arg, "--hosts-file") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--hosts-file: option requires an argument", EX_USAGE);
+            }
+
+            state.hosts_file = argv[++opt_index];
+        } else if (strcmp(arg, "--dns-server") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--dns-server: option requires an argument", EX_USAGE);
+            }
+
+            parse_dns_server(argv[++opt_index]);
+        } else if (strcmp(arg, "--metrics") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--metrics: option requires an argument", EX_USAGE);
+            }
+
+            parse_metrics_address(argv[++opt_index]);
+        } else if (strcmp(arg, "--recv-thread") == 0) {
+            state.recv_thread = 1;
+        } else if (strcmp(arg, "--packet-ring") == 0) {
+            state.packet_ring = 1;
+        } else if (strcmp(arg, "--io-uring") == 0) {
+            state.io_uring = 1;
+        } else if (strcmp(arg, "--simulate") == 0) {
+            // check if there's a next argument
+            if (opt_index + 1 >= argc) {
+                errorLogger("--simulate: option requires an argument", EX_USAGE);
+            }
+
+            parse_simulation(argv[++opt_index]);
+            state.simulate = 1;
+        } else if (strcmp(arg, "--self-stats") == 0) {
+            state.self_stats = 1;
+        } else if (strcmp(arg, "--no-filter") == 0) {
+            state.icmp_filter = 0;
+        } else if (strcmp(arg, "--kernel-timestamps") == 0) {
+            state.kernel_timestamps = 1;
         } else if (strcmp(arg, "-v") == 0) {
             state.verbose = 1;
         } else if (strcmp(arg, "-V") == 0) {
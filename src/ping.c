@@ -4,152 +4,556 @@
 #include "icmp.h"
 #include "statistics.h"
 #include "macros.h"
+#include "event.h"
+#include "output.h"
+#include "probelog.h"
+#include "receiver.h"
+#include "workers.h"
+#include "pacer.h"
+#include "timerwheel.h"
+#include "resolver.h"
+#include "packetring.h"
+#include "uring.h"
+#include "metrics.h"
+#include "selfstats.h"
+#include "signals.h"
+#include "target.h"
 #include <errno.h>
 #include <string.h>
-#include <sys/select.h>
+#include <stdlib.h>
 #include <sys/socket.h>
-#include <time.h>
 #include <unistd.h>
 #include <stdio.h>
 
 extern ping_state_t state;
 
+static uint64_t probe_timeout_ns = 0;   // -W, 0 if probes are waited for until the end of the run
+static uint64_t run_deadline_ns = 0;    // -w (absolute), 0 if the run has no deadline
+static size_t probes_left = 0;          // count mode: probes still to be sent (all targets together)
+static unsigned long expected_recv = 0; // count mode: replies expected
+static int counts_set = 0;              // probes_left and expected_recv are set (the loop has started)
 
-static void first_ping_log() {
-    printf("PING %s (%s): %zu data bytes", state.hostname, state.display_address, state.packet.data_len);
+static void print_ping_header(ping_target_t *target) {
+    if (state.output_format != OUTPUT_TEXT) {
+        return ;
+    }
+
+    printf("PING %s (%s): %zu data bytes", target->hostname, target->display_address, state.packet.data_len);
 
     if (state.verbose) {
-        printf(", id 0x%04x = %d", state.identifier, state.identifier);
+        printf(", id 0x%04x = %d", target->identifier, target->identifier);
     }
 
     printf("\n");
 }
 
-void start_pinging() {
-    first_ping_log();
+static void first_ping_log() {
+    for (size_t i = 0; i < state.num_targets; i++) {
+        if (state.targets[i].resolution == RESOLUTION_DONE) {
+            print_ping_header(&state.targets[i]);
+        }
+    }
+}
 
-    size_t count = state.count;
-    int isLoopInfinite = (count == 0); // in inetutils-2.0 implementation (they consider -c 0 as loop infinitely)
-    uint8_t buffer[PING_MAX_PACKET_SIZE];
-    float wait_interval = (state.flood == 1) ? 0.01 : state.wait; // interval (in seconds) to wait between each two sends
+// @brief resolver callback: a target got its address (it joins in), or turned out to be an unknown host (its probes are off)
+static void on_resolution(ping_target_t *target) {
+    if (target->resolution == RESOLUTION_DONE) {
+        print_ping_header(target);
+        return ;
+    }
 
-    while (count || isLoopInfinite) {
-        // create ICMP ECHO request message
-        if (createIcmpEchoRequestMessage() == ICMP_ERROR) {
-            infoLogger("Error while creating ICMP echo request message");
-            // waitBetweenPings(state.wait); // wait
-            continue;
+    // with a single host, the usual "unknown host" error says it all
+    if (state.num_targets > 1) {
+        fprintf(stderr, "%s: unknown host %s\n", state.program_name, target->hostname);
+    }
+    // before the loop starts, its counts leave the unknown hosts out by themselves
+    if (counts_set) {
+        probes_left -= state.count;
+        expected_recv -= state.count;
+    }
+}
+
+static size_t count_targets(int resolution) {
+    size_t found = 0;
+
+    for (size_t i = 0; i < state.num_targets; i++) {
+        found += (state.targets[i].resolution == resolution);
+    }
+    return (found);
+}
+
+// @brief a target is pinged once its address is known, until it's sent its state.count probes (forever if 0)
+static int wants_probe(ping_target_t *target) {
+    return (target->resolution == RESOLUTION_DONE && (state.count == 0 || target->probes < state.count));
+}
+
+// @brief sends the queued ICMP ECHO requests (one sendmmsg() call per batch)
+static void flush_batch(void) {
+    size_t pending = pendingIcmpEchoMessages();
+    uint64_t started = selfStatsStart();
+    ssize_t sent = flushIcmpEchoMessages();
+
+    selfStatsRecord(SELF_STAGE_SEND, started, (sent > 0) ? sent : 0);
+
+    if ((size_t)sent < pending) {
+        infoLogger("Error while sending ICMP echo request");
+    }
+
+    // when flood mode is on, log '.' after the ECHO REQUEST message is sent
+    if (state.quiet == 0 && state.flood == 1 && state.output_format == OUTPUT_TEXT && sent > 0) {
+        for (ssize_t i = 0; i < sent; i++) {
+            putchar('.');
+        }
+        fflush(stdout);
+    }
+}
+
+// @brief reports a probe that never got a reply (timeout record of the machine readable output and of the probe log)
+static void report_lost_probe(ping_target_t *target, uint16_t sequence) {
+    if (state.output_format != OUTPUT_TEXT) {
+        outputTimeout(target, sequence);
+    }
+    appendProbeRecord(target, PROBE_TIMEOUT, sequence, probeSendTime(target, sequence), 0, 0, 0, 0, 0);
+}
+
+// @brief timer wheel callback: the timeout (-W) of a probe expired before its reply came, it's declared lost right away
+// (unless it was never sent)
+static void expire_probe(wheel_timer_t *timer) {
+    uint16_t sequence = (uint16_t)timer->id;
+
+    if (probeUnsent(timer->owner, timer->id)) {
+        return ;
+    }
+
+    if (state.output_format == OUTPUT_TEXT && state.quiet == 0 && state.flood == 0) {
+        printf("Request timeout for icmp_seq %u\n", sequence);
+    }
+    report_lost_probe(timer->owner, sequence);
+}
+
+// @brief a probe without reply is still outstanding, unless it was never sent or its timeout (-W) expired (it was reported
+// lost then)
+static int is_outstanding(ping_target_t *target, uint64_t index) {
+    if (probeUnsent(target, index)) {
+        return (0);
+    }
+    return (!target->timeouts || probeTimeoutPending(target, index));
+}
+
+// @brief queues an ICMP ECHO request to target, sending the batch once it's full
+static void send_probe(ping_target_t *target) {
+    uint16_t window_index = target->sequence % SEQUENCE_WINDOW;
+
+    // the sequence about to be sent takes the window slot of the one sent SEQUENCE_WINDOW probes ago:
+    // if that one never got a reply, it's given up on now
+    // (its timeout, if still running, is stopped: it would report the probe a second time)
+    if (target->probes >= SEQUENCE_WINDOW) {
+        uint64_t oldest = target->probes - SEQUENCE_WINDOW;
+
+        if (!(target->received[window_index / 64] & ((uint64_t)1 << (window_index % 64))) && is_outstanding(target, oldest)) {
+            if (probeTimeoutPending(target, oldest)) {
+                cancelWheelTimer(probeTimer(target, oldest));
+            }
+            report_lost_probe(target, target->sequence - SEQUENCE_WINDOW);
         }
+    }
+
+    // create ICMP ECHO request message, in place in the send batch
+    uint64_t started = selfStatsStart();
+
+    if (createIcmpEchoRequestMessage(target, nextIcmpEchoSlot()) == ICMP_ERROR) {
+        infoLogger("Error while creating ICMP echo request message");
+        return ;
+    }
+    selfStatsRecord(SELF_STAGE_BUILD, started, 1);
+
+    // the probe's timeout takes its turn on the target's timers: the previous probe on this one is normally done with it,
+    // if not (more probes waiting than planned for) it's given up on now
+    wheel_timer_t *timer = probeTimer(target, target->probes);
+
+    if (timer) {
+        if (wheelTimerPending(timer)) {
+            cancelWheelTimer(timer);
+            expire_probe(timer);
+        }
+        timer->owner = target;
+        timer->id = target->probes;
+        addWheelTimer(timer, get_nanoseconds() + probe_timeout_ns);
+    }
+
+    // queue ICMP ECHO request message to destination, sending the batch once it's full
+    if ((size_t)queueIcmpEchoMessage(target) == state.batch) {
+        flush_batch();
+    }
+}
+
+// @brief sends 'rounds' rounds (a round is an ICMP ECHO request to each target that wants one), batched state.batch requests
+// per system call
+// @return the number of probes sent
+static size_t send_tick(size_t rounds) {
+    size_t sent = 0;
+
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < state.num_targets; i++) {
+            if (wants_probe(&state.targets[i])) {
+                send_probe(&state.targets[i]);
+                sent += 1;
+            }
+        }
+    }
+
+    if (pendingIcmpEchoMessages()) {
+        flush_batch();
+    }
+    return (sent);
+}
+
+// @brief rate mode: sends up to 'probes' ICMP ECHO requests, going round the targets that want one (where the last call left off)
+// @return the number of probes sent
+static size_t send_probes(size_t probes) {
+    static size_t next_target = 0;
+    size_t sent = 0;
+    size_t skipped = 0;
+
+    while (sent < probes && skipped < state.num_targets) {
+        ping_target_t *target = &state.targets[next_target];
 
-        // send ICMP ECHO request message to destination
-        if (sendIcmpEchoMessage() == SOCKET_ERROR) {
-            infoLogger("Error while sending ICMP echo request");
-            // waitBetweenPings(state.wait); // wait
+        next_target = (next_target + 1) % state.num_targets;
+        if (!wants_probe(target)) {
+            skipped += 1;
             continue;
         }
+        skipped = 0;
+        send_probe(target);
+        sent += 1;
+    }
 
-        // mark ICMP ECHO as sent
-        if (!isLoopInfinite && count > 0) {
-            count -= 1;
+    if (pendingIcmpEchoMessages()) {
+        flush_batch();
+    }
+    return (sent);
+}
+
+// @brief drains the socket receive buffer (non blocking), a batch of packets per recvmmsg() call, parsing and logging each packet
+static void drain_socket(void) {
+    // transmit timestamps first, so that replies find the kernel send time of their probe
+    if (state.kernel_timestamps) {
+        drainTxTimestamps();
+    }
+
+    while (1) {
+        recv_slot_t *slots;
+        uint64_t started = selfStatsStart();
+        ssize_t received = recvIcmpMessages(&slots);
+
+        selfStatsRecord(SELF_STAGE_RECV, started, (received > 0) ? received : 0);
+        if (received <= 0) {
+            break;
         }
 
-        // when flood mode is on, log '.' after the ECHO REQUEST message is sent
-        if (state.quiet == 0 && state.flood == 1) {
-            printf(".");
-            fflush(stdout);
+        started = selfStatsStart();
+        parseIcmpMessageBatch(slots, received);
+        selfStatsRecord(SELF_STAGE_PARSE, started, received);
+
+        // a partially filled ring means the socket is empty
+        if ((size_t)received < recvRingCapacity()) {
+            break;
         }
+    }
+}
 
-        // (*) productive wait (using select & recvfrom)
-        struct timespec start_time, current_time;
-        clock_gettime(CLOCK_MONOTONIC, &start_time);
+// @brief reports the probes (among the last SEQUENCE_WINDOW of each target) that never got a reply
+static void report_unanswered_probes(void) {
+    if (state.output_format == OUTPUT_TEXT && !state.probe_log) {
+        return ; // nobody to report them to
+    }
 
-        while (1) {
-            // calculate elapsed time since we sent the packet
-            clock_gettime(CLOCK_MONOTONIC, &current_time);
-            double elapsed = (current_time.tv_sec - start_time.tv_sec) + (current_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    for (size_t i = 0; i < state.num_targets; i++) {
+        ping_target_t *target = &state.targets[i];
+        uint64_t tracked = (target->probes < SEQUENCE_WINDOW) ? target->probes : SEQUENCE_WINDOW;
 
-            // if the wait interval is over, break the inner loop to send the next packet
-            if (elapsed >= wait_interval || (!isLoopInfinite && state.num_recv == state.count)) {
-                break;
-            }
+        // walked by probe (refused sends took a sequence too), is_outstanding skips those
+        for (uint64_t k = tracked; k > 0; k--) {
+            uint16_t sequence = target->sequence - k;
+            uint16_t window_index = sequence % SEQUENCE_WINDOW;
 
-            struct timeval select_timeout;
-            select_timeout.tv_sec = 0;
-            select_timeout.tv_usec = 10000; // 10ms
-
-            fd_set read_fds;
-
-            FD_ZERO(&read_fds);
-            FD_SET(state.sock_fd, &read_fds);
-
-            int select_ret = select(state.sock_fd + 1, &read_fds, NULL, NULL, &select_timeout);
-
-            if (select_ret > 0) {
-                // drain socket receive buffer
-                while (1) {
-                    struct sockaddr_in sender_addr;
-                    memset(&sender_addr, 0, sizeof(sender_addr));
-                    socklen_t sender_addr_len = sizeof(sender_addr);
-                    ssize_t packet_len = recvfrom(state.sock_fd, buffer, PING_MAX_PACKET_SIZE, MSG_DONTWAIT, (struct sockaddr *)&sender_addr, &sender_addr_len);
-                    if (packet_len > 0) {
-                        parseIcmpMessageAndLogResult(buffer, packet_len, (struct sockaddr *)&sender_addr, &sender_addr_len);
-                    } else {
-                        break;
-                    }
-                }
-            } else if (state.quiet == 0 && state.flood == 0 && select_ret < 0 && errno != EINTR) {
-                // infoLogger("Select() failed");
-                break;
+            if (!(target->received[window_index / 64] & ((uint64_t)1 << (window_index % 64))) && is_outstanding(target, target->probes - k)) {
+                report_lost_probe(target, sequence);
             }
         }
     }
+}
 
+// @brief arms the loop's timer for wake_ns, or earlier for the next probe timeout (-W) or the end of the run (-w)
+static void arm_timer(uint64_t wake_ns) {
+    if (probe_timeout_ns) {
+        uint64_t expiry = nextWheelExpiry();
 
-    // if we haven't received enough ECHO REPLIES (compared to sent ECHO REQUESTS), we wait for 1 second (giving another last chance)
-    struct timespec start_time, current_time;
-    clock_gettime(CLOCK_MONOTONIC, &start_time);
+        if (expiry && expiry < wake_ns) {
+            wake_ns = expiry;
+        }
+    }
 
-    while (state.num_recv < state.count) {
-        // calculate elapsed time since we sent the packet
-        clock_gettime(CLOCK_MONOTONIC, &current_time);
-        double elapsed = (current_time.tv_sec - start_time.tv_sec) + (current_time.tv_nsec - start_time.tv_nsec) / 1e9;
+    if (run_deadline_ns && run_deadline_ns < wake_ns) {
+        wake_ns = run_deadline_ns;
+    }
 
-        // if the wait interval (1 second) is over, break the inner loop to send the next packet
-        if (elapsed >= DEFAULT_PING_WAIT) {
-            break;
+    armEventTimer(wake_ns);
+}
+
+void run_ping_loop(void) {
+    int isLoopInfinite = (state.count == 0); // in inetutils-2.0 implementation (they consider -c 0 as loop infinitely)
+    float wait_interval = (state.flood == 1) ? 0.01 : state.wait; // interval (in seconds) to wait between each two sends
+    uint64_t interval_ns = (uint64_t)(wait_interval * 1e9);
+
+    // count mode: state.count probes per target (those whose host is unknown are left out)
+    probes_left = state.count * (state.num_targets - count_targets(RESOLUTION_FAILED));
+    expected_recv = probes_left;
+    counts_set = 1;
+
+    // rate mode: the token bucket paces single probes
+    if (state.rate > 0) {
+        interval_ns = (uint64_t)(1e9 / state.rate);
+    }
+
+    // with a batch bigger than the number of targets, a tick sends several rounds at once and ticks are spread
+    // accordingly (the average rate stays one round per interval, with a fraction of the system calls)
+    size_t rounds_per_tick = state.batch / state.num_targets;
+    if (rounds_per_tick == 0) {
+        rounds_per_tick = 1;
+    }
+    interval_ns *= rounds_per_tick;
+
+    // with a receiver thread, the loop waits on the thread's events instead of the socket
+    int event_source = state.sock_fd;
+
+    if (state.recv_thread) {
+        if (startReceiver() == RECEIVER_ERROR) {
+            errorLogger(ft_strjoin("receiver thread: ", strerror(errno)), EXIT_FAILURE);
         }
+        event_source = receiverEventFd();
+    } else if (state.packet_ring) {
+        event_source = packetRingFd();
+    }
+
+    if (createEventLoop(event_source) == EVENT_ERROR) {
+        errorLogger(ft_strjoin("event loop: ", strerror(errno)), EXIT_FAILURE);
+    }
+
+    // (*) one timer drives both phases: while sending, it holds the (absolute) time of the next round;
+    // once every round is sent, it holds the end of the "last chance" wait (interval + DEFAULT_PING_WAIT after the last round,
+    // with -W: until every probe is answered or timed out), in between the process sleeps until the timer expires or a packet arrives;
+    // the timer also goes off for probe timeouts and the run deadline, 'wake' is what the loop itself is waiting for
+    int sending = 1;
+    uint64_t loop_started = selfStatsStart();
+    uint64_t deadline = get_nanoseconds();
+    uint64_t wake = deadline;
+
+    run_deadline_ns = (state.deadline > 0) ? deadline + (uint64_t)(state.deadline * 1e9) : 0;
+    if (state.probe_timeout > 0) {
+        probe_timeout_ns = (uint64_t)(state.probe_timeout * 1e9);
+        initTimerWheel(deadline, probe_timeout_ns);
+    }
+    arm_timer(wake);
+
+    // in rate mode, the timer is armed PACER_SPIN_NS ahead of the send deadline, the rest is spent spinning
+    // (timer wake ups are late by tens of microseconds, which is the whole gap at high rates)
+    if (state.rate > 0) {
+        initPacer(deadline);
+    }
 
-        struct timeval select_timeout;
-        select_timeout.tv_sec = 0;
-        select_timeout.tv_usec = 10000; // 10ms
+    while (1) {
+        // every reply we expected is in: nothing left to wait for
+        if (!isLoopInfinite && state.num_recv >= expected_recv && !probes_left) {
+            break;
+        }
 
-        fd_set read_fds;
+        // every probe is sent and answered or timed out (-W)
+        if (!sending && probe_timeout_ns && pendingWheelTimers() == 0) {
+            break;
+        }
 
-        FD_ZERO(&read_fds);
-        FD_SET(state.sock_fd, &read_fds);
+        uint64_t started = selfStatsStart();
+        int events = waitForEvents();
 
-        int select_ret = select(state.sock_fd + 1, &read_fds, NULL, NULL, &select_timeout);
+        selfStatsRecord(SELF_STAGE_WAIT, started, 0);
+        selfStatsWakeup(events);
 
-        if (select_ret > 0) {
-            // drain socket receive buffer
-            while (1) {
-                struct sockaddr_in sender_addr;
-                memset(&sender_addr, 0, sizeof(sender_addr));
-                socklen_t sender_addr_len = sizeof(sender_addr);
-                ssize_t packet_len = recvfrom(state.sock_fd, buffer, PING_MAX_PACKET_SIZE, MSG_DONTWAIT, (struct sockaddr *)&sender_addr, &sender_addr_len);
-                if (packet_len > 0) {
-                    parseIcmpMessageAndLogResult(buffer, packet_len, (struct sockaddr *)&sender_addr, &sender_addr_len);
-                } else {
-                    break;
-                }
+        if (events == EVENT_ERROR) {
+            if (state.quiet == 0 && state.flood == 0) {
+                infoLogger("epoll_wait() failed");
             }
-        } else if (state.quiet == 0 && state.flood == 0 && select_ret < 0 && errno != EINTR) {
-            infoLogger("Select() failed");
             break;
         }
+
+        if (events & EVENT_SOCKET_READABLE) {
+            // the other backends receive and parse in one go (or on their own thread), they're timed as a whole
+            started = selfStatsStart();
+            if (state.recv_thread) {
+                drainReceiver();
+            } else if (state.packet_ring) {
+                drainPacketRing();
+            } else if (state.io_uring) {
+                drainUring();
+            } else {
+                drain_socket();
+                started = 0;
+            }
+            selfStatsRecord(SELF_STAGE_DRAIN, started, 0);
+        }
+
+        // signals are serviced here, between two packets: the counters are never caught half updated
+        int signals = takeSignals();
+
+        if (signals & SIGNAL_STOP) {
+            break; // SIGINT: the run ends as with -w, whatever is left
+        }
+        if (signals & SIGNAL_SNAPSHOT) {
+            print_interim_statistics();
+        }
+
+        outputTick();
+        metricsTick();
+
+        // loss events go out as soon as a probe's timeout expires
+        if (probe_timeout_ns) {
+            expireWheelTimers(get_nanoseconds(), expire_probe);
+        }
+
+        if (!(events & EVENT_TIMER_EXPIRED)) {
+            continue;
+        }
+
+        uint64_t now = get_nanoseconds();
+
+        if (run_deadline_ns && now >= run_deadline_ns) {
+            break; // -w: the run is over, whatever is left
+        }
+
+        // woken up for a probe timeout: back to waiting (with -W, the last chance lasts until no probe is outstanding)
+        if (now < wake) {
+            arm_timer(wake);
+            continue;
+        }
+
+        if (!sending) {
+            break; // last chance is over
+        }
+
+        // targets whose address just came in join in from this round on
+        collectResolutions(now, on_resolution);
+
+        if (state.rate > 0) {
+            started = selfStatsStart();
+            now = spinUntilDeadline(deadline);
+            selfStatsRecord(SELF_STAGE_SPIN, started, 0);
+            selfStatsLateness(deadline, now);
+            size_t probes = takePacerTokens(now);
+
+            if (!isLoopInfinite && probes > probes_left) {
+                probes = probes_left;
+            }
+
+            size_t sent = send_probes(probes);
+
+            if (!isLoopInfinite) {
+                probes_left -= sent;
+            }
+
+            if (!isLoopInfinite && probes_left == 0) {
+                sending = 0;
+                deadline = now + interval_ns + (uint64_t)DEFAULT_PING_WAIT * 1000000000ULL;
+                wake = probe_timeout_ns ? UINT64_MAX : deadline;
+            } else {
+                deadline = nextPacerDeadline(get_nanoseconds());
+                wake = (deadline > PACER_SPIN_NS) ? deadline - PACER_SPIN_NS : deadline;
+            }
+            arm_timer(wake);
+            continue;
+        }
+
+        selfStatsLateness(deadline, now);
+        size_t sent = send_tick(rounds_per_tick);
+
+        // mark the probes as sent
+        if (!isLoopInfinite) {
+            probes_left -= sent;
+        }
+
+        if (!isLoopInfinite && probes_left == 0) {
+            // every round is sent: give the replies the usual interval plus a last chance (with -W, their own timeouts)
+            sending = 0;
+            deadline += interval_ns + (uint64_t)DEFAULT_PING_WAIT * 1000000000ULL;
+            if (probe_timeout_ns) {
+                deadline = UINT64_MAX;
+            }
+        } else {
+            // absolute deadlines keep the send schedule from drifting; when we fell behind by more than an interval
+            // (stopped process, slow terminal) the schedule restarts from now instead of bursting to catch up
+            deadline += interval_ns;
+            now = get_nanoseconds();
+            if (deadline + interval_ns < now) {
+                deadline = now;
+                state.self.schedule_resets += 1;
+            }
+        }
+        wake = deadline;
+        arm_timer(wake);
+    }
+
+    closeEventLoop();
+    stopReceiver();
+
+    if (loop_started) {
+        state.self.loop_ns = selfStatsStart() - loop_started;
+    }
+
+    report_unanswered_probes();
+}
+
+// @brief SIGINT before the first probe (slow lookups): the (empty) summary is all there is; the resolver threads are not
+// waited for (a lookup can take seconds to time out), the process exits with them still running
+static void stop_before_start(void) {
+    print_statistics();
+    closeOutput();
+    closeProbeLog();
+    exit(EXIT_SUCCESS);
+}
+
+void start_pinging() {
+    first_ping_log();
+
+    // pinging starts as soon as an address is known, the other targets join in as they resolve
+    while (count_targets(RESOLUTION_DONE) == 0 && pendingResolutions()) {
+        waitForResolutions();
+        collectResolutions(get_nanoseconds(), on_resolution);
+
+        if (takeSignals() & SIGNAL_STOP) {
+            stop_before_start();
+        }
+    }
+
+    if (count_targets(RESOLUTION_DONE) == 0) {
+        errorLogger("unknown host", EXIT_FAILURE);
+    }
+
+    if (state.workers > 1) {
+        // workers are forked with every address known (the resolver threads wouldn't survive the fork)
+        while (pendingResolutions()) {
+            waitForResolutions();
+            collectResolutions(get_nanoseconds(), on_resolution);
+            if (takeSignals() & SIGNAL_STOP) {
+                stop_before_start();
+            }
+        }
+        stopResolver();
+        runWorkers();
+    } else {
+        run_ping_loop();
+        stopResolver();
     }
 
-    if (state.quiet == 0 && state.flood == 1) {
+    if (state.quiet == 0 && state.flood == 1 && state.output_format == OUTPUT_TEXT) {
         printf("\n");
     }
 
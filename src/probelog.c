@@ -0,0 +1,135 @@
+// binary probe log: fixed-size records appended to a memory-mapped file that grows by doubling
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "ft_ping.h"
+#include "macros.h"
+#include "probelog.h"
+#include "utils.h"
+
+extern ping_state_t state;
+
+static int log_fd = -1;
+static uint8_t *log_map = NULL;
+static size_t log_map_size = 0;
+static size_t records_offset = 0;   // offset of the first record (header + targets table)
+
+// @brief resizes the file and its mapping to new_size bytes
+static int grow_log(size_t new_size) {
+    if (ftruncate(log_fd, new_size) < 0) {
+        return (PROBELOG_ERROR);
+    }
+
+    void *map = (log_map == NULL)
+        ? mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, log_fd, 0)
+        : mremap(log_map, log_map_size, new_size, MREMAP_MAYMOVE);
+
+    if (map == MAP_FAILED) {
+        return (PROBELOG_ERROR);
+    }
+
+    log_map = map;
+    log_map_size = new_size;
+    return (PROBELOG_OK);
+}
+
+int openProbeLog(const char *path) {
+    log_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
+        return (PROBELOG_ERROR);
+    }
+
+    records_offset = sizeof(probelog_header_t) + state.num_targets * sizeof(probelog_target_t);
+
+    if (grow_log(records_offset + PROBELOG_INITIAL_RECORDS * sizeof(probe_record_t)) == PROBELOG_ERROR) {
+        int saved_errno = errno;
+        close(log_fd);
+        log_fd = -1;
+        errno = saved_errno;
+        return (PROBELOG_ERROR);
+    }
+
+    probelog_header_t *header = (probelog_header_t *)log_map;
+
+    memcpy(header->magic, PROBELOG_MAGIC, sizeof(header->magic));
+    header->version = PROBELOG_VERSION;
+    header->record_size = sizeof(probe_record_t);
+    header->num_targets = state.num_targets;
+    header->data_len = state.packet.data_len;
+    header->num_records = 0;
+    header->start_ns = get_realtime_nanoseconds();
+
+    probelog_target_t *targets = (probelog_target_t *)(log_map + sizeof(probelog_header_t));
+    for (size_t i = 0; i < state.num_targets; i++) {
+        targets[i].address = state.targets[i].dest_addr.sin_addr.s_addr;
+        strncpy(targets[i].name, state.targets[i].hostname, PROBELOG_NAME_LEN - 1);
+    }
+
+    return (PROBELOG_OK);
+}
+
+void updateProbeLogTarget(ping_target_t *target) {
+    if (!log_map) {
+        return ;
+    }
+
+    probelog_target_t *targets = (probelog_target_t *)(log_map + sizeof(probelog_header_t));
+    targets[target - state.targets].address = target->dest_addr.sin_addr.s_addr;
+}
+
+void appendProbeRecord(ping_target_t *target, uint8_t kind, uint16_t sequence, uint64_t sent_ns, uint64_t reply_ns,
+                       uint16_t size, uint8_t ttl, uint8_t icmp_type, uint8_t icmp_code) {
+    if (!log_map) {
+        return ;
+    }
+
+    probelog_header_t *header = (probelog_header_t *)log_map;
+    size_t offset = records_offset + header->num_records * sizeof(probe_record_t);
+
+    if (offset + sizeof(probe_record_t) > log_map_size) {
+        // doubling keeps appends amortized O(1); on failure the log just stops growing
+        if (grow_log(records_offset + (log_map_size - records_offset) * 2) == PROBELOG_ERROR) {
+            return ;
+        }
+        header = (probelog_header_t *)log_map;
+    }
+
+    probe_record_t *record = (probe_record_t *)(log_map + offset);
+
+    record->sent_ns = sent_ns;
+    record->reply_ns = reply_ns;
+    record->target = target - state.targets;
+    record->sequence = sequence;
+    record->size = size;
+    record->kind = kind;
+    record->ttl = ttl;
+    record->icmp_type = icmp_type;
+    record->icmp_code = icmp_code;
+    record->reserved = 0;
+
+    // the count is bumped last, with a release store: a reader (or a crash) never sees a half written record
+    __atomic_store_n(&header->num_records, header->num_records + 1, __ATOMIC_RELEASE);
+}
+
+void closeProbeLog(void) {
+    if (!log_map) {
+        return ;
+    }
+
+    probelog_header_t *header = (probelog_header_t *)log_map;
+    size_t used = records_offset + header->num_records * sizeof(probe_record_t);
+
+    munmap(log_map, log_map_size);
+    if (ftruncate(log_fd, used) < 0) {
+        // the file keeps its preallocated tail, num_records still tells where the records end
+    }
+    close(log_fd);
+
+    log_map = NULL;
+    log_map_size = 0;
+    log_fd = -1;
+}
@@ -0,0 +1,237 @@
+// receiver thread: recvmmsg + parse stage on its own thread, events handed over through an SPSC ring
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "ft_ping.h"
+#include "icmp.h" // before macros.h (its PARSE_* macros would clash with the parse_status_t enum)
+#include "macros.h"
+#include "receiver.h"
+#include "socket.h"
+#include "spsc.h"
+
+extern ping_state_t state;
+
+static spsc_ring_t ring;
+static pthread_t thread;
+static int event_fd = -1;
+static atomic_int stop_requested = 0;
+static int running = 0;
+
+// counters of the receiver thread: written by it only (relaxed, no read-modify-write needed), read by the main thread,
+// which adds what they gained since its last look to the state's (folded)
+typedef struct receiver_counters {
+    _Atomic unsigned long recv_calls;
+    _Atomic unsigned long recv_packets;
+    _Atomic unsigned long noise_packets;
+    _Atomic unsigned long ring_overflows;
+    _Atomic size_t ring_max_occupancy;
+    _Atomic unsigned long ring_occupancy_sum;
+    _Atomic unsigned long ring_samples;
+} receiver_counters_t;
+
+static receiver_counters_t counters;
+
+typedef struct folded_counters {
+    unsigned long recv_calls;
+    unsigned long recv_packets;
+    unsigned long noise_packets;
+    unsigned long ring_overflows;
+    unsigned long ring_occupancy_sum;
+    unsigned long ring_samples;
+} folded_counters_t;
+
+static folded_counters_t folded;
+
+// @brief receiver thread: adds n to one of its counters
+static void count(_Atomic unsigned long *counter, unsigned long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// @brief main thread: adds what a counter of the receiver gained since the last fold to the state's counter
+static void fold(unsigned long *into, _Atomic unsigned long *counter, unsigned long *last) {
+    unsigned long value = atomic_load_explicit(counter, memory_order_relaxed);
+
+    *into += value - *last;
+    *last = value;
+}
+
+// @brief main thread: brings the state's receive, noise and ring counters up to date with the receiver's
+static void fold_counters(void) {
+    fold(&state.recv_calls, &counters.recv_calls, &folded.recv_calls);
+    fold(&state.recv_packets, &counters.recv_packets, &folded.recv_packets);
+    fold(&state.noise_packets, &counters.noise_packets, &folded.noise_packets);
+    fold(&state.ring_overflows, &counters.ring_overflows, &folded.ring_overflows);
+    fold(&state.ring_occupancy_sum, &counters.ring_occupancy_sum, &folded.ring_occupancy_sum);
+    fold(&state.ring_samples, &counters.ring_samples, &folded.ring_samples);
+
+    size_t max_occupancy = atomic_load_explicit(&counters.ring_max_occupancy, memory_order_relaxed);
+    if (max_occupancy > state.ring_max_occupancy) {
+        state.ring_max_occupancy = max_occupancy;
+    }
+}
+
+// @brief wakes up the main thread (eventfd counter + 1)
+static void notify_main_thread(void) {
+    uint64_t one = 1;
+
+    if (write(event_fd, &one, sizeof(one)) < 0) {
+        // EAGAIN: the counter is saturated, the main thread is already woken up
+    }
+}
+
+static void *receiver_loop(void *arg) {
+    (void)arg;
+
+    while (!atomic_load_explicit(&stop_requested, memory_order_relaxed)) {
+        recv_slot_t *slots;
+        ssize_t received = waitIcmpMessages(&slots);
+
+        if (received <= 0) {
+            continue; // receive timeout (EAGAIN) or interrupted: check whether we're to stop
+        }
+
+        count(&counters.recv_calls, 1);
+        count(&counters.recv_packets, received);
+
+        size_t pushed = 0;
+
+        for (ssize_t i = 0; i < received; i++) {
+            icmp_event_t event;
+
+            if (slots[i].len == 0) {
+                continue;
+            }
+            if (parseIcmpMessage(slots[i].data, slots[i].len, (struct sockaddr *)&slots[i].sender_addr,
+                                 &slots[i].sender_addr_len, &slots[i].rx_time, &event) != PARSE_OK) {
+                count(&counters.noise_packets, 1); // not about an echo request
+                continue;
+            }
+            if (spscRingPush(&ring, &event) == SPSC_FULL) {
+                count(&counters.ring_overflows, 1); // the main thread is behind: the reply is lost (it will show as a timeout)
+            } else {
+                pushed += 1;
+            }
+        }
+
+        if (pushed) {
+            size_t occupancy = spscRingOccupancy(&ring);
+
+            if (occupancy > atomic_load_explicit(&counters.ring_max_occupancy, memory_order_relaxed)) {
+                atomic_store_explicit(&counters.ring_max_occupancy, occupancy, memory_order_relaxed);
+            }
+            count(&counters.ring_occupancy_sum, occupancy);
+            count(&counters.ring_samples, 1);
+
+            notify_main_thread();
+        }
+    }
+
+    return (NULL);
+}
+
+int startReceiver(void) {
+    // the receive timeout bounds how long the thread takes to notice it's asked to stop
+    struct timeval timeout = { .tv_sec = 0, .tv_usec = RECEIVER_STOP_CHECK_US };
+
+    if (setsockopt(state.sock_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        return (RECEIVER_ERROR);
+    }
+
+    if (createSpscRing(&ring, RECEIVER_RING_SIZE, sizeof(icmp_event_t)) == SPSC_ERROR) {
+        return (RECEIVER_ERROR);
+    }
+
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) {
+        destroySpscRing(&ring);
+        return (RECEIVER_ERROR);
+    }
+
+    // signals are for the main thread (its loop services them, see signals.h)
+    sigset_t all_signals, previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous_mask);
+
+    atomic_store(&stop_requested, 0);
+    memset(&counters, 0, sizeof(counters));
+    memset(&folded, 0, sizeof(folded));
+    int err = pthread_create(&thread, NULL, receiver_loop, NULL);
+
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+
+    if (err != 0) {
+        close(event_fd);
+        event_fd = -1;
+        destroySpscRing(&ring);
+        errno = err;
+        return (RECEIVER_ERROR);
+    }
+
+    running = 1;
+    return (RECEIVER_OK);
+}
+
+int receiverEventFd(void) {
+    return (event_fd);
+}
+
+void drainReceiver(void) {
+    if (!running) {
+        return ;
+    }
+
+    uint64_t counter;
+    if (read(event_fd, &counter, sizeof(counter)) < 0) {
+        // EAGAIN: woken up for nothing, the ring is checked anyway
+    }
+
+    // transmit timestamps first, so that replies find the kernel send time of their probe
+    // (the error queue is left to this thread: tx stamps are written and read here only)
+    if (state.kernel_timestamps) {
+        drainTxTimestamps();
+    }
+
+    icmp_event_t event;
+    size_t handled = 0;
+
+    while (handled < RECEIVER_DRAIN_BUDGET && spscRingPop(&ring, &event)) {
+        handleIcmpEvent(&event);
+        handled += 1;
+    }
+
+    // budget spent with events left: stay readable so the loop comes back here right after its timer check
+    if (handled == RECEIVER_DRAIN_BUDGET && spscRingOccupancy(&ring) > 0) {
+        notify_main_thread();
+    }
+
+    fold_counters();
+}
+
+void stopReceiver(void) {
+    if (!running) {
+        return ;
+    }
+
+    atomic_store(&stop_requested, 1);
+    pthread_join(thread, NULL);
+    running = 0;
+
+    // replies that made it into the ring are still ours
+    icmp_event_t event;
+    while (spscRingPop(&ring, &event)) {
+        handleIcmpEvent(&event);
+    }
+    fold_counters();
+
+    close(event_fd);
+    event_fd = -1;
+    destroySpscRing(&ring);
+}
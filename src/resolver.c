@@ -0,0 +1,464 @@
+// asynchronous resolver: lookups on a pool of threads, answers cached per name and applied to the targets by the main thread
+
+#define _DEFAULT_SOURCE
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <resolv.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "ft_ping.h"
+#include "macros.h"
+#include "parsing.h"
+#include "probelog.h"
+#include "resolver.h"
+#include "target.h"
+#include "utils.h"
+
+extern ping_state_t state;
+
+#define NO_TARGET ((size_t)-1)
+
+// cache entry: one per distinct host name, written by a resolver thread while it's in flight, by the main thread otherwise
+typedef struct cache_entry {
+    const char *name;
+    struct in_addr addr;                // last answer
+    uint32_t ttl;                       // of the last answer (seconds)
+    int answered;                       // 1 if the last lookup found an address
+    int in_flight;                      // queued or being looked up
+    uint64_t expires_ns;                // when the answer has to be looked up again (UINT64_MAX: never)
+    size_t first_target;                // targets with this name, chained through next_target
+} cache_entry_t;
+
+static cache_entry_t *entries = NULL;
+static size_t num_entries = 0;
+static size_t *next_target = NULL;
+
+// open addressing hash table (linear probing) mapping a name to (entry index + 1), 0 marks an empty slot
+static uint32_t *name_table = NULL;
+static size_t name_table_mask = 0;
+
+// lookups waiting for a thread, and answers waiting for the main thread (both circular, at most num_entries each)
+static size_t *jobs = NULL;
+static size_t job_head = 0;
+static size_t num_jobs = 0;
+static size_t *answers = NULL;
+static size_t num_answers = 0;
+static size_t *collected = NULL;
+static size_t in_flight = 0;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t answer_ready = PTHREAD_COND_INITIALIZER;
+static pthread_t threads[RESOLVER_THREADS];
+static size_t num_threads = 0;
+static int stopping = 0;
+
+static size_t unresolved = 0;           // targets without a first answer
+static uint64_t next_refresh_ns = UINT64_MAX;
+
+// (*) lookups (resolver threads)
+
+static size_t hash_name(const char *name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+
+    while (*name) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return (hash & name_table_mask);
+}
+
+// @brief looks name up in the hosts file (first IPv4 line naming it, aliases included)
+// @return 1 if found, 0 otherwise
+static int lookup_hosts_file(const char *name, struct in_addr *addr) {
+    FILE *file = fopen(state.hosts_file ? state.hosts_file : DEFAULT_HOSTS_FILE, "r");
+    char *line = NULL;
+    size_t line_size = 0;
+    int found = 0;
+
+    if (!file) {
+        return (0);
+    }
+
+    while (!found && getline(&line, &line_size, file) >= 0) {
+        char *comment = strchr(line, '#');
+        char *saveptr;
+
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char *address = strtok_r(line, " \t\n", &saveptr);
+        if (!address || inet_aton(address, addr) == 0) {
+            continue; // empty line or IPv6
+        }
+
+        char *alias;
+        while ((alias = strtok_r(NULL, " \t\n", &saveptr))) {
+            if (strcasecmp(alias, name) == 0) {
+                found = 1;
+                break;
+            }
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return (found);
+}
+
+// @brief queries DNS for the A record of name (search domains of resolv.conf applied), ttl is the smallest of the answer
+// (the CNAME chain included)
+// @return 1 if found, 0 otherwise
+static int lookup_dns(const char *name, struct in_addr *addr, uint32_t *ttl) {
+    struct __res_state resolver;
+    unsigned char answer[RESOLVER_ANSWER_SIZE];
+
+    memset(&resolver, 0, sizeof(resolver));
+    if (res_ninit(&resolver) < 0) {
+        return (0);
+    }
+
+    if (state.dns_server.sin_family == AF_INET) {
+        resolver.nscount = 1;
+        resolver.nsaddr_list[0] = state.dns_server;
+    }
+
+    int len = res_nsearch(&resolver, name, ns_c_in, ns_t_a, answer, sizeof(answer));
+    res_nclose(&resolver);
+
+    ns_msg message;
+    if (len < 0 || ns_initparse(answer, len, &message) < 0) {
+        return (0);
+    }
+
+    int found = 0;
+    *ttl = UINT32_MAX;
+
+    for (int i = 0; i < ns_msg_count(message, ns_s_an); i++) {
+        ns_rr record;
+
+        if (ns_parserr(&message, ns_s_an, i, &record) < 0) {
+            break;
+        }
+        if (ns_rr_ttl(record) < *ttl) {
+            *ttl = ns_rr_ttl(record);
+        }
+        if (!found && ns_rr_type(record) == ns_t_a && ns_rr_rdlen(record) == sizeof(struct in_addr)) {
+            memcpy(addr, ns_rr_rdata(record), sizeof(struct in_addr));
+            found = 1;
+        }
+    }
+
+    return (found);
+}
+
+// @brief hosts file, then DNS, then (unless the hosts file or the DNS server are overridden) whatever getaddrinfo knows
+// @return 1 if found, 0 otherwise
+static int lookup_name(const char *name, struct in_addr *addr, uint32_t *ttl) {
+    char display_address[INET_ADDRSTRLEN];
+
+    if (lookup_hosts_file(name, addr)) {
+        *ttl = RESOLVER_DEFAULT_TTL;
+        return (1);
+    }
+    if (lookup_dns(name, addr, ttl)) {
+        return (1);
+    }
+    if (!state.hosts_file && state.dns_server.sin_family != AF_INET && parse_input_address(name, addr, display_address) == PARSE_OK) {
+        *ttl = RESOLVER_DEFAULT_TTL;
+        return (1);
+    }
+    return (0);
+}
+
+static void *resolver_loop(void *arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&lock);
+    while (1) {
+        while (num_jobs == 0 && !stopping) {
+            pthread_cond_wait(&job_ready, &lock);
+        }
+        if (stopping) {
+            break;
+        }
+
+        size_t index = jobs[job_head];
+        job_head = (job_head + 1) % num_entries;
+        num_jobs -= 1;
+        pthread_mutex_unlock(&lock);
+
+        struct in_addr addr;
+        uint32_t ttl = 0;
+        int answered = lookup_name(entries[index].name, &addr, &ttl);
+
+        pthread_mutex_lock(&lock);
+        entries[index].answered = answered;
+        if (answered) {
+            entries[index].addr = addr;
+            entries[index].ttl = ttl;
+        }
+        answers[num_answers++] = index;
+        pthread_cond_signal(&answer_ready);
+    }
+    pthread_mutex_unlock(&lock);
+    return (NULL);
+}
+
+// (*) main thread
+
+static void queue_lookup(size_t index) {
+    entries[index].in_flight = 1;
+
+    pthread_mutex_lock(&lock);
+    jobs[(job_head + num_jobs) % num_entries] = index;
+    num_jobs += 1;
+    in_flight += 1;
+    pthread_cond_signal(&job_ready);
+    pthread_mutex_unlock(&lock);
+}
+
+// @brief returns the cache entry of name, adding it if it's not there yet
+static size_t find_entry(const char *name) {
+    size_t slot = hash_name(name);
+
+    while (name_table[slot] != 0) {
+        if (strcmp(entries[name_table[slot] - 1].name, name) == 0) {
+            return (name_table[slot] - 1);
+        }
+        slot = (slot + 1) & name_table_mask;
+    }
+
+    cache_entry_t *entry = &entries[num_entries];
+    entry->name = name;
+    entry->first_target = NO_TARGET;
+    entry->expires_ns = UINT64_MAX;
+    name_table[slot] = num_entries + 1;
+    return (num_entries++);
+}
+
+// @brief points target at addr (moving its route if it had another address)
+static void set_target_address(ping_target_t *target, struct in_addr addr) {
+    size_t index = target - state.targets;
+
+    // special address (0.0.0.0), as parse_input_address does
+    if (addr.s_addr == 0) {
+        inet_aton("127.0.0.1", &addr);
+    }
+
+    if (target->resolution == RESOLUTION_DONE) {
+        unregisterTargetAddress(index);
+    }
+
+    memset(&target->dest_addr, 0, sizeof(target->dest_addr));
+    target->dest_addr.sin_family = AF_INET;
+    target->dest_addr.sin_port = 0;
+    target->dest_addr.sin_addr = addr;
+    inet_ntop(AF_INET, &addr, target->display_address, sizeof(target->display_address));
+    registerTargetAddress(index);
+    updateProbeLogTarget(target);
+}
+
+int startResolver(char **names, size_t num_names) {
+    size_t table_size = 16;
+
+    while (table_size < num_names * 2) {
+        table_size <<= 1;
+    }
+
+    entries = calloc(num_names, sizeof(cache_entry_t));
+    next_target = calloc(num_names, sizeof(size_t));
+    name_table = calloc(table_size, sizeof(uint32_t));
+    jobs = calloc(num_names, sizeof(size_t));
+    answers = calloc(num_names, sizeof(size_t));
+    collected = calloc(num_names, sizeof(size_t));
+    if (!entries || !next_target || !name_table || !jobs || !answers || !collected) {
+        stopResolver();
+        return (RESOLVER_ERROR);
+    }
+    name_table_mask = table_size - 1;
+
+    for (size_t i = 0; i < num_names; i++) {
+        ping_target_t *target = &state.targets[i];
+        struct in_addr addr;
+
+        target->hostname = names[i];
+        target->resolution = RESOLUTION_PENDING;
+
+        // IP addresses need no lookup
+        if (inet_aton(names[i], &addr) != 0) {
+            set_target_address(target, addr);
+            target->resolution = RESOLUTION_DONE;
+            continue;
+        }
+
+        size_t index = find_entry(names[i]);
+        next_target[i] = entries[index].first_target;
+        entries[index].first_target = i;
+        unresolved += 1;
+    }
+
+    // signals are for the main thread
+    sigset_t all_signals, previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous_mask);
+
+    for (size_t i = 0; i < num_entries && num_threads < RESOLVER_THREADS; i++) {
+        int err = pthread_create(&threads[num_threads], NULL, resolver_loop, NULL);
+
+        if (err != 0) {
+            pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+            stopResolver();
+            errno = err;
+            return (RESOLVER_ERROR);
+        }
+        num_threads += 1;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+
+    for (size_t i = 0; i < num_entries; i++) {
+        queue_lookup(i);
+    }
+    return (RESOLVER_OK);
+}
+
+// @brief hands the answer of entries[index] to its targets
+static void apply_answer(size_t index, uint64_t now_ns, void (*resolved)(ping_target_t *target)) {
+    cache_entry_t *entry = &entries[index];
+    int refreshed = 0; // some target was already pinging this name
+
+    entry->in_flight = 0;
+
+    for (size_t i = entry->first_target; i != NO_TARGET; i = next_target[i]) {
+        ping_target_t *target = &state.targets[i];
+
+        if (target->resolution == RESOLUTION_DONE) {
+            refreshed = 1;
+            if (entry->answered && target->dest_addr.sin_addr.s_addr != entry->addr.s_addr) {
+                set_target_address(target, entry->addr);
+            }
+            continue;
+        }
+
+        unresolved -= 1;
+        if (entry->answered) {
+            set_target_address(target, entry->addr);
+            target->resolution = RESOLUTION_DONE;
+        } else {
+            target->resolution = RESOLUTION_FAILED;
+        }
+        resolved(target);
+    }
+
+    // the answer is good for its TTL; a failed refresh keeps the previous address for a while, a name that never
+    // resolved is given up on
+    if (entry->answered) {
+        uint32_t ttl = (entry->ttl < RESOLVER_MIN_TTL) ? RESOLVER_MIN_TTL : entry->ttl;
+        entry->expires_ns = now_ns + (uint64_t)ttl * 1000000000ULL;
+    } else if (refreshed) {
+        entry->expires_ns = now_ns + (uint64_t)RESOLVER_RETRY_TTL * 1000000000ULL;
+    } else {
+        entry->expires_ns = UINT64_MAX;
+    }
+
+    if (entry->expires_ns < next_refresh_ns) {
+        next_refresh_ns = entry->expires_ns;
+    }
+}
+
+size_t collectResolutions(uint64_t now_ns, void (*resolved)(ping_target_t *target)) {
+    if (num_threads == 0) {
+        return (0);
+    }
+
+    pthread_mutex_lock(&lock);
+    size_t count = num_answers;
+    memcpy(collected, answers, count * sizeof(size_t));
+    num_answers = 0;
+    in_flight -= count;
+    pthread_mutex_unlock(&lock);
+
+    for (size_t i = 0; i < count; i++) {
+        apply_answer(collected[i], now_ns, resolved);
+    }
+
+    // answers whose TTL ran out are looked up again (the targets keep pinging the old address meanwhile)
+    if (now_ns >= next_refresh_ns) {
+        next_refresh_ns = UINT64_MAX;
+
+        for (size_t i = 0; i < num_entries; i++) {
+            if (entries[i].in_flight) {
+                continue;
+            }
+            if (entries[i].expires_ns <= now_ns) {
+                queue_lookup(i);
+            } else if (entries[i].expires_ns < next_refresh_ns) {
+                next_refresh_ns = entries[i].expires_ns;
+            }
+        }
+    }
+
+    return (count);
+}
+
+void waitForResolutions(void) {
+    struct timespec until;
+
+    // the condition variable's clock is CLOCK_REALTIME (a clock step only makes this one wait shorter or longer)
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += RESOLVER_WAIT_SLICE_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec += 1;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (num_answers == 0 && in_flight > 0) {
+        if (pthread_cond_timedwait(&answer_ready, &lock, &until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+size_t pendingResolutions(void) {
+    return (unresolved);
+}
+
+void stopResolver(void) {
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_broadcast(&job_ready);
+    pthread_mutex_unlock(&lock);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    num_threads = 0;
+
+    free(entries);
+    free(next_target);
+    free(name_table);
+    free(jobs);
+    free(answers);
+    free(collected);
+    entries = NULL;
+    next_target = NULL;
+    name_table = NULL;
+    jobs = NULL;
+    answers = NULL;
+    collected = NULL;
+    num_entries = 0;
+    num_jobs = 0;
+    num_answers = 0;
+    in_flight = 0;
+}
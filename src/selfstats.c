@@ -0,0 +1,156 @@
+// self-instrumentation (--self-stats): per-stage call counts and timings of the ping loop, send schedule lateness
+
+#include <math.h>
+#include <time.h>
+#include "ft_ping.h"
+#include "event.h"
+#include "selfstats.h"
+
+extern ping_state_t state;
+
+static const char *stage_names[SELF_STAGES] = { "build", "send", "wait", "spin", "recv", "parse", "drain" };
+
+// the stages are timed with the real clock, a simulation's virtual clock only moves when the mock advances it
+static uint64_t real_nanoseconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+uint64_t selfStatsStart(void) {
+    return (state.self_stats ? real_nanoseconds() : 0);
+}
+
+void selfStatsRecord(int stage, uint64_t start_ns, unsigned long items) {
+    if (!start_ns) {
+        return ;
+    }
+
+    self_stage_t *s = &state.self.stages[stage];
+    uint64_t elapsed = real_nanoseconds() - start_ns;
+
+    s->calls += 1;
+    s->items += items;
+    s->total_ns += elapsed;
+    if (elapsed > s->max_ns) {
+        s->max_ns = elapsed;
+    }
+}
+
+void selfStatsWakeup(int events) {
+    if (!state.self_stats || events == EVENT_ERROR) {
+        return ;
+    }
+
+    int socket = (events & EVENT_SOCKET_READABLE) != 0;
+    int timer = (events & EVENT_TIMER_EXPIRED) != 0;
+
+    if (socket && timer) {
+        state.self.wakeups_both += 1;
+    } else if (socket) {
+        state.self.wakeups_socket += 1;
+    } else if (timer) {
+        state.self.wakeups_timer += 1;
+    } else {
+        state.self.wakeups_none += 1;
+    }
+}
+
+void selfStatsLateness(uint64_t deadline_ns, uint64_t now_ns) {
+    if (!state.self_stats) {
+        return ;
+    }
+
+    uint64_t late = (now_ns > deadline_ns) ? now_ns - deadline_ns : 0;
+
+    state.self.ticks += 1;
+    state.self.lateness_sum += late;
+    state.self.lateness_sum_sq += (double)late * late;
+    if (late > state.self.lateness_max) {
+        state.self.lateness_max = late;
+    }
+}
+
+void mergeSelfStats(self_stats_t *into, const self_stats_t *from) {
+    for (int i = 0; i < SELF_STAGES; i++) {
+        into->stages[i].calls += from->stages[i].calls;
+        into->stages[i].items += from->stages[i].items;
+        into->stages[i].total_ns += from->stages[i].total_ns;
+        if (from->stages[i].max_ns > into->stages[i].max_ns) {
+            into->stages[i].max_ns = from->stages[i].max_ns;
+        }
+    }
+
+    into->wakeups_socket += from->wakeups_socket;
+    into->wakeups_timer += from->wakeups_timer;
+    into->wakeups_both += from->wakeups_both;
+    into->wakeups_none += from->wakeups_none;
+    into->ticks += from->ticks;
+    into->lateness_sum += from->lateness_sum;
+    into->lateness_sum_sq += from->lateness_sum_sq;
+    if (from->lateness_max > into->lateness_max) {
+        into->lateness_max = from->lateness_max;
+    }
+    into->schedule_resets += from->schedule_resets;
+    into->loop_ns += from->loop_ns; // workers: summed over the processes, as the stages are
+}
+
+void printSelfStats(FILE *out) {
+    self_stats_t *self = &state.self;
+    uint64_t instrumented_ns = 0;
+
+    fprintf(out, "--- ft_ping self statistics ---\n");
+    fprintf(out, "%-6s %10s %10s %10s %10s %10s %10s\n", "stage", "calls", "items", "total ms", "avg us", "max us", "ns/item");
+
+    for (int i = 0; i < SELF_STAGES; i++) {
+        self_stage_t *s = &self->stages[i];
+
+        if (s->calls == 0) {
+            continue;
+        }
+        if (i != SELF_STAGE_WAIT && i != SELF_STAGE_SPIN) {
+            instrumented_ns += s->total_ns;
+        }
+
+        fprintf(out, "%-6s %10lu ", stage_names[i], s->calls);
+        if (s->items) {
+            fprintf(out, "%10lu ", s->items);
+        } else {
+            fprintf(out, "%10s ", "-");
+        }
+        fprintf(out, "%10.3f %10.3f %10.3f ", s->total_ns / 1e6, s->total_ns / 1e3 / s->calls, s->max_ns / 1e3);
+        if (s->items) {
+            fprintf(out, "%10.1f\n", (double)s->total_ns / s->items);
+        } else {
+            fprintf(out, "%10s\n", "-");
+        }
+    }
+
+    fprintf(out, "wakeups: %lu socket, %lu timer, %lu both, %lu none\n",
+            self->wakeups_socket, self->wakeups_timer, self->wakeups_both, self->wakeups_none);
+
+    // lateness of the send ticks: the timer's wake up latency, plus whatever the loop was busy with at the time
+    if (self->ticks) {
+        double avg_ns = self->lateness_sum / self->ticks;
+        double variance = self->lateness_sum_sq / self->ticks - avg_ns * avg_ns;
+
+        fprintf(out, "send schedule lateness avg/max/stddev = %.3f/%.3f/%.3f us over %lu ticks, %lu schedule restarts\n",
+                avg_ns / 1e3, self->lateness_max / 1e3, sqrt(fmax(0.0, variance)) / 1e3, self->ticks, self->schedule_resets);
+    }
+
+    fprintf(out, "noise: %lu packets discarded in userspace\n", state.noise_packets);
+
+    // the loop's time minus its sleep (and spin) is what the tool itself cost (stages, output, timers and bookkeeping)
+    if (self->loop_ns) {
+        uint64_t wait_ns = self->stages[SELF_STAGE_WAIT].total_ns + self->stages[SELF_STAGE_SPIN].total_ns;
+        uint64_t busy_ns = (self->loop_ns > wait_ns) ? self->loop_ns - wait_ns : 0;
+
+        fprintf(out, "overhead: %.3f ms busy (%.3f ms in the stages above) and %.3f ms waiting in %.3f ms, %.1f%% busy",
+                busy_ns / 1e6, instrumented_ns / 1e6, wait_ns / 1e6, self->loop_ns / 1e6, busy_ns * 100.0 / self->loop_ns);
+        if (state.num_sent) {
+            fprintf(out, ", %.3f us per probe", busy_ns / 1e3 / state.num_sent);
+        }
+        fprintf(out, "\n");
+    }
+}
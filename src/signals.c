@@ -0,0 +1,119 @@
+// signal handling: async-signal-safe handlers (a flag and an eventfd write), serviced by the main loop (see signals.h)
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "signals.h"
+
+static int wake_fd = -1;
+static atomic_int stop_requested = 0;
+static atomic_int snapshot_requested = 0;
+static int stop_taken = 0;              // main thread: the stop request's token is read already
+
+// (*) the eventfd is a semaphore holding a token per raised flag: a flag going up writes one, taking it reads one,
+// so the fd is readable exactly while a flag waits (a signal coming in while the loop takes the others leaves its own token)
+
+static void raise_flag(atomic_int *flag) {
+    uint64_t one = 1;
+
+    if (atomic_exchange(flag, 1)) {
+        return ; // already waiting to be taken
+    }
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // can't happen (the counter is a handful at most), the flag is seen on the loop's next turn anyway
+    }
+}
+
+static void on_signal(int sig) {
+    int saved_errno = errno;
+
+    raise_flag(sig == SIGINT ? &stop_requested : &snapshot_requested);
+    errno = saved_errno;
+}
+
+static void take_token(void) {
+    uint64_t token;
+
+    if (read(wake_fd, &token, sizeof(token)) < 0) {
+        // EAGAIN: the token wasn't written (see raise_flag)
+    }
+}
+
+int openSignals(int snapshots) {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC | EFD_SEMAPHORE);
+    if (fd < 0) {
+        return (SIGNALS_ERROR);
+    }
+
+    // a worker process opens its own (the parent's one would wake up every process)
+    int inherited = wake_fd;
+    wake_fd = fd;
+    if (inherited >= 0) {
+        close(inherited);
+    }
+    atomic_store(&stop_requested, 0);
+    atomic_store(&snapshot_requested, 0);
+    stop_taken = 0;
+
+    struct sigaction action = {0};
+
+    // system calls in progress go on (stdout writes, waitpid), the event loop's waits return anyway: epoll_wait()
+    // is never restarted and the others watch the eventfd; the handler is reset after the first SIGINT, so that a second
+    // one still kills a run stuck somewhere (a blocked terminal)
+    action.sa_handler = on_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART | SA_RESETHAND;
+    if (sigaction(SIGINT, &action, NULL) < 0) {
+        return (SIGNALS_ERROR);
+    }
+
+    action.sa_handler = snapshots ? on_signal : SIG_IGN;
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGQUIT, &action, NULL) < 0 || sigaction(SIGUSR1, &action, NULL) < 0) {
+        return (SIGNALS_ERROR);
+    }
+    return (SIGNALS_OK);
+}
+
+int signalsFd(void) {
+    return (wake_fd);
+}
+
+int takeSignals(void) {
+    int signals = 0;
+
+    if (wake_fd < 0) {
+        return (0);
+    }
+
+    // the flag goes down before its token is read: a signal in between raises it again with a token of its own
+    if (atomic_load_explicit(&snapshot_requested, memory_order_relaxed) && atomic_exchange(&snapshot_requested, 0)) {
+        take_token();
+        signals |= SIGNAL_SNAPSHOT;
+    }
+
+    // the stop request stays up (its token is read once)
+    if (!stop_taken && atomic_load_explicit(&stop_requested, memory_order_relaxed)) {
+        take_token();
+        stop_taken = 1;
+    }
+    if (stop_taken) {
+        signals |= SIGNAL_STOP;
+    }
+    return (signals);
+}
+
+void closeSignals(void) {
+    if (wake_fd < 0) {
+        return ;
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGUSR1, SIG_DFL);
+    close(wake_fd);
+    wake_fd = -1;
+}
@@ -1,15 +1,27 @@
 // socket creation, send/recv logic
 
+#define _GNU_SOURCE
+
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <netinet/ip_icmp.h>
 #include "ft_ping.h"
+#include "icmp.h"
 #include "macros.h"
 #include "socket.h"
+#include "target.h"
+#include "transport.h"
+#include "uring.h"
 #include "utils.h"
 
 extern ping_state_t state;
@@ -67,53 +79,518 @@ int closePingSocket(int sock_fd) {
     return (SOCKET_OK);
 }
 
-int sendIcmpEchoMessage() { 
-    // static buffer to avoid repeated heap alloc/free (as this function is called repetitively)
-    static uint8_t packet_buffer[PING_MAX_PACKET_SIZE];
+// (*) in-kernel demultiplexing: every raw ICMP socket gets a copy of every ICMP packet, a classic BPF filter
+// drops (before they are queued) the ones that aren't about our identifiers
 
-    // calculating total packet size
-    size_t packet_size = sizeof(icmp_echo_header_t) + state.packet.data_len;
-    
-    if (packet_size > PING_MAX_PACKET_SIZE) {
-        return (SOCKET_ERROR);  // Packet too large
+int attachIcmpFilter(int fd, uint16_t first_identifier, size_t count) {
+    // the packet starts with the IP header; X holds its length, the identifier is compared as (id - first) mod 2^16 < count
+    // (a packet socket gets every IPv4 packet, hence the protocol check: a raw ICMP socket only gets ICMP)
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),                        // [-2] A = IP protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_ICMP, 0, 19),     // [-1] not ICMP -> [19]
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),                       // [0]  X = IP header length
+        BPF_STMT(BPF_LD | BPF_B | BPF_IND, 0),                        // [1]  A = ICMP type
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_ECHOREPLY, 4, 0),    // [2]  echo reply -> [7]
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_DEST_UNREACH, 5, 0), // [3]  error -> [9]
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_TIME_EXCEEDED, 4, 0),// [4]  error -> [9]
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ICMP_REDIRECT, 3, 0),     // [5]  error -> [9]
+        BPF_STMT(BPF_RET | BPF_K, 0),                                 // [6]  any other type: drop
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4),                        // [7]  A = echo reply identifier
+        BPF_STMT(BPF_JMP | BPF_JA, 6),                                // [8]  -> [15]
+        BPF_STMT(BPF_LD | BPF_B | BPF_IND, 8),                        // [9]  A = first byte of the quoted IP header
+        BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0f),                    // [10]
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 2),                       // [11] A = quoted IP header length
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),                       // [12]
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),                              // [13] X = both IP headers lengths
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 12),                       // [14] A = identifier of the quoted echo request
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, first_identifier),        // [15]
+        BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xffff),                  // [16]
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, count, 1, 0),             // [17] not ours -> [19]
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff),                        // [18] ours: keep the whole packet
+        BPF_STMT(BPF_RET | BPF_K, 0),                                 // [19] drop
+    };
+    struct sock_fprog program = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) < 0) {
+        return (SOCKET_ERROR);
     }
-    
-    // copy header to buffer
-    memcpy(packet_buffer, &state.packet.header, sizeof(icmp_echo_header_t));
- 
-    // Copy data to buffer (if any)
-    if (state.packet.data && state.packet.data_len) {
-        memcpy(packet_buffer + sizeof(icmp_echo_header_t), 
-               state.packet.data, state.packet.data_len);
-    }
- 
-    ssize_t ret = sendto(state.sock_fd, packet_buffer, packet_size, 0, (struct sockaddr *)&(state.dest_addr), sizeof(struct sockaddr_in));
- 
-    if (ret < 0) {
+    return (SOCKET_OK);
+}
+
+int readIcmpInMessages(unsigned long *count) {
+    FILE *file = fopen("/proc/net/snmp", "r");
+    char header[1024];
+    char values[1024];
+    int status = SOCKET_ERROR;
+
+    if (!file) {
         return (SOCKET_ERROR);
     }
-    
-    if ((size_t)ret != packet_size) {
-        // partial send
+
+    // "Icmp:" comes as a line of field names followed by a line of values
+    while (fgets(header, sizeof(header), file)) {
+        if (strncmp(header, "Icmp: ", 6) != 0 || !fgets(values, sizeof(values), file)) {
+            continue;
+        }
+
+        char *name_save, *value_save;
+        char *name = strtok_r(header, " \n", &name_save);
+        char *value = strtok_r(values, " \n", &value_save);
+
+        while (name && value) {
+            if (strcmp(name, "InMsgs") == 0) {
+                *count = strtoul(value, NULL, 10);
+                status = SOCKET_OK;
+                break;
+            }
+            name = strtok_r(NULL, " \n", &name_save);
+            value = strtok_r(NULL, " \n", &value_save);
+        }
+        break;
+    }
+
+    fclose(file);
+    return (status);
+}
+
+// (*) kernel timestamps: RX from SO_TIMESTAMPNS control messages, TX from the socket error queue (SO_TIMESTAMPING)
+
+typedef struct tx_stamp {
+    int64_t ns;                 // software transmit timestamp (CLOCK_REALTIME nanoseconds)
+    uint16_t sequence;
+    uint8_t valid;
+} tx_stamp_t;
+
+typedef struct tx_log_entry {
+    uint32_t target_index;
+    uint16_t sequence;
+} tx_log_entry_t;
+
+static tx_stamp_t *tx_stamps = NULL;            // TX_STAMP_WINDOW entries per target (indexed by sequence)
+static tx_log_entry_t tx_log[TX_LOG_SIZE];      // probe sent with kernel key k is tx_log[k % TX_LOG_SIZE]
+static uint32_t tx_key = 0;                     // key of the next sent probe (the kernel counts sent packets from 0, SOF_TIMESTAMPING_OPT_ID)
+
+int enableKernelTimestamps(void) {
+    int enable = 1;
+
+    if (setsockopt(state.sock_fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) < 0) {
+        return (SOCKET_ERROR);
+    }
+
+    // transmit timestamps are best effort: without them the sent time written in the payload is used
+    int flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    tx_stamps = calloc(state.num_targets * TX_STAMP_WINDOW, sizeof(tx_stamp_t));
+    if (!tx_stamps) {
+        return (SOCKET_ERROR);
+    }
+
+    if (setsockopt(state.sock_fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        free(tx_stamps);
+        tx_stamps = NULL;
+    }
+
+    return (SOCKET_OK);
+}
+
+void disableKernelTimestamps(void) {
+    free(tx_stamps);
+    tx_stamps = NULL;
+}
+
+void readRxTimestamp(struct msghdr *msg, struct timespec *rx_time) {
+    rx_time->tv_sec = 0;
+    rx_time->tv_nsec = 0;
+
+    if (msg->msg_controllen == 0) {
+        return ;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(rx_time, CMSG_DATA(cmsg), sizeof(*rx_time));
+            return ;
+        }
+    }
+}
+
+void drainTxTimestamps(void) {
+    if (!tx_stamps) {
+        return ;
+    }
+
+    while (1) {
+        uint8_t control[RECV_CONTROL_SIZE];
+        uint8_t data[1];
+        struct iovec iov = { data, sizeof(data) };
+        struct msghdr msg = {0};
+
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(state.sock_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+
+        struct scm_timestamping stamps;
+        struct sock_extended_err err = {0};
+        int has_stamp = 0;
+        int has_key = 0;
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+                memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+                has_stamp = 1;
+            } else if (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) {
+                memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+                has_key = (err.ee_origin == SO_EE_ORIGIN_TIMESTAMPING);
+            }
+        }
+
+        if (!has_stamp || !has_key) {
+            continue;
+        }
+
+        // the key is ignored when the probe it names has already been overwritten in the log (or isn't known yet)
+        uint32_t age = tx_key - err.ee_data;
+        if (age == 0 || age > TX_LOG_SIZE) {
+            continue;
+        }
+
+        tx_log_entry_t *entry = &tx_log[err.ee_data % TX_LOG_SIZE];
+        tx_stamp_t *stamp = &tx_stamps[entry->target_index * TX_STAMP_WINDOW + entry->sequence % TX_STAMP_WINDOW];
+
+        stamp->ns = (int64_t)stamps.ts[0].tv_sec * 1000000000LL + stamps.ts[0].tv_nsec;
+        stamp->sequence = entry->sequence;
+        stamp->valid = 1;
+    }
+}
+
+int64_t getTxTimestamp(ping_target_t *target, uint16_t sequence) {
+    if (!tx_stamps || !target) {
+        return (0);
+    }
+
+    tx_stamp_t *stamp = &tx_stamps[(target - state.targets) * TX_STAMP_WINDOW + sequence % TX_STAMP_WINDOW];
+    if (!stamp->valid || stamp->sequence != sequence) {
+        return (0);
+    }
+
+    return (stamp->ns);
+}
+
+// (*) batched transmit: probes are queued into preallocated wire buffers and sent with a single sendmmsg()
+
+static uint8_t *batch_buffers = NULL;           // batch_capacity slots of state.packet_size bytes
+static struct mmsghdr *batch_msgs = NULL;
+static struct iovec *batch_iovs = NULL;
+static ping_target_t **batch_targets = NULL;    // target of each queued probe
+static size_t batch_capacity = 0;
+static size_t batch_pending = 0;
+
+int createSendBatch(size_t batch_size) {
+    if (batch_size == 0) {
+        return (SOCKET_ERROR);
+    }
+
+    // slots are kept 8-byte aligned so that the ICMP header of each packet is aligned
+    size_t slot_size = (state.packet_size + 7) & ~(size_t)7;
+
+    batch_buffers = malloc(batch_size * slot_size);
+    batch_msgs = calloc(batch_size, sizeof(struct mmsghdr));
+    batch_iovs = calloc(batch_size, sizeof(struct iovec));
+    batch_targets = calloc(batch_size, sizeof(ping_target_t *));
+
+    if (!batch_buffers || !batch_msgs || !batch_iovs || !batch_targets) {
+        destroySendBatch();
+        return (SOCKET_ERROR);
+    }
+
+    // the message headers never change (only the destination pointer), so they're wired once,
+    // and so does most of each packet: the template is copied once, probes then only rewrite their own words in place
+    for (size_t i = 0; i < batch_size; i++) {
+        batch_iovs[i].iov_base = batch_buffers + i * slot_size;
+        copyIcmpEchoRequestTemplate(batch_iovs[i].iov_base);
+        batch_iovs[i].iov_len = state.packet_size;
+        batch_msgs[i].msg_hdr.msg_iov = &batch_iovs[i];
+        batch_msgs[i].msg_hdr.msg_iovlen = 1;
+        batch_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+
+    batch_capacity = batch_size;
+    batch_pending = 0;
+    return (SOCKET_OK);
+}
+
+void destroySendBatch(void) {
+    free(batch_buffers);
+    free(batch_msgs);
+    free(batch_iovs);
+    free(batch_targets);
+    batch_buffers = NULL;
+    batch_msgs = NULL;
+    batch_iovs = NULL;
+    batch_targets = NULL;
+    batch_capacity = 0;
+    batch_pending = 0;
+}
+
+ssize_t queueIcmpEchoMessage(ping_target_t *target) {
+    if (!target) {
+        debugLogger("queueIcmpEchoMessage: target cannot be NULL");
         return (SOCKET_ERROR);
     }
 
-    // clearing the received flag for the sequence of the packet just sent, marking it as not yet received
-    state.received[state.sequence] = 0;
+    if (batch_pending == batch_capacity) {
+        debugLogger("queueIcmpEchoMessage: send batch is full (or not created)");
+        return (SOCKET_ERROR);
+    }
+
+    batch_msgs[batch_pending].msg_hdr.msg_name = &target->dest_addr;
+    batch_targets[batch_pending] = target;
+
+    // forget the transmit timestamp of the probe that used this window slot before
+    if (tx_stamps) {
+        tx_stamps[(target - state.targets) * TX_STAMP_WINDOW + target->sequence % TX_STAMP_WINDOW].valid = 0;
+    }
+
+    // the sequence is consumed now (a target may have several probes in the same batch),
+    // clearing the received flag of that sequence, marking it as not yet received
+    uint16_t window_index = target->sequence % SEQUENCE_WINDOW;
+    target->received[window_index / 64] &= ~((uint64_t)1 << (window_index % 64));
+    target->unsent[window_index / 64] &= ~((uint64_t)1 << (window_index % 64));
+    target->sequence += 1;
+    target->probes += 1;
+
+    batch_pending += 1;
+    return (batch_pending);
+}
+
+void *nextIcmpEchoSlot(void) {
+    if (batch_pending == batch_capacity) {
+        return (NULL);
+    }
+
+    // io_uring backend: the previous batch may still be on its way out of these buffers
+    if (batch_pending == 0 && uringActive()) {
+        completeUringSends();
+    }
+    return (batch_iovs[batch_pending].iov_base);
+}
+
+size_t pendingIcmpEchoMessages(void) {
+    return (batch_pending);
+}
 
-    // increment sequence and number of sent packets for the next transmission
-    state.sequence += 1;
+// @brief sequence of the probe in the batch slot
+static uint16_t batch_sequence(size_t index) {
+    return (ntohs(((icmp_echo_header_t *)batch_iovs[index].iov_base)->sequence));
+}
+
+// @brief counts the message of the batch slot as sent
+static void account_sent(size_t index) {
+    ping_target_t *target = batch_targets[index];
+
+    target->num_sent += 1;
     state.num_sent += 1;
 
+    // remember which probe the kernel's next transmit timestamp key refers to
+    if (tx_stamps) {
+        tx_log[tx_key % TX_LOG_SIZE].target_index = target - state.targets;
+        tx_log[tx_key % TX_LOG_SIZE].sequence = batch_sequence(index);
+        tx_key += 1;
+    }
+}
+
+// @brief counts the message of the batch slot as not sent: its probe already took its sequence, which is skipped
+static void account_unsent(size_t index) {
+    markProbeUnsent(batch_targets[index], batch_sequence(index));
+}
+
+// @brief sends the batch with sendmmsg() (one syscall per batch, through the transport), counting what went out
+// @return the number of messages sent (a message the kernel refuses is dropped, the ones after it are still sent)
+static size_t send_batch(void) {
+    size_t next = 0;
+    size_t sent = 0;
+
+    while (next < batch_pending) {
+        int ret = getTransport()->send(batch_msgs + next, batch_pending - next);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // sendmmsg() stops at the first message that fails: its probe is lost (its sequence is skipped),
+            // the others may well be for healthy targets
+            account_unsent(next);
+            next += 1;
+            continue;
+        }
+        if (ret == 0) {
+            // nothing went out: the rest of the batch is given up
+            while (next < batch_pending) {
+                account_unsent(next);
+                next += 1;
+            }
+            break;
+        }
+
+        for (int i = 0; i < ret; i++) {
+            if (batch_msgs[next + i].msg_len != state.packet_size) {
+                account_unsent(next + i); // partial send
+                continue;
+            }
+            account_sent(next + i);
+            sent += 1;
+        }
+        next += ret;
+    }
+    return (sent);
+}
+
+ssize_t flushIcmpEchoMessages(void) {
+    size_t sent;
+
+    if (uringActive()) {
+        // io_uring backend: the sends are submitted with the next wait for events, a send that fails is taken back then
+        sent = 0;
+        for (size_t i = 0; i < batch_pending; i++) {
+            if (queueUringSend(&batch_msgs[i].msg_hdr, batch_targets[i], batch_sequence(i)) == URING_ERROR) {
+                account_unsent(i);
+                continue;
+            }
+            account_sent(i);
+            sent += 1;
+        }
+    } else {
+        sent = send_batch();
+    }
+
+    if (sent) {
+        uint64_t now = get_nanoseconds();
+        if (state.first_send_ns == 0) {
+            state.first_send_ns = now;
+        }
+        state.last_send_ns = now;
+    }
+
+    batch_pending = 0;
+    return (sent);
+}
+
+// (*) batched receive: recvmmsg() fills a preallocated ring of slots sized for our replies
+
+static uint8_t *ring_buffers = NULL;
+static uint8_t *ring_controls = NULL;
+static recv_slot_t *ring_slots = NULL;
+static struct mmsghdr *ring_msgs = NULL;
+static struct iovec *ring_iovs = NULL;
+static size_t ring_capacity = 0;
+static size_t ring_slot_size = 0;
+
+int createRecvRing(size_t num_slots) {
+    if (num_slots == 0) {
+        return (SOCKET_ERROR);
+    }
+
+    // big enough for our echo replies (largest IP header + our ICMP message) and for ICMP error messages;
+    // anything bigger is truncated (it can't be a reply of ours)
+    size_t slot_size = MAX_IP_HEADER_SIZE + state.packet_size;
+    if (slot_size < MIN_RECV_SLOT_SIZE) {
+        slot_size = MIN_RECV_SLOT_SIZE;
+    }
+
+    ring_buffers = malloc(num_slots * slot_size);
+    ring_controls = malloc(num_slots * RECV_CONTROL_SIZE);
+    ring_slots = calloc(num_slots, sizeof(recv_slot_t));
+    ring_msgs = calloc(num_slots, sizeof(struct mmsghdr));
+    ring_iovs = calloc(num_slots, sizeof(struct iovec));
+
+    if (!ring_buffers || !ring_controls || !ring_slots || !ring_msgs || !ring_iovs) {
+        destroyRecvRing();
+        return (SOCKET_ERROR);
+    }
+
+    for (size_t i = 0; i < num_slots; i++) {
+        ring_slots[i].data = ring_buffers + i * slot_size;
+        ring_iovs[i].iov_base = ring_slots[i].data;
+        ring_iovs[i].iov_len = slot_size;
+        ring_msgs[i].msg_hdr.msg_iov = &ring_iovs[i];
+        ring_msgs[i].msg_hdr.msg_iovlen = 1;
+        ring_msgs[i].msg_hdr.msg_name = &ring_slots[i].sender_addr;
+        ring_slots[i].control = ring_controls + i * RECV_CONTROL_SIZE;
+        ring_msgs[i].msg_hdr.msg_control = ring_slots[i].control;
+    }
+
+    ring_capacity = num_slots;
+    ring_slot_size = slot_size;
     return (SOCKET_OK);
 }
 
-ssize_t recvMessage(void *buffer, size_t buffer_len, struct sockaddr *sender_addr, socklen_t *sender_addr_len) {
-    ssize_t ret = recvfrom(state.sock_fd, buffer, buffer_len, 0, sender_addr, sender_addr_len);
+void destroyRecvRing(void) {
+    free(ring_buffers);
+    free(ring_controls);
+    free(ring_slots);
+    free(ring_msgs);
+    free(ring_iovs);
+    ring_buffers = NULL;
+    ring_controls = NULL;
+    ring_slots = NULL;
+    ring_msgs = NULL;
+    ring_iovs = NULL;
+    ring_capacity = 0;
+    ring_slot_size = 0;
+}
 
-    if (ret < 0) {
+// @brief a single recvmmsg() call into the ring (through the transport), with the given flags
+static ssize_t recv_batch(recv_slot_t **slots, int flags) {
+    if (!slots || ring_capacity == 0) {
         return (SOCKET_ERROR);
     }
 
+    // msg_namelen and msg_controllen are value-result fields, they must be reset before each call
+    size_t control_len = state.kernel_timestamps ? RECV_CONTROL_SIZE : 0;
+    for (size_t i = 0; i < ring_capacity; i++) {
+        ring_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        ring_msgs[i].msg_hdr.msg_controllen = control_len;
+    }
+
+    int ret = getTransport()->recv(ring_msgs, ring_capacity, flags);
+
+    if (ret <= 0) {
+        return (ret < 0 ? SOCKET_ERROR : 0);
+    }
+
+    for (int i = 0; i < ret; i++) {
+        ring_slots[i].len = ring_msgs[i].msg_len;
+        ring_slots[i].sender_addr_len = ring_msgs[i].msg_hdr.msg_namelen;
+        readRxTimestamp(&ring_msgs[i].msg_hdr, &ring_slots[i].rx_time);
+    }
+
+    *slots = ring_slots;
+    return (ret);
+}
+
+ssize_t recvIcmpMessages(recv_slot_t **slots) {
+    ssize_t ret = recv_batch(slots, MSG_DONTWAIT);
+
+    if (ret > 0) {
+        state.recv_calls += 1;
+        state.recv_packets += ret;
+    }
     return (ret);
 }
+
+ssize_t waitIcmpMessages(recv_slot_t **slots) {
+    // blocks until a packet is in (or the socket's receive timeout expires), then takes whatever else is already waiting
+    return (recv_batch(slots, MSG_WAITFORONE));
+}
+
+size_t recvRingCapacity(void) {
+    return (ring_capacity);
+}
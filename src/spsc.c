@@ -0,0 +1,84 @@
+// lock-free single producer / single consumer ring (see spsc.h)
+
+#include <stdlib.h>
+#include <string.h>
+#include "spsc.h"
+
+int createSpscRing(spsc_ring_t *ring, size_t capacity, size_t record_size) {
+    if (!ring || capacity == 0 || record_size == 0) {
+        return (SPSC_ERROR);
+    }
+
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+
+    ring->records = malloc(rounded * record_size);
+    if (!ring->records) {
+        return (SPSC_ERROR);
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+    ring->mask = rounded - 1;
+    ring->record_size = record_size;
+    return (SPSC_OK);
+}
+
+void destroySpscRing(spsc_ring_t *ring) {
+    if (!ring) {
+        return ;
+    }
+    free(ring->records);
+    ring->records = NULL;
+}
+
+int spscRingPush(spsc_ring_t *ring, const void *record) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - ring->cached_tail > ring->mask) {
+        // looks full: refresh the consumer's position (acquire: its reads of those records are done)
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail > ring->mask) {
+            return (SPSC_FULL);
+        }
+    }
+
+    memcpy(ring->records + (head & ring->mask) * ring->record_size, record, ring->record_size);
+
+    // release: the record is written before the consumer can see the new head
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return (SPSC_OK);
+}
+
+int spscRingPop(spsc_ring_t *ring, void *record) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == ring->cached_head) {
+        // looks empty: refresh the producer's position (acquire: the records up to head are written)
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == ring->cached_head) {
+            return (0);
+        }
+    }
+
+    memcpy(record, ring->records + (tail & ring->mask) * ring->record_size, ring->record_size);
+
+    // release: the record is read before the producer can reuse its slot
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return (1);
+}
+
+size_t spscRingOccupancy(spsc_ring_t *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    return (head - tail);
+}
+
+size_t spscRingCapacity(const spsc_ring_t *ring) {
+    return (ring->mask + 1);
+}
@@ -1,37 +1,187 @@
 #include "statistics.h"
 #include "ft_ping.h"
+#include "macros.h"
+#include "mock.h"
+#include "output.h"
+#include "selfstats.h"
+#include "socket.h"
+#include "target.h"
+#include "packetring.h"
 #include <math.h>
-#include <signal.h>
 #include <stdio.h>
-#include <stdlib.h>
 
 extern ping_state_t state;
 
-void print_statistics(void) {
+// @brief prints the statistics of a target (an interim summary leaves the probes still in flight out of the loss)
+static void print_target_statistics(ping_target_t *target, int interim) {
     unsigned long packet_loss = 0;
+    unsigned long in_flight = interim ? countProbesInFlight(target) : 0;
+    unsigned long settled = (target->num_sent > in_flight) ? target->num_sent - in_flight : 0;
+
+    if (settled > target->num_recv) {
+        packet_loss = ((settled - target->num_recv) * 100) / settled;
+    }
 
-    if (state.num_sent) {
-        packet_loss = ((state.num_sent - state.num_recv) * 100) / state.num_sent;
+    printf("--- %s ping statistics%s ---\n", target->hostname, interim ? " (interim)" : "");
+    printf("%lu packets transmitted, %lu packets received, %lu%% packet loss", target->num_sent, target->num_recv, packet_loss);
+    if (interim) {
+        printf(", %lu in flight", in_flight);
     }
+    printf("\n");
 
-    printf("--- %s ping statistics ---\n", state.hostname);
-    printf("%lu packets transmitted, %lu packets received, %lu%% packet loss\n", state.num_sent, state.num_recv, packet_loss);
+    // replies that arrived after their probe was given up on, or that matched no probe (not counted as received)
+    if (target->num_late || target->num_unknown) {
+        printf("%lu late replies, %lu unmatched replies\n", target->num_late, target->num_unknown);
+    }
+
+    if (target->num_send_errors) {
+        printf("%lu probes not sent (send errors)\n", target->num_send_errors);
+    }
     
     // we calculate and print rtt stats only if we have received packets
-    if (state.num_recv > 0) {
-        double avg_sec = state.rrt_sum / state.num_recv;
-        double variance = (state.rrt_sum_sq / state.num_recv) - (avg_sec * avg_sec);
+    if (target->num_recv > 0) {
+        double avg_sec = target->rrt_sum / target->num_recv;
+        double variance = (target->rrt_sum_sq / target->num_recv) - (avg_sec * avg_sec);
         double variance_clamped = fmax(0.0, variance);
         double stddev_sec = sqrt(variance_clamped);
 
         printf("round-trip min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\n", 
-               state.rrt_min * 1000.0, avg_sec * 1000.0, state.rrt_max * 1000.0, stddev_sec * 1000.0);
+               target->rrt_min * 1000.0, avg_sec * 1000.0, target->rrt_max * 1000.0, stddev_sec * 1000.0);
+    }
+
+    // percentiles (from the histogram: each one is known within ~3%)
+    if (target->histogram && target->histogram->total > 0) {
+        printf("round-trip percentiles ");
+        for (size_t i = 0; i < state.num_percentiles; i++) {
+            printf("%sp%g", i ? "/" : "", state.percentiles[i]);
+        }
+        printf(" = ");
+        for (size_t i = 0; i < state.num_percentiles; i++) {
+            printf("%s%.3f", i ? "/" : "", histogramPercentile(target->histogram, state.percentiles[i]) / 1e6);
+        }
+        printf(" ms\n");
     }
 }
 
-void signal_handler(int sig) {
-    if (sig == SIGINT) {
-        print_statistics();
-        exit(EXIT_SUCCESS);
+void print_statistics(void) {
+    if (state.output_format != OUTPUT_TEXT) {
+        for (size_t i = 0; i < state.num_targets; i++) {
+            outputSummary(&state.targets[i], 0);
+        }
+        // the machine readable output stays as it is on stdout
+        if (state.self_stats) {
+            printSelfStats(stderr);
+        }
+        return ;
+    }
+
+    for (size_t i = 0; i < state.num_targets; i++) {
+        // unknown hosts were never pinged
+        if (state.targets[i].resolution != RESOLUTION_FAILED) {
+            print_target_statistics(&state.targets[i], 0);
+        }
+    }
+
+    // achieved send rate (batched, rate and multi-core modes only, the classic output is left untouched)
+    if ((state.batch > 1 || state.workers > 1 || state.rate > 0) && state.num_sent > 1 && state.last_send_ns > state.first_send_ns) {
+        double elapsed_sec = (state.last_send_ns - state.first_send_ns) / 1e9;
+
+        double achieved = (state.num_sent - 1) / elapsed_sec;
+
+        // low rates (rate mode) get decimals
+        printf("%lu packets sent in %.3f s, %.*f packets/s (", state.num_sent, elapsed_sec, achieved < 10 ? 2 : 0, achieved);
+        if (state.rate > 0) {
+            printf("requested %g, burst %zu, ", state.rate, state.burst);
+        }
+        if (state.workers > 1) {
+            printf("%zu workers, ", state.workers);
+        }
+        printf("batch %zu)\n", state.batch);
+    }
+
+    // pacing precision: how late the sends were relative to their deadlines
+    if (state.rate > 0 && state.pacer_wakeups > 0) {
+        double avg_ns = state.pacer_lateness_sum / state.pacer_wakeups;
+        double variance = state.pacer_lateness_sum_sq / state.pacer_wakeups - avg_ns * avg_ns;
+
+        printf("send lateness avg/max/stddev = %.3f/%.3f/%.3f us over %lu deadlines\n",
+               avg_ns / 1e3, state.pacer_lateness_max / 1e3, sqrt(fmax(0.0, variance)) / 1e3, state.pacer_wakeups);
+    }
+
+    // receive batching efficiency
+    if (state.verbose && state.recv_calls > 0) {
+        printf("%lu packets read in %lu recvmmsg calls, %.2f packets per call\n",
+               state.recv_packets, state.recv_calls, (double)state.recv_packets / state.recv_calls);
+    }
+
+    // io_uring backend: how many operations each io_uring_enter carried
+    if (state.verbose && state.io_uring) {
+        printf("io_uring: %lu sends and %lu receives in %lu io_uring_enter calls, %.2f operations per call, %lu receive re-arms\n",
+               state.uring_sends, state.recv_packets, state.uring_enters,
+               state.uring_enters ? (double)(state.uring_sends + state.recv_packets) / state.uring_enters : 0.0, state.uring_rearms);
+    }
+
+    // packet ring: what the kernel could or couldn't put in it
+    if (state.packet_ring) {
+        collectPacketRingStats();
+        printf("packet ring: %lu packets in %lu blocks, %lu drops, %lu queue freezes\n",
+               state.packet_ring_packets, state.packet_ring_blocks, state.packet_ring_drops, state.packet_ring_freezes);
+    }
+
+    // simulation: what the mock did to the probes, and how much faster than real time the engine went through them
+    if (state.simulate) {
+        mock_stats_t mock;
+
+        getMockStats(&mock);
+        printf("simulation: %lu requests, %lu replies, %lu duplicated, %lu dropped, %lu errors, %.3f s simulated in %.3f s (%.0f probes/s)\n",
+               mock.requests, mock.replies, mock.duplicated, mock.dropped, mock.errors, mock.virtual_ns / 1e9, mock.real_ns / 1e9,
+               mock.real_ns ? mock.requests * 1e9 / mock.real_ns : 0.0);
+    }
+
+    // noise: with a raw socket, every ICMP message of the host that we didn't read was dropped by the filter
+    // (each worker's socket was offered all of them)
+    if (state.verbose && state.socket_type == SOCK_RAW && !state.simulate) {
+        unsigned long icmp_in_now;
+        unsigned long kernel_dropped = 0;
+
+        if (state.icmp_in_start && readIcmpInMessages(&icmp_in_now) == SOCKET_OK) {
+            unsigned long offered = (icmp_in_now - state.icmp_in_start) * state.workers;
+
+            kernel_dropped = (offered > state.recv_packets) ? offered - state.recv_packets : 0;
+        }
+        printf("noise: %lu packets dropped in the kernel (%s), %lu dropped in userspace\n",
+               kernel_dropped, state.icmp_filter ? "BPF filter" : "no filter", state.noise_packets);
+    }
+
+    // receiver thread hand-over: how close the main thread came to falling behind
+    if (state.recv_thread) {
+        printf("receiver ring: max occupancy %zu/%d, average %.2f, %lu overflows\n",
+               state.ring_max_occupancy, RECEIVER_RING_SIZE,
+               state.ring_samples ? (double)state.ring_occupancy_sum / state.ring_samples : 0.0, state.ring_overflows);
+    }
+
+    // the tool's own costs, to tell them apart from the network's
+    if (state.self_stats) {
+        printSelfStats(stdout);
+    }
+}
+
+void print_interim_statistics(void) {
+    if (state.output_format != OUTPUT_TEXT) {
+        for (size_t i = 0; i < state.num_targets; i++) {
+            outputSummary(&state.targets[i], 1);
+        }
+        return ;
+    }
+
+    // flood mode: the dots line is left as it is
+    if (state.quiet == 0 && state.flood == 1) {
+        printf("\n");
+    }
+    for (size_t i = 0; i < state.num_targets; i++) {
+        if (state.targets[i].resolution != RESOLUTION_FAILED) {
+            print_target_statistics(&state.targets[i], 1);
+        }
     }
+    fflush(stdout);
 }
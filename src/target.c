@@ -0,0 +1,308 @@
+// per-target records arena and reply routing
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "ft_ping.h"
+#include "macros.h"
+#include "target.h"
+
+extern ping_state_t state;
+
+// open addressing hash table (linear probing) mapping a destination address to (target index + 1), 0 marks an empty slot;
+// targets given the same address are chained behind the one in the table through same_address (target index + 1, 0 ends the chain)
+static uint32_t *address_table = NULL;
+static size_t address_table_mask = 0;
+static uint32_t *same_address = NULL;
+
+// RTT histograms (one per target, only allocated when they're needed)
+static latency_histogram_t *histograms = NULL;
+
+// probe timeouts (state.timeout_slots per target, only allocated with -W)
+static wheel_timer_t *timeouts = NULL;
+
+// send times (SEQUENCE_WINDOW per target, only allocated with --probe-log)
+static uint64_t *send_times = NULL;
+
+static size_t hash_address(in_addr_t s_addr) {
+    // Knuth's multiplicative hash (addresses are often sequential, this spreads them)
+    return ((uint32_t)s_addr * 2654435761u) & address_table_mask;
+}
+
+// @brief timers per target for -W: one per probe that can be waiting on its timeout at once (a probe per interval over the
+// timeout, plus a tick's worth of back to back probes), at most one per sequence window slot; a probe that finds its
+// timer still taken (the sends came faster than planned) gives the older probe up early
+static size_t count_timeout_slots(size_t num_targets) {
+    double interval = state.flood ? 0.01 : state.wait;
+    double back_to_back = (double)state.batch / num_targets;
+
+    if (state.rate > 0) {
+        interval = num_targets / state.rate;
+        back_to_back = (double)state.burst / num_targets;
+    }
+
+    double waiting = state.probe_timeout / interval + back_to_back + 1;
+    size_t slots = MIN_TIMEOUT_SLOTS;
+
+    while (slots < waiting && slots < SEQUENCE_WINDOW) {
+        slots <<= 1;
+    }
+    return (slots);
+}
+
+int createTargets(size_t num_targets) {
+    if (num_targets == 0) {
+        return (TARGET_ERROR);
+    }
+
+    state.targets = calloc(num_targets, sizeof(ping_target_t));
+    if (!state.targets) {
+        return (TARGET_ERROR);
+    }
+
+    // table is at least twice as big as the number of targets (keeps probe sequences short)
+    size_t table_size = 16;
+    while (table_size < num_targets * 2) {
+        table_size <<= 1;
+    }
+
+    address_table = calloc(table_size, sizeof(uint32_t));
+    same_address = calloc(num_targets, sizeof(uint32_t));
+    if (!address_table || !same_address) {
+        free(same_address);
+        free(address_table);
+        free(state.targets);
+        same_address = NULL;
+        address_table = NULL;
+        state.targets = NULL;
+        return (TARGET_ERROR);
+    }
+    address_table_mask = table_size - 1;
+
+    if (state.num_percentiles > 0) {
+        histograms = calloc(num_targets, sizeof(latency_histogram_t));
+        if (!histograms) {
+            free(same_address);
+            free(address_table);
+            free(state.targets);
+            same_address = NULL;
+            address_table = NULL;
+            state.targets = NULL;
+            return (TARGET_ERROR);
+        }
+    }
+
+    if (state.probe_timeout > 0) {
+        state.timeout_slots = count_timeout_slots(num_targets);
+        timeouts = calloc(num_targets * state.timeout_slots, sizeof(wheel_timer_t));
+        if (!timeouts) {
+            free(histograms);
+            free(same_address);
+            free(address_table);
+            free(state.targets);
+            histograms = NULL;
+            same_address = NULL;
+            address_table = NULL;
+            state.targets = NULL;
+            return (TARGET_ERROR);
+        }
+    }
+
+    if (state.probe_log) {
+        send_times = calloc(num_targets * SEQUENCE_WINDOW, sizeof(uint64_t));
+        if (!send_times) {
+            free(timeouts);
+            free(histograms);
+            free(same_address);
+            free(address_table);
+            free(state.targets);
+            timeouts = NULL;
+            histograms = NULL;
+            same_address = NULL;
+            address_table = NULL;
+            state.targets = NULL;
+            return (TARGET_ERROR);
+        }
+    }
+
+    for (size_t i = 0; i < num_targets; i++) {
+        state.targets[i].identifier = (state.identifier + i) & 0xFFFF;
+        state.targets[i].rrt_min = DBL_MAX;
+        state.targets[i].histogram = histograms ? &histograms[i] : NULL;
+        state.targets[i].timeouts = timeouts ? &timeouts[i * state.timeout_slots] : NULL;
+        state.targets[i].send_times = send_times ? &send_times[i * SEQUENCE_WINDOW] : NULL;
+    }
+    state.num_targets = num_targets;
+
+    return (TARGET_OK);
+}
+
+void registerTargetAddress(size_t index) {
+    in_addr_t s_addr = state.targets[index].dest_addr.sin_addr.s_addr;
+    size_t slot = hash_address(s_addr);
+
+    while (address_table[slot] != 0) {
+        // same address given twice: replies are routed to the first one, the others wait in its chain
+        if (state.targets[address_table[slot] - 1].dest_addr.sin_addr.s_addr == s_addr) {
+            size_t first = address_table[slot] - 1;
+
+            same_address[index] = same_address[first];
+            same_address[first] = index + 1;
+            return ;
+        }
+        slot = (slot + 1) & address_table_mask;
+    }
+    address_table[slot] = index + 1;
+    same_address[index] = 0;
+}
+
+void unregisterTargetAddress(size_t index) {
+    in_addr_t s_addr = state.targets[index].dest_addr.sin_addr.s_addr;
+    size_t slot = hash_address(s_addr);
+
+    while (address_table[slot] != 0 && state.targets[address_table[slot] - 1].dest_addr.sin_addr.s_addr != s_addr) {
+        slot = (slot + 1) & address_table_mask;
+    }
+    if (address_table[slot] == 0) {
+        return ; // not registered
+    }
+
+    // a target further down the chain just leaves it
+    if (address_table[slot] != index + 1) {
+        size_t previous = address_table[slot] - 1;
+
+        while (same_address[previous] != 0 && same_address[previous] != index + 1) {
+            previous = same_address[previous] - 1;
+        }
+        if (same_address[previous] == index + 1) {
+            same_address[previous] = same_address[index];
+            same_address[index] = 0;
+        }
+        return ;
+    }
+
+    // the first one hands the route over to the next target with the same address
+    if (same_address[index] != 0) {
+        address_table[slot] = same_address[index];
+        same_address[index] = 0;
+        return ;
+    }
+
+    // backward shift deletion: the entries after the hole that could live in it move up, so that no probe sequence breaks
+    size_t hole = slot;
+    address_table[hole] = 0;
+
+    for (slot = (hole + 1) & address_table_mask; address_table[slot] != 0; slot = (slot + 1) & address_table_mask) {
+        size_t home = hash_address(state.targets[address_table[slot] - 1].dest_addr.sin_addr.s_addr);
+
+        // the entry may move to the hole if its home slot isn't between the hole and its slot (cyclically)
+        if (((slot - home) & address_table_mask) >= ((slot - hole) & address_table_mask)) {
+            address_table[hole] = address_table[slot];
+            address_table[slot] = 0;
+            hole = slot;
+        }
+    }
+}
+
+wheel_timer_t *probeTimer(ping_target_t *target, uint64_t index) {
+    if (!target->timeouts) {
+        return (NULL);
+    }
+    return (&target->timeouts[index & (state.timeout_slots - 1)]);
+}
+
+int probeTimeoutPending(ping_target_t *target, uint64_t index) {
+    wheel_timer_t *timer = probeTimer(target, index);
+
+    return (timer && timer->id == index && wheelTimerPending(timer));
+}
+
+void markProbeUnsent(ping_target_t *target, uint16_t sequence) {
+    uint16_t window_index = sequence % SEQUENCE_WINDOW;
+
+    target->num_send_errors += 1;
+    target->unsent[window_index / 64] |= (uint64_t)1 << (window_index % 64);
+}
+
+int probeUnsent(ping_target_t *target, uint64_t index) {
+    uint16_t window_index = index % SEQUENCE_WINDOW;
+
+    return ((target->unsent[window_index / 64] >> (window_index % 64)) & 1);
+}
+
+size_t countProbesInFlight(ping_target_t *target) {
+    uint64_t tracked = (target->probes < SEQUENCE_WINDOW) ? target->probes : SEQUENCE_WINDOW;
+    size_t in_flight = 0;
+
+    for (uint64_t k = 1; k <= tracked; k++) {
+        uint64_t index = target->probes - k;
+        uint16_t window_index = index % SEQUENCE_WINDOW;
+
+        // answered, never sent, or its timeout (-W) expired: not waited for anymore
+        if (((target->received[window_index / 64] | target->unsent[window_index / 64]) >> (window_index % 64)) & 1) {
+            continue;
+        }
+        if (target->timeouts && !probeTimeoutPending(target, index)) {
+            continue;
+        }
+        in_flight += 1;
+    }
+    return (in_flight);
+}
+
+uint64_t probeSendTime(ping_target_t *target, uint16_t sequence) {
+    if (!target->send_times) {
+        return (0);
+    }
+    return (target->send_times[sequence % SEQUENCE_WINDOW]);
+}
+
+void destroyTargets(void) {
+    free(send_times);
+    free(timeouts);
+    free(histograms);
+    free(same_address);
+    free(address_table);
+    free(state.targets);
+    send_times = NULL;
+    timeouts = NULL;
+    histograms = NULL;
+    same_address = NULL;
+    address_table = NULL;
+    state.targets = NULL;
+    state.num_targets = 0;
+}
+
+ping_target_t *findTargetByAddress(in_addr_t s_addr) {
+    if (!address_table) {
+        return (NULL);
+    }
+
+    size_t slot = hash_address(s_addr);
+
+    while (address_table[slot] != 0) {
+        ping_target_t *target = &state.targets[address_table[slot] - 1];
+        if (target->dest_addr.sin_addr.s_addr == s_addr) {
+            return (target);
+        }
+        slot = (slot + 1) & address_table_mask;
+    }
+
+    return (NULL);
+}
+
+ping_target_t *findTarget(uint16_t identifier, in_addr_t s_addr) {
+    if (state.useless_identifier) {
+        return (findTargetByAddress(s_addr));
+    }
+
+    // identifiers are allocated consecutively (modulo 2^16) starting from state.identifier, at most one per target
+    // (MAX_TARGETS): the identifier names the target, the address must still be the target's (another pinger may use
+    // a nearby identifier, a host may spoof one)
+    size_t index = (uint16_t)(identifier - state.identifier);
+    if (index >= state.num_targets || state.targets[index].dest_addr.sin_addr.s_addr != s_addr) {
+        return (NULL);
+    }
+
+    return (&state.targets[index]);
+}
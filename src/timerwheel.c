@@ -0,0 +1,142 @@
+// hashed timer wheel (see timerwheel.h)
+
+#include <stdlib.h>
+#include <string.h>
+#include "macros.h"
+#include "timerwheel.h"
+
+#define WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static wheel_timer_t *slots[TIMER_WHEEL_SLOTS];
+static uint64_t occupied[TIMER_WHEEL_SLOTS / 64];   // bit set while the slot's list isn't empty
+static uint64_t tick_ns = TIMER_WHEEL_MIN_TICK_NS;
+static uint64_t current_tick = 0;                   // next tick to be processed
+static size_t pending = 0;
+
+int initTimerWheel(uint64_t now_ns, uint64_t timeout_ns) {
+    memset(slots, 0, sizeof(slots));
+    memset(occupied, 0, sizeof(occupied));
+    pending = 0;
+
+    // a timer is due within one turn: every timer is looked at once, when it expires
+    tick_ns = timeout_ns / TIMER_WHEEL_SLOTS + 1;
+    if (tick_ns < TIMER_WHEEL_MIN_TICK_NS) {
+        tick_ns = TIMER_WHEEL_MIN_TICK_NS;
+    }
+    current_tick = now_ns / tick_ns;
+    return (WHEEL_OK);
+}
+
+static void unlink_timer(wheel_timer_t *timer) {
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    *timer->pprev = timer->next;
+    timer->pprev = NULL;
+    pending -= 1;
+}
+
+void addWheelTimer(wheel_timer_t *timer, uint64_t expires_ns) {
+    if (timer->pprev) {
+        unlink_timer(timer);
+    }
+
+    timer->expires_tick = (expires_ns + tick_ns - 1) / tick_ns;
+    if (timer->expires_tick < current_tick) {
+        timer->expires_tick = current_tick; // already due: expires on the next turn of the wheel
+    }
+
+    size_t slot = timer->expires_tick & WHEEL_MASK;
+
+    timer->next = slots[slot];
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = &slots[slot];
+    slots[slot] = timer;
+    occupied[slot / 64] |= (uint64_t)1 << (slot % 64);
+    pending += 1;
+}
+
+void cancelWheelTimer(wheel_timer_t *timer) {
+    if (timer->pprev) {
+        unlink_timer(timer);
+    }
+}
+
+int wheelTimerPending(const wheel_timer_t *timer) {
+    return (timer->pprev != NULL);
+}
+
+// @brief expires the timers of a slot that are due by now_tick (the others are due on a later turn)
+static size_t expire_slot(size_t slot, uint64_t now_tick, void (*expire)(wheel_timer_t *timer)) {
+    size_t expired = 0;
+    wheel_timer_t *timer = slots[slot];
+
+    while (timer) {
+        wheel_timer_t *next = timer->next;
+
+        if (timer->expires_tick <= now_tick) {
+            unlink_timer(timer);
+            expire(timer);
+            expired += 1;
+        }
+        timer = next;
+    }
+
+    if (!slots[slot]) {
+        occupied[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    }
+    return (expired);
+}
+
+size_t expireWheelTimers(uint64_t now_ns, void (*expire)(wheel_timer_t *timer)) {
+    uint64_t now_tick = now_ns / tick_ns;
+    size_t expired = 0;
+
+    if (now_tick < current_tick) {
+        return (0);
+    }
+
+    // more than a turn behind: every slot is looked at once
+    uint64_t ticks = now_tick - current_tick + 1;
+    if (ticks > TIMER_WHEEL_SLOTS) {
+        ticks = TIMER_WHEEL_SLOTS;
+    }
+
+    for (uint64_t t = 0; t < ticks && pending; t++) {
+        size_t slot = (current_tick + t) & WHEEL_MASK;
+
+        if (occupied[slot / 64] & ((uint64_t)1 << (slot % 64))) {
+            expired += expire_slot(slot, now_tick, expire);
+        }
+    }
+
+    current_tick = now_tick + 1;
+    return (expired);
+}
+
+uint64_t nextWheelExpiry(void) {
+    if (pending == 0) {
+        return (0);
+    }
+
+    // first occupied slot from the current tick on (going round once), a word of the bitmap at a time
+    size_t start = current_tick & WHEEL_MASK;
+
+    for (size_t scanned = 0; scanned < TIMER_WHEEL_SLOTS + 64; ) {
+        size_t slot = (start + scanned) & WHEEL_MASK;
+        uint64_t word = occupied[slot / 64] >> (slot % 64);
+
+        if (word) {
+            size_t distance = scanned + __builtin_ctzll(word);
+            return ((current_tick + distance) * tick_ns);
+        }
+        scanned += 64 - (slot % 64);
+    }
+    return (0);
+}
+
+size_t pendingWheelTimers(void) {
+    return (pending);
+}
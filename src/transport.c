@@ -0,0 +1,34 @@
+// transport: the kernel's (sendmmsg/recvmmsg on the ping socket) unless another one is set (see transport.h)
+
+#define _GNU_SOURCE
+
+#include <sys/socket.h>
+#include "ft_ping.h"
+#include "transport.h"
+
+extern ping_state_t state;
+
+static int kernel_send(struct mmsghdr *msgs, unsigned int count) {
+    return (sendmmsg(state.sock_fd, msgs, count, 0));
+}
+
+static int kernel_recv(struct mmsghdr *msgs, unsigned int count, int flags) {
+    return (recvmmsg(state.sock_fd, msgs, count, flags, NULL));
+}
+
+static const ping_transport_t kernel_transport = {
+    .name = "kernel",
+    .send = kernel_send,
+    .recv = kernel_recv,
+    .wait = NULL,
+};
+
+static const ping_transport_t *transport = &kernel_transport;
+
+const ping_transport_t *getTransport(void) {
+    return (transport);
+}
+
+void setTransport(const ping_transport_t *new_transport) {
+    transport = new_transport ? new_transport : &kernel_transport;
+}
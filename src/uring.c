@@ -0,0 +1,518 @@
+// io_uring I/O backend: multishot receive with provided buffers, sends as submissions, one io_uring_enter per tick (see uring.h)
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "event.h"
+#include "ft_ping.h"
+#include "icmp.h" // before macros.h (its PARSE_* macros would clash with the parse_status_t enum)
+#include "macros.h"
+#include "signals.h"
+#include "socket.h"
+#include "target.h"
+#include "uring.h"
+#include "utils.h"
+
+extern ping_state_t state;
+
+#define URING_RECV_TAG 0 // user_data of the receive's completions
+#define URING_SIGNAL_TAG 1 // user_data of the signals' wake up fd poll
+#define URING_SEND_TAG 2 // user_data of a send: URING_SEND_TAG + (target index << 16 | sequence of its probe)
+
+static int ring_fd = -1;
+
+// submission queue: the kernel's ring of indexes and the entries themselves
+static uint8_t *sq_ring = NULL;
+static size_t sq_ring_size = 0;
+static unsigned *sq_head = NULL;
+static unsigned *sq_tail = NULL;
+static unsigned *sq_array = NULL;
+static unsigned sq_mask = 0;
+static unsigned sq_entries = 0;
+static struct io_uring_sqe *sqes = NULL;
+static size_t sqes_size = 0;
+static unsigned sq_local_tail = 0;      // entries filled (published to the kernel with the tail when submitting)
+static unsigned to_submit = 0;
+
+// completion queue (shares its mapping with the submission queue when the kernel supports it)
+static uint8_t *cq_ring = NULL;
+static size_t cq_ring_size = 0;
+static unsigned *cq_head = NULL;
+static unsigned *cq_tail = NULL;
+static unsigned cq_mask = 0;
+static struct io_uring_cqe *cqes = NULL;
+
+// provided receive buffers: the kernel picks one per received packet, it's given back once the packet is parsed
+static struct io_uring_buf_ring *buf_ring = NULL;
+static size_t buf_ring_size = 0;
+static uint8_t *buffers = NULL;
+static size_t buffers_size = 0;
+static size_t buffer_size = 0;
+static unsigned num_buffers = 0;
+static uint16_t buf_tail = 0;
+
+static struct msghdr recv_msg;          // layout of the receive's buffers: name and control areas, then the payload
+static int recv_posted = 0;
+static int signal_poll_posted = 0;
+static size_t sends_in_flight = 0;
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sys_io_uring_enter(unsigned submit, unsigned min_complete, unsigned flags, void *arg, size_t arg_size) {
+    return (syscall(__NR_io_uring_enter, ring_fd, submit, min_complete, flags, arg, arg_size));
+}
+
+static int sys_io_uring_register(unsigned opcode, void *arg, unsigned num_args) {
+    return (syscall(__NR_io_uring_register, ring_fd, opcode, arg, num_args));
+}
+
+// @brief maps the submission and completion queues of the new ring
+static int map_rings(struct io_uring_params *params) {
+    sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size = (cq_ring_size > sq_ring_size) ? cq_ring_size : sq_ring_size;
+    }
+
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = NULL;
+        return (URING_ERROR);
+    }
+
+    if (params->features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring = sq_ring;
+        cq_ring_size = 0;
+    } else {
+        cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = NULL;
+            return (URING_ERROR);
+        }
+    }
+
+    sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        sqes = NULL;
+        return (URING_ERROR);
+    }
+
+    sq_head = (unsigned *)(sq_ring + params->sq_off.head);
+    sq_tail = (unsigned *)(sq_ring + params->sq_off.tail);
+    sq_array = (unsigned *)(sq_ring + params->sq_off.array);
+    sq_mask = *(unsigned *)(sq_ring + params->sq_off.ring_mask);
+    sq_entries = params->sq_entries;
+    sq_local_tail = *sq_tail;
+
+    cq_head = (unsigned *)(cq_ring + params->cq_off.head);
+    cq_tail = (unsigned *)(cq_ring + params->cq_off.tail);
+    cq_mask = *(unsigned *)(cq_ring + params->cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq_ring + params->cq_off.cqes);
+    return (URING_OK);
+}
+
+// @brief hands a receive buffer (back) to the kernel (visible to it once the buffer ring's tail is published)
+static void provide_buffer(unsigned short buffer_id) {
+    struct io_uring_buf *buf = &buf_ring->bufs[buf_tail & (num_buffers - 1)];
+
+    buf->addr = (uintptr_t)(buffers + (size_t)buffer_id * buffer_size);
+    buf->len = buffer_size;
+    buf->bid = buffer_id;
+    buf_tail += 1;
+}
+
+static void publish_buffers(void) {
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+// @brief allocates the receive buffers and registers their ring (buffer group URING_BUFFER_GROUP)
+static int register_buffers(void) {
+    // each buffer holds the recvmsg header, the sender's address, the ancillary data (kernel timestamps) and a packet
+    // as big as the receive ring's slots
+    size_t packet_size = MAX_IP_HEADER_SIZE + state.packet_size;
+    if (packet_size < MIN_RECV_SLOT_SIZE) {
+        packet_size = MIN_RECV_SLOT_SIZE;
+    }
+
+    memset(&recv_msg, 0, sizeof(recv_msg));
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    recv_msg.msg_controllen = state.kernel_timestamps ? RECV_CONTROL_SIZE : 0;
+    buffer_size = sizeof(struct io_uring_recvmsg_out) + recv_msg.msg_namelen + recv_msg.msg_controllen + packet_size;
+
+    // as many buffers as fit in URING_BUFFERS_MAX_BYTES, a power of two (the buffer ring's size)
+    num_buffers = URING_BUFFERS;
+    while (num_buffers > 1 && (size_t)num_buffers * buffer_size > URING_BUFFERS_MAX_BYTES) {
+        num_buffers /= 2;
+    }
+
+    buffers_size = (size_t)num_buffers * buffer_size;
+    buffers = mmap(NULL, buffers_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buf_ring_size = (size_t)num_buffers * sizeof(struct io_uring_buf);
+    buf_ring = mmap(NULL, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED || buf_ring == MAP_FAILED) {
+        buffers = (buffers == MAP_FAILED) ? NULL : buffers;
+        buf_ring = (buf_ring == MAP_FAILED) ? NULL : buf_ring;
+        return (URING_ERROR);
+    }
+
+    struct io_uring_buf_reg reg = {
+        .ring_addr = (uintptr_t)buf_ring,
+        .ring_entries = num_buffers,
+        .bgid = URING_BUFFER_GROUP,
+    };
+
+    if (sys_io_uring_register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return (URING_ERROR);
+    }
+
+    buf_tail = 0;
+    for (unsigned i = 0; i < num_buffers; i++) {
+        provide_buffer(i);
+    }
+    publish_buffers();
+    return (URING_OK);
+}
+
+// @brief submits the queued entries (and waits for min_complete completions, until the timeout if one is given)
+static int enter(unsigned min_complete, struct __kernel_timespec *timeout) {
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    struct io_uring_getevents_arg arg = {0};
+
+    if (timeout) {
+        arg.ts = (uintptr_t)timeout;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    int ret = sys_io_uring_enter(to_submit, min_complete, flags, timeout ? &arg : NULL, timeout ? sizeof(arg) : 0);
+
+    state.uring_enters += 1;
+    if (ret >= 0) {
+        to_submit -= ((unsigned)ret < to_submit) ? (unsigned)ret : to_submit;
+    }
+    return (ret);
+}
+
+// @brief returns the next free submission entry, submitting the queue first if it's full
+static struct io_uring_sqe *get_sqe(void) {
+    while (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        if (enter(0, NULL) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return (NULL);
+        }
+    }
+
+    unsigned index = sq_local_tail & sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    sq_local_tail += 1;
+    to_submit += 1;
+    return (sqe);
+}
+
+// @brief queues the multishot receive: it stays posted, a completion per packet, until it runs out of buffers
+static void post_receive(void) {
+    struct io_uring_sqe *sqe = get_sqe();
+
+    if (!sqe) {
+        return ;
+    }
+
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = state.sock_fd;
+    sqe->addr = (uintptr_t)&recv_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_RECV_TAG;
+    recv_posted = 1;
+}
+
+// @brief queues a poll of the signals' wake up fd: its completion ends the wait of a signal (see signals.h)
+static void post_signal_poll(void) {
+    struct io_uring_sqe *sqe = (signalsFd() >= 0) ? get_sqe() : NULL;
+
+    if (!sqe) {
+        return ;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = signalsFd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = URING_SIGNAL_TAG;
+    signal_poll_posted = 1;
+}
+
+int openUring(void) {
+    struct io_uring_params params = {0};
+
+    // a burst of replies between two ticks shouldn't overflow the completion queue
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_CQ_ENTRIES;
+
+    ring_fd = sys_io_uring_setup(URING_SQ_ENTRIES, &params);
+    if (ring_fd < 0) {
+        ring_fd = -1;
+        return (URING_ERROR);
+    }
+
+    // waiting with a timeout (EXT_ARG) and never losing a completion (NODROP) are needed, the multishot receive
+    // and the buffer ring come with recent kernels (6.0) and fail to register or prepare otherwise
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        closeUring();
+        errno = ENOTSUP;
+        return (URING_ERROR);
+    }
+
+    if (map_rings(&params) == URING_ERROR || register_buffers() == URING_ERROR) {
+        int saved_errno = errno;
+        closeUring();
+        errno = saved_errno;
+        return (URING_ERROR);
+    }
+
+    // a kernel without multishot receive tells right away: the receive completes with EINVAL
+    post_receive();
+    post_signal_poll();
+    if (enter(0, NULL) < 0) {
+        int saved_errno = errno;
+        closeUring();
+        errno = saved_errno;
+        return (URING_ERROR);
+    }
+
+    unsigned head = *cq_head;
+
+    if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) && cqes[head & cq_mask].res == -EINVAL) {
+        closeUring();
+        errno = EINVAL;
+        return (URING_ERROR);
+    }
+    return (URING_OK);
+}
+
+int uringActive(void) {
+    return (ring_fd >= 0);
+}
+
+int queueUringSend(struct msghdr *msg, ping_target_t *target, uint16_t sequence) {
+    struct io_uring_sqe *sqe = get_sqe();
+
+    if (!sqe) {
+        return (URING_ERROR);
+    }
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = state.sock_fd;
+    sqe->addr = (uintptr_t)msg;
+    sqe->len = 1;
+    sqe->user_data = URING_SEND_TAG + ((uint64_t)(target - state.targets) << 16 | sequence);
+
+    sends_in_flight += 1;
+    state.uring_sends += 1;
+    return (URING_OK);
+}
+
+// @brief parses the packet of a receive completion
+static void handle_packet(struct io_uring_cqe *cqe, uint8_t *buffer) {
+    struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buffer;
+    size_t header_size = sizeof(*out) + recv_msg.msg_namelen + recv_msg.msg_controllen;
+
+    if ((size_t)cqe->res < header_size) {
+        return ;
+    }
+
+    struct sockaddr_in sender_addr = {0};
+    socklen_t sender_addr_len = (out->namelen < sizeof(sender_addr)) ? out->namelen : sizeof(sender_addr);
+    memcpy(&sender_addr, buffer + sizeof(*out), sender_addr_len);
+
+    // the ancillary data is where a recvmsg() would have put it: the socket layer's helpers read it as usual
+    struct timespec rx_time = {0};
+    if (recv_msg.msg_controllen) {
+        struct msghdr msg = {
+            .msg_control = buffer + sizeof(*out) + recv_msg.msg_namelen,
+            .msg_controllen = (out->controllen < recv_msg.msg_controllen) ? out->controllen : recv_msg.msg_controllen,
+        };
+        readRxTimestamp(&msg, &rx_time);
+    }
+
+    // a truncated packet (MSG_TRUNC) reports its full size, only what fits in the buffer is there
+    size_t packet_len = cqe->res - header_size;
+    if (out->payloadlen < packet_len) {
+        packet_len = out->payloadlen;
+    }
+
+    state.recv_packets += 1;
+    parseIcmpMessageAndLogResult(buffer + header_size, packet_len, (struct sockaddr *)&sender_addr, &sender_addr_len, &rx_time);
+}
+
+// @brief handles the completions waiting in the queue
+// @return the number of completions handled
+static size_t reap_completions(void) {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    size_t reaped = 0;
+    int returned_buffers = 0;
+
+    for (; head != tail; head++, reaped++) {
+        struct io_uring_cqe *cqe = &cqes[head & cq_mask];
+
+        // the signal is taken by the loop, the poll is queued again below
+        if (cqe->user_data == URING_SIGNAL_TAG) {
+            signal_poll_posted = 0;
+            continue;
+        }
+
+        if (cqe->user_data != URING_RECV_TAG) {
+            // a send: counted as sent when queued, taken back (as a send error) if it failed
+            sends_in_flight -= 1;
+            if (cqe->res < 0) {
+                uint64_t send = cqe->user_data - URING_SEND_TAG;
+                ping_target_t *target = &state.targets[send >> 16];
+
+                target->num_sent -= 1;
+                state.num_sent -= 1;
+                markProbeUnsent(target, (uint16_t)send);
+                infoLogger("Error while sending ICMP echo request");
+            }
+            continue;
+        }
+
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            unsigned short buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+            if (cqe->res > 0) {
+                handle_packet(cqe, buffers + (size_t)buffer_id * buffer_size);
+            }
+            provide_buffer(buffer_id);
+            returned_buffers = 1;
+        }
+
+        // the receive stopped (out of buffers: ENOBUFS, or an error), it's posted again below
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            recv_posted = 0;
+            state.uring_rearms += 1;
+        }
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    if (returned_buffers) {
+        publish_buffers();
+    }
+    if (!recv_posted) {
+        post_receive();
+    }
+    if (!signal_poll_posted) {
+        post_signal_poll();
+    }
+    return (reaped);
+}
+
+void completeUringSends(void) {
+    while (1) {
+        // transmit timestamps first, so that replies find the kernel send time of their probe
+        if (state.kernel_timestamps) {
+            drainTxTimestamps();
+        }
+        reap_completions();
+
+        if (sends_in_flight == 0) {
+            break;
+        }
+        if (enter(1, NULL) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            break;
+        }
+    }
+}
+
+int waitUringEvents(uint64_t deadline_ns) {
+    uint64_t now = get_nanoseconds();
+    int ready = (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE));
+
+    if (ready || now >= deadline_ns) {
+        // nothing to wait for: only the queued entries go in
+        if (to_submit && enter(0, NULL) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return (URING_ERROR);
+        }
+    } else {
+        struct __kernel_timespec timeout = {
+            .tv_sec = (deadline_ns - now) / 1000000000ULL,
+            .tv_nsec = (deadline_ns - now) % 1000000000ULL,
+        };
+
+        if (enter(1, &timeout) < 0) {
+            if (errno == EINTR) {
+                return (0);
+            }
+            if (errno != ETIME && errno != EAGAIN && errno != EBUSY) {
+                return (URING_ERROR);
+            }
+        }
+    }
+
+    int events = 0;
+
+    if (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        events |= EVENT_SOCKET_READABLE;
+    }
+    if (get_nanoseconds() >= deadline_ns) {
+        events |= EVENT_TIMER_EXPIRED;
+    }
+    return (events);
+}
+
+void drainUring(void) {
+    if (ring_fd < 0) {
+        return ;
+    }
+
+    // transmit timestamps first, so that replies find the kernel send time of their probe
+    if (state.kernel_timestamps) {
+        drainTxTimestamps();
+    }
+    reap_completions();
+}
+
+void closeUring(void) {
+    if (ring_fd >= 0) {
+        close(ring_fd);
+    }
+    if (sqes) {
+        munmap(sqes, sqes_size);
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    if (buf_ring) {
+        munmap(buf_ring, buf_ring_size);
+    }
+    if (buffers) {
+        munmap(buffers, buffers_size);
+    }
+
+    ring_fd = -1;
+    sqes = NULL;
+    sq_ring = NULL;
+    cq_ring = NULL;
+    buf_ring = NULL;
+    buffers = NULL;
+    recv_posted = 0;
+    signal_poll_posted = 0;
+    sends_in_flight = 0;
+    to_submit = 0;
+}
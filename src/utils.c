@@ -9,6 +9,8 @@
 
 extern ping_state_t state;
 
+static const ping_clock_t *clock_source = NULL; // NULL: the system clocks
+
 // @brief function copies up to dstsize - 1 characters 
 // from the NUL-terminated string src to dest, NUL-terminating the result
 static size_t	ft_strlcpy(char *dest, const char *src, size_t dstsize)
@@ -90,10 +92,48 @@ char	*ft_strjoin(char const *s1, char const *s2) {
 	return (join);
 }
 
-// (*) get_milliseconds
+// (*) get_nanoseconds
+
+uint64_t get_nanoseconds() {
+    if (clock_source) {
+        return (clock_source->monotonic_ns());
+    }
 
-uint32_t get_milliseconds() {
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (ts.tv_sec * 1000 + ts.tv_nsec / 1000000) & 0xFFFFFFFF;
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+// (*) get_realtime_nanoseconds
+
+int64_t get_realtime_nanoseconds() {
+    if (clock_source) {
+        return (clock_source->realtime_ns());
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+// (*) wait_until_nanoseconds
+
+uint64_t wait_until_nanoseconds(uint64_t deadline_ns) {
+    uint64_t now = get_nanoseconds();
+
+    if (now < deadline_ns && clock_source && clock_source->advance) {
+        clock_source->advance(deadline_ns);
+        return (get_nanoseconds());
+    }
+
+    while (now < deadline_ns) {
+        now = get_nanoseconds();
+    }
+    return (now);
+}
+
+// (*) set_clock
+
+void set_clock(const ping_clock_t *clock) {
+    clock_source = clock;
 }
@@ -0,0 +1,335 @@
+// multi-core mode: worker processes with their own socket, identifiers and statistics shard
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ft_ping.h"
+#include "histogram.h"
+#include "macros.h"
+#include "selfstats.h"
+#include "signals.h"
+#include "socket.h"
+#include "utils.h"
+#include "workers.h"
+
+extern ping_state_t state;
+
+// (*) statistics shards: one per worker in a shared mapping, filled by the worker when it's done
+
+typedef struct worker_totals {
+    int done;                           // set once the shard is filled
+    unsigned long num_sent;
+    unsigned long num_recv;
+    unsigned long num_rept;
+    uint64_t first_send_ns;
+    uint64_t last_send_ns;
+    unsigned long recv_calls;
+    unsigned long recv_packets;
+    unsigned long noise_packets;
+    unsigned long ring_overflows;
+    size_t ring_max_occupancy;
+    unsigned long ring_occupancy_sum;
+    unsigned long ring_samples;
+    unsigned long pacer_wakeups;
+    double pacer_lateness_sum;
+    double pacer_lateness_sum_sq;
+    uint64_t pacer_lateness_max;
+    self_stats_t self;
+} worker_totals_t;
+
+typedef struct target_shard {
+    unsigned long num_sent;
+    unsigned long num_recv;
+    unsigned long num_rept;
+    unsigned long num_late;
+    unsigned long num_unknown;
+    unsigned long num_send_errors;
+    double rrt_sum;
+    double rrt_sum_sq;
+    double rrt_min;
+    double rrt_max;
+} target_shard_t;
+
+static uint8_t *shards = NULL;          // per worker: worker_totals_t, then num_targets target_shard_t, then the histograms
+static size_t shard_size = 0;
+static size_t shards_size = 0;
+static pid_t worker_pids[MAX_WORKERS];
+static size_t num_workers = 0;
+static volatile sig_atomic_t interrupted = 0;
+
+static worker_totals_t *shard_totals(size_t worker) {
+    return ((worker_totals_t *)(shards + worker * shard_size));
+}
+
+static target_shard_t *shard_targets(size_t worker) {
+    return ((target_shard_t *)(shards + worker * shard_size + sizeof(worker_totals_t)));
+}
+
+static latency_histogram_t *shard_histograms(size_t worker) {
+    return ((latency_histogram_t *)((uint8_t *)shard_targets(worker) + state.num_targets * sizeof(target_shard_t)));
+}
+
+// @brief worker: copies its statistics into its shard
+static void save_shard(size_t worker) {
+    worker_totals_t *totals = shard_totals(worker);
+    target_shard_t *targets = shard_targets(worker);
+    latency_histogram_t *histograms = shard_histograms(worker);
+
+    for (size_t i = 0; i < state.num_targets; i++) {
+        ping_target_t *target = &state.targets[i];
+
+        targets[i].num_sent = target->num_sent;
+        targets[i].num_recv = target->num_recv;
+        targets[i].num_rept = target->num_rept;
+        targets[i].num_late = target->num_late;
+        targets[i].num_unknown = target->num_unknown;
+        targets[i].num_send_errors = target->num_send_errors;
+        targets[i].rrt_sum = target->rrt_sum;
+        targets[i].rrt_sum_sq = target->rrt_sum_sq;
+        targets[i].rrt_min = target->rrt_min;
+        targets[i].rrt_max = target->rrt_max;
+        if (target->histogram) {
+            memcpy(&histograms[i], target->histogram, sizeof(latency_histogram_t));
+        }
+    }
+
+    totals->num_sent = state.num_sent;
+    totals->num_recv = state.num_recv;
+    totals->num_rept = state.num_rept;
+    totals->first_send_ns = state.first_send_ns;
+    totals->last_send_ns = state.last_send_ns;
+    totals->recv_calls = state.recv_calls;
+    totals->recv_packets = state.recv_packets;
+    totals->noise_packets = state.noise_packets;
+    totals->ring_overflows = state.ring_overflows;
+    totals->ring_max_occupancy = state.ring_max_occupancy;
+    totals->ring_occupancy_sum = state.ring_occupancy_sum;
+    totals->ring_samples = state.ring_samples;
+    totals->pacer_wakeups = state.pacer_wakeups;
+    totals->pacer_lateness_sum = state.pacer_lateness_sum;
+    totals->pacer_lateness_sum_sq = state.pacer_lateness_sum_sq;
+    totals->pacer_lateness_max = state.pacer_lateness_max;
+    totals->self = state.self;
+    totals->done = 1;
+}
+
+// @brief parent: adds the shard of a worker to state and state.targets
+static void merge_shard(size_t worker) {
+    worker_totals_t *totals = shard_totals(worker);
+    target_shard_t *targets = shard_targets(worker);
+    latency_histogram_t *histograms = shard_histograms(worker);
+
+    if (!totals->done) {
+        return ; // the worker died before it could tell
+    }
+
+    for (size_t i = 0; i < state.num_targets; i++) {
+        ping_target_t *target = &state.targets[i];
+
+        if (targets[i].num_recv > 0) {
+            if (target->num_recv == 0 || targets[i].rrt_min < target->rrt_min) {
+                target->rrt_min = targets[i].rrt_min;
+            }
+            if (target->num_recv == 0 || targets[i].rrt_max > target->rrt_max) {
+                target->rrt_max = targets[i].rrt_max;
+            }
+        }
+        target->num_sent += targets[i].num_sent;
+        target->num_recv += targets[i].num_recv;
+        target->num_rept += targets[i].num_rept;
+        target->num_late += targets[i].num_late;
+        target->num_unknown += targets[i].num_unknown;
+        target->num_send_errors += targets[i].num_send_errors;
+        target->rrt_sum += targets[i].rrt_sum;
+        target->rrt_sum_sq += targets[i].rrt_sum_sq;
+        if (target->histogram) {
+            histogramMerge(target->histogram, &histograms[i]);
+        }
+    }
+
+    state.num_sent += totals->num_sent;
+    state.num_recv += totals->num_recv;
+    state.num_rept += totals->num_rept;
+    if (totals->first_send_ns && (!state.first_send_ns || totals->first_send_ns < state.first_send_ns)) {
+        state.first_send_ns = totals->first_send_ns;
+    }
+    if (totals->last_send_ns > state.last_send_ns) {
+        state.last_send_ns = totals->last_send_ns;
+    }
+    state.recv_calls += totals->recv_calls;
+    state.recv_packets += totals->recv_packets;
+    state.noise_packets += totals->noise_packets;
+    state.ring_overflows += totals->ring_overflows;
+    if (totals->ring_max_occupancy > state.ring_max_occupancy) {
+        state.ring_max_occupancy = totals->ring_max_occupancy;
+    }
+    state.ring_occupancy_sum += totals->ring_occupancy_sum;
+    state.ring_samples += totals->ring_samples;
+    state.pacer_wakeups += totals->pacer_wakeups;
+    state.pacer_lateness_sum += totals->pacer_lateness_sum;
+    state.pacer_lateness_sum_sq += totals->pacer_lateness_sum_sq;
+    if (totals->pacer_lateness_max > state.pacer_lateness_max) {
+        state.pacer_lateness_max = totals->pacer_lateness_max;
+    }
+    mergeSelfStats(&state.self, &totals->self);
+}
+
+
+// (*) workers
+
+// @brief pins the calling process to the index-th CPU it's allowed to run on (round robin)
+static void pin_to_cpu(size_t index) {
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0 || CPU_COUNT(&allowed) == 0) {
+        return ;
+    }
+
+    size_t nth = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        if (nth-- == 0) {
+            cpu_set_t pinned;
+            CPU_ZERO(&pinned);
+            CPU_SET(cpu, &pinned);
+            sched_setaffinity(0, sizeof(pinned), &pinned);
+            return ;
+        }
+    }
+}
+
+// @brief worker process: takes its own socket and identifiers, runs the ping loop for 'count' rounds, then fills its shard
+static void run_worker(size_t index, size_t count) {
+    // a SIGINT ends the worker's loop, which fills its shard as usual (no interim summaries: the counters are split)
+    if (openSignals(0) == SIGNALS_ERROR) {
+        errorLogger(ft_strjoin("workers: ", strerror(errno)), EXIT_FAILURE);
+    }
+    pin_to_cpu(index);
+
+    // a socket of its own (the parent's one would get everybody's replies, it's closed before the fork)
+    int sock_fd;
+    int sock_type;
+
+    if (createPingSocket(&sock_fd, &sock_type, state.program_name) == SOCKET_ERROR) {
+        errorLogger(ft_strjoin("socket: ", strerror(errno)), EXIT_FAILURE);
+    }
+    state.sock_fd = sock_fd;
+
+    // identifiers: worker w uses [identifier + w * num_targets, identifier + (w + 1) * num_targets)
+    state.identifier = (state.identifier + index * state.num_targets) & 0xFFFF;
+    for (size_t i = 0; i < state.num_targets; i++) {
+        state.targets[i].identifier = (state.identifier + i) & 0xFFFF;
+    }
+
+    if (state.socket_type == SOCK_RAW && state.icmp_filter && attachIcmpFilter(sock_fd, state.identifier, state.num_targets) == SOCKET_ERROR) {
+        infoLogger("Note: socket filter not supported, every worker parses every ICMP packet");
+    }
+
+    if (state.kernel_timestamps) {
+        disableKernelTimestamps();
+        if (enableKernelTimestamps() == SOCKET_ERROR) {
+            state.kernel_timestamps = 0;
+        }
+    }
+
+    state.count = count;
+    state.rate /= state.workers; // --rate is the total
+    run_ping_loop();
+    save_shard(index);
+    fflush(stdout); // _exit() doesn't flush stdio
+    _exit(EXIT_SUCCESS);
+}
+
+static void parent_signal_handler(int sig) {
+    if (sig == SIGINT) {
+        interrupted = 1;
+    }
+}
+
+void runWorkers(void) {
+    shard_size = sizeof(worker_totals_t) + state.num_targets * sizeof(target_shard_t);
+    if (state.num_percentiles > 0) {
+        shard_size += state.num_targets * sizeof(latency_histogram_t);
+    }
+    shard_size = (shard_size + 63) & ~(size_t)63; // shards don't share cache lines
+    shards_size = shard_size * state.workers;
+
+    shards = mmap(NULL, shards_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shards == MAP_FAILED) {
+        errorLogger(ft_strjoin("workers: ", strerror(errno)), EXIT_FAILURE);
+    }
+
+    // (*) -c is the total: rounds are split between the workers (-c 0 keeps every worker going)
+    // waitpid() isn't restarted after a SIGINT (no SA_RESTART): it's forwarded right away, also when only we got it;
+    // the counters are in the workers until they're done: there's nothing to show an interim summary of
+    struct sigaction action = { .sa_handler = parent_signal_handler };
+
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGUSR1, SIG_IGN);
+    fflush(stdout);
+
+    // nobody reads our socket from now on: left open, it would keep queuing replies (worker 0's identifiers are ours)
+    closePingSocket(state.sock_fd);
+    state.sock_fd = -1;
+
+    num_workers = 0;
+    for (size_t w = 0; w < state.workers; w++) {
+        size_t count = 0;
+
+        if (state.count) {
+            count = state.count / state.workers + (w < state.count % state.workers);
+            if (count == 0) {
+                break; // fewer rounds than workers
+            }
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            errorLogger(ft_strjoin("workers: ", strerror(errno)), EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            run_worker(w, count);
+        }
+        worker_pids[num_workers++] = pid;
+    }
+
+    // (*) wait for every worker; an interrupt is forwarded once (workers in our process group already got it from the terminal)
+    int forwarded = 0;
+    size_t remaining = num_workers;
+
+    while (remaining > 0) {
+        pid_t pid = waitpid(-1, NULL, 0);
+
+        if (pid > 0) {
+            remaining -= 1;
+        } else if (errno == ECHILD) {
+            break;
+        }
+
+        if (interrupted && !forwarded) {
+            for (size_t w = 0; w < num_workers; w++) {
+                kill(worker_pids[w], SIGINT);
+            }
+            forwarded = 1;
+        }
+    }
+
+    for (size_t w = 0; w < num_workers; w++) {
+        merge_shard(w);
+    }
+
+    munmap(shards, shards_size);
+    shards = NULL;
+}
@@ -0,0 +1,305 @@
+// ft_ping_analyze: offline analysis of a binary probe log written by ft_ping --probe-log
+// (per target summary, RTT percentiles and loss bursts, recomputed from the raw records)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sysexits.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "histogram.h"
+#include "probelog.h"
+
+#define MAX_ANALYZE_PERCENTILES 16
+#define SEQUENCE_BASE 65536 // outcome index of an (unwrapped) sequence is sequence + SEQUENCE_BASE, so it stays positive
+
+// outcome of a probe
+#define OUTCOME_UNKNOWN 0
+#define OUTCOME_REPLIED 1
+#define OUTCOME_LOST 2
+
+typedef struct target_analysis {
+    unsigned long replies;
+    unsigned long duplicates;
+    unsigned long errors;
+    unsigned long timeouts;
+    unsigned long late;
+    unsigned long timed;        // replies with both timestamps
+    double rtt_sum;             // seconds
+    double rtt_sum_sq;
+    double rtt_min;
+    double rtt_max;
+    latency_histogram_t *histogram; // allocated with the first timed reply
+
+    // 16 bit sequences unwrapped in record order (consecutive records are never 32768 sequences apart)
+    int64_t last_sequence;
+    int seen;
+    uint8_t *outcomes;          // indexed by unwrapped sequence + SEQUENCE_BASE
+    size_t outcomes_size;
+} target_analysis_t;
+
+static void usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-p <percentiles>] <probe log>\n", program_name);
+    fprintf(stderr, "  -p <list>     RTT percentiles to report (default 50,90,99,99.9)\n");
+}
+
+static int parse_percentile_list(char *list, double *percentiles, size_t *num_percentiles) {
+    *num_percentiles = 0;
+
+    while (1) {
+        char *endptr;
+        double value = strtod(list, &endptr);
+
+        if (endptr == list || (*endptr != ',' && *endptr != '\0') || value < 0.0 || value > 100.0
+            || *num_percentiles == MAX_ANALYZE_PERCENTILES) {
+            return (-1);
+        }
+        percentiles[(*num_percentiles)++] = value;
+
+        if (*endptr == '\0') {
+            return (0);
+        }
+        list = endptr + 1;
+    }
+}
+
+// @brief maps a 16 bit sequence to the unwrapped sequence nearest to the previous one of the target
+static int64_t unwrap_sequence(target_analysis_t *analysis, uint16_t sequence) {
+    if (!analysis->seen) {
+        analysis->seen = 1;
+        analysis->last_sequence = sequence;
+    } else {
+        analysis->last_sequence += (int16_t)(sequence - (uint16_t)analysis->last_sequence);
+    }
+    return (analysis->last_sequence);
+}
+
+static int set_outcome(target_analysis_t *analysis, int64_t sequence, uint8_t outcome) {
+    if (sequence + SEQUENCE_BASE < 0) {
+        return (0); // can't happen with the logs ft_ping writes
+    }
+
+    size_t index = sequence + SEQUENCE_BASE;
+
+    if (index >= analysis->outcomes_size) {
+        size_t new_size = analysis->outcomes_size ? analysis->outcomes_size : 4 * SEQUENCE_BASE;
+        while (new_size <= index) {
+            new_size *= 2;
+        }
+
+        uint8_t *outcomes = realloc(analysis->outcomes, new_size);
+        if (!outcomes) {
+            return (-1);
+        }
+        memset(outcomes + analysis->outcomes_size, OUTCOME_UNKNOWN, new_size - analysis->outcomes_size);
+        analysis->outcomes = outcomes;
+        analysis->outcomes_size = new_size;
+    }
+
+    // a reply wins over a timeout (a late reply, the probe was given up on before it came)
+    if (analysis->outcomes[index] != OUTCOME_REPLIED) {
+        analysis->outcomes[index] = outcome;
+    }
+    return (0);
+}
+
+static int analyze_record(target_analysis_t *analysis, const probe_record_t *record) {
+    int64_t sequence = unwrap_sequence(analysis, record->sequence);
+
+    switch (record->kind) {
+        case PROBE_REPLY:
+            analysis->replies += 1;
+            if (record->sent_ns && record->reply_ns) {
+                int64_t rtt_ns = (int64_t)(record->reply_ns - record->sent_ns);
+                double rtt_s = rtt_ns / 1e9;
+
+                if (!analysis->histogram && !(analysis->histogram = calloc(1, sizeof(latency_histogram_t)))) {
+                    return (-1);
+                }
+
+                if (analysis->timed == 0 || rtt_s < analysis->rtt_min) {
+                    analysis->rtt_min = rtt_s;
+                }
+                if (analysis->timed == 0 || rtt_s > analysis->rtt_max) {
+                    analysis->rtt_max = rtt_s;
+                }
+                analysis->rtt_sum += rtt_s;
+                analysis->rtt_sum_sq += rtt_s * rtt_s;
+                analysis->timed += 1;
+                histogramRecord(analysis->histogram, rtt_ns > 0 ? (uint64_t)rtt_ns : 0);
+            }
+            return (set_outcome(analysis, sequence, OUTCOME_REPLIED));
+        case PROBE_DUPLICATE:
+            analysis->duplicates += 1;
+            return (0);
+        case PROBE_ERROR:
+            analysis->errors += 1;
+            return (0);
+        case PROBE_LATE:
+            analysis->late += 1; // the probe's timeout record counts it as lost
+            return (0);
+        case PROBE_TIMEOUT:
+            analysis->timeouts += 1;
+            return (set_outcome(analysis, sequence, OUTCOME_LOST));
+        default:
+            return (0); // unknown kind (newer writer), skipped
+    }
+}
+
+static void print_loss_bursts(const target_analysis_t *analysis) {
+    unsigned long bursts = 0;
+    unsigned long lost = 0;
+    unsigned long longest = 0;
+    unsigned long current = 0;
+
+    // a burst is a run of consecutive lost probes (a probe with no record ends it, as a reply does)
+    for (size_t i = 0; i <= analysis->outcomes_size; i++) {
+        if (i < analysis->outcomes_size && analysis->outcomes[i] == OUTCOME_LOST) {
+            current += 1;
+            continue;
+        }
+        if (current) {
+            bursts += 1;
+            lost += current;
+            if (current > longest) {
+                longest = current;
+            }
+            current = 0;
+        }
+    }
+
+    if (bursts == 0) {
+        printf("loss bursts: none\n");
+    } else {
+        printf("loss bursts: %lu, longest %lu probes, average %.2f probes\n", bursts, longest, (double)lost / bursts);
+    }
+}
+
+static void print_analysis(const probelog_target_t *target, const target_analysis_t *analysis,
+                           const double *percentiles, size_t num_percentiles) {
+    struct in_addr address = { .s_addr = target->address };
+    unsigned long probes = analysis->replies + analysis->timeouts;  // every probe ends replied or timed out
+    double loss = probes ? (analysis->timeouts * 100.0) / probes : 0.0;
+
+    printf("--- %.*s (%s) probe log ---\n", PROBELOG_NAME_LEN, target->name, inet_ntoa(address));
+    printf("%lu probes, %lu replies, %lu duplicates, %lu late replies, %lu ICMP errors, %lu timeouts, %.3f%% packet loss\n",
+           probes, analysis->replies, analysis->duplicates, analysis->late, analysis->errors, analysis->timeouts, loss);
+
+    if (analysis->timed > 0) {
+        double avg = analysis->rtt_sum / analysis->timed;
+        double stddev = sqrt(fmax(0.0, analysis->rtt_sum_sq / analysis->timed - avg * avg));
+
+        printf("round-trip min/avg/max/stddev = %.3f/%.3f/%.3f/%.3f ms\n",
+               analysis->rtt_min * 1000.0, avg * 1000.0, analysis->rtt_max * 1000.0, stddev * 1000.0);
+
+        printf("round-trip percentiles ");
+        for (size_t i = 0; i < num_percentiles; i++) {
+            printf("%sp%g", i ? "/" : "", percentiles[i]);
+        }
+        printf(" = ");
+        for (size_t i = 0; i < num_percentiles; i++) {
+            printf("%s%.3f", i ? "/" : "", histogramPercentile(analysis->histogram, percentiles[i]) / 1e6);
+        }
+        printf(" ms\n");
+    }
+
+    print_loss_bursts(analysis);
+}
+
+int main(int argc, char **argv) {
+    double percentiles[MAX_ANALYZE_PERCENTILES] = { 50, 90, 99, 99.9 };
+    size_t num_percentiles = 4;
+    int arg_index = 1;
+
+    if (arg_index + 1 < argc && strcmp(argv[arg_index], "-p") == 0) {
+        if (parse_percentile_list(argv[arg_index + 1], percentiles, &num_percentiles) < 0) {
+            fprintf(stderr, "%s: -p: invalid percentile list\n", argv[0]);
+            return (EX_USAGE);
+        }
+        arg_index += 2;
+    }
+    if (arg_index + 1 != argc) {
+        usage(argv[0]);
+        return (EX_USAGE);
+    }
+
+    const char *path = argv[arg_index];
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+        return (EX_NOINPUT);
+    }
+
+    size_t file_size = file_stat.st_size;
+    if (file_size < sizeof(probelog_header_t)) {
+        fprintf(stderr, "%s: %s: not a probe log\n", argv[0], path);
+        return (EX_DATAERR);
+    }
+
+    const uint8_t *map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], path, strerror(errno));
+        return (EX_IOERR);
+    }
+    madvise((void *)map, file_size, MADV_SEQUENTIAL); // a single pass over the records
+
+    const probelog_header_t *header = (const probelog_header_t *)map;
+    size_t records_offset = sizeof(probelog_header_t) + (size_t)header->num_targets * sizeof(probelog_target_t);
+
+    if (memcmp(header->magic, PROBELOG_MAGIC, sizeof(PROBELOG_MAGIC)) != 0 || header->version != PROBELOG_VERSION
+        || header->record_size != sizeof(probe_record_t) || records_offset > file_size) {
+        fprintf(stderr, "%s: %s: not a probe log (or an unsupported version)\n", argv[0], path);
+        return (EX_DATAERR);
+    }
+
+    // a log that wasn't closed (killed process) still has its preallocated tail: num_records tells where records end
+    // (acquire: pairs with the writer's release store, the records counted are complete even while ft_ping still runs)
+    size_t num_records = (file_size - records_offset) / sizeof(probe_record_t);
+    uint64_t written = __atomic_load_n(&header->num_records, __ATOMIC_ACQUIRE);
+    if (written < num_records) {
+        num_records = written;
+    }
+
+    const probelog_target_t *targets = (const probelog_target_t *)(map + sizeof(probelog_header_t));
+    const probe_record_t *records = (const probe_record_t *)(map + records_offset);
+    target_analysis_t *analyses = calloc(header->num_targets, sizeof(target_analysis_t));
+
+    if (!analyses && header->num_targets) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    unsigned long skipped = 0;
+    for (size_t i = 0; i < num_records; i++) {
+        if (records[i].target >= header->num_targets) {
+            skipped += 1;
+            continue;
+        }
+        if (analyze_record(&analyses[records[i].target], &records[i]) < 0) {
+            fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+            return (EXIT_FAILURE);
+        }
+    }
+
+    printf("%s: %zu records, %u targets, %u data bytes per probe\n", path, num_records, header->num_targets, header->data_len);
+    for (size_t i = 0; i < header->num_targets; i++) {
+        print_analysis(&targets[i], &analyses[i], percentiles, num_percentiles);
+        free(analyses[i].outcomes);
+        free(analyses[i].histogram);
+    }
+    if (skipped) {
+        printf("%lu records with an unknown target skipped\n", skipped);
+    }
+
+    free(analyses);
+    munmap((void *)map, file_size);
+    close(fd);
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,43 @@
+#!/usr/bin/env bash
+# compares the I/O backends (sendmmsg/recvmmsg and --io-uring) on loopback at several rates
+#
+# usage: sudo tools/bench_io.sh [seconds per run] [rates...]
+# prints one line per run: backend, requested and achieved rate, loss, average RTT, user and system CPU time
+# and system time per probe (where the system calls show); runs need root (raw socket and rates above the flood limit)
+
+set -u
+
+PING=${PING:-./ft_ping}
+TARGET=${TARGET:-127.0.0.1}
+SECONDS_PER_RUN=${1:-2}
+shift $(( $# > 0 ? 1 : 0 ))
+RATES=${*:-"1000 10000 50000 100000 200000"}
+
+if [ ! -x "$PING" ]; then
+    echo "$PING not found (run make first)" >&2
+    exit 1
+fi
+
+printf "%-8s %8s %10s %7s %9s %7s %7s %10s\n" backend rate achieved loss% rtt_ms user_s sys_s sys_us/pkt
+
+for rate in $RATES; do
+    for backend in socket io_uring; do
+        count=$(( rate * SECONDS_PER_RUN ))
+        flags="-q -v --rate $rate --burst 64 --batch 64 -c $count"
+        if [ "$backend" = io_uring ]; then
+            flags="$flags --io-uring"
+        fi
+
+        # bash's time keyword reports the run's user and system CPU time on stderr
+        out=$( { TIMEFORMAT='cpu %U %S'; time $PING $flags "$TARGET" 2>/dev/null; } 2>&1 )
+
+        achieved=$(echo "$out" | sed -n 's/.* s, \([0-9]*\) packets\/s.*/\1/p')
+        loss=$(echo "$out" | sed -n 's/.* received, \([0-9.]*\)% packet loss.*/\1/p')
+        rtt=$(echo "$out" | sed -n 's/^round-trip [^=]*= [^/]*\/\([^/]*\)\/.*/\1/p')
+        user=$(echo "$out" | awk '/^cpu / { print $2 }')
+        sys=$(echo "$out" | awk '/^cpu / { print $3 }')
+        per_packet=$(awk -v sys="${sys:-0}" -v n="$count" 'BEGIN { printf "%.3f", n ? sys * 1e6 / n : 0 }')
+
+        printf "%-8s %8s %10s %7s %9s %7s %7s %10s\n" "$backend" "$rate" "${achieved:--}" "${loss:--}" "${rtt:--}" "${user:--}" "${sys:--}" "$per_packet"
+    done
+done
@@ -0,0 +1,225 @@
+#!/usr/bin/env bash
+# load test harness: ft_ping against a userspace echo responder (ft_ping_responder) with injected impairments, on loopback,
+# in a network namespace of its own (the kernel's echo replies are turned off there, nothing else on the host is touched)
+#
+# usage: sudo tools/loadtest.sh [-q] [-n]
+#   -q  quick: fewer probes per scenario
+#   -n  skip the maximum sustained rate search
+#
+# each scenario runs the responder with a set of impairments and checks what ft_ping reports (sent, received, duplicates,
+# RTT min/avg/max/stddev) against what the responder actually did (it counts its drops, copies and held back replies)
+# and against the injected delay and jitter; then the highest rate sustained without loss is searched for, per backend
+
+set -u
+
+PING=${PING:-./ft_ping}
+RESPONDER=${RESPONDER:-./ft_ping_responder}
+TARGET=127.0.0.1
+QUICK=0
+SEARCH_RATE=1
+
+while getopts "qn" opt; do
+    case $opt in
+        q) QUICK=1 ;;
+        n) SEARCH_RATE=0 ;;
+        *) echo "usage: $0 [-q] [-n]" >&2; exit 2 ;;
+    esac
+done
+
+if [ "$(id -u)" -ne 0 ]; then
+    echo "$0: must be run as root (network namespace, raw sockets)" >&2
+    exit 1
+fi
+for binary in "$PING" "$RESPONDER"; do
+    if [ ! -x "$binary" ]; then
+        echo "$0: $binary not found (run make first)" >&2
+        exit 1
+    fi
+done
+
+# (*) isolated network: a new namespace with loopback only, where the responder answers the echo requests instead of the kernel
+if [ -z "${FT_PING_LOADTEST_NETNS:-}" ]; then
+    exec env FT_PING_LOADTEST_NETNS=1 unshare --net -- "$0" "$@"
+fi
+
+ip link set lo up
+sysctl -qw net.ipv4.icmp_echo_ignore_all=1
+sysctl -qw net.ipv4.ping_group_range="0 2147483647" # SOCK_DGRAM runs
+
+WORKDIR=$(mktemp -d)
+trap 'kill "$RESPONDER_PID" 2>/dev/null; rm -rf "$WORKDIR"' EXIT
+RESPONDER_PID=
+CHECKS=0
+FAILURES=0
+
+COUNT=4000
+SLOW_COUNT=40
+if [ "$QUICK" -eq 1 ]; then
+    COUNT=1000
+    SLOW_COUNT=15
+fi
+
+start_responder() {
+    "$RESPONDER" -S 42 -o "$WORKDIR/responder.txt" "$@" &
+    RESPONDER_PID=$!
+    sleep 0.2
+}
+
+# @brief stops the responder and loads its counters (requests, replies, dropped, duplicated, reordered, lateness) as r_* variables
+stop_responder() {
+    kill -TERM "$RESPONDER_PID"
+    wait "$RESPONDER_PID" 2>/dev/null
+    RESPONDER_PID=
+    for pair in $(cat "$WORKDIR/responder.txt"); do
+        eval "r_${pair%%=*}=${pair#*=}"
+    done
+}
+
+# @brief json_field <record> <key>: value of a field of a JSON lines record
+json_field() {
+    echo "$1" | sed -n "s/.*\"$2\":\"\{0,1\}\([^,\"}]*\).*/\1/p"
+}
+
+# @brief check <scenario> <description> <awk condition>
+check() {
+    CHECKS=$((CHECKS + 1))
+    if awk "BEGIN { exit !($3) }"; then
+        echo "PASS $1: $2"
+    else
+        echo "FAIL $1: $2"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+# @brief scenario <name> <delay ms> <jitter ms> <loss %> <dup %> <reorder %> <gap ms> [ft_ping options...]
+# runs ft_ping (JSON lines summary) against the impaired responder and checks the summary
+scenario() {
+    local name=$1 delay=$2 jitter=$3 loss=$4 dup=$5 reorder=$6 gap=$7
+    shift 7
+
+    start_responder -d "$delay" -j "$jitter" -l "$loss" -D "$dup" -r "$reorder" -g "$gap"
+    "$@" > "$WORKDIR/ping.txt" 2>&1
+    stop_responder
+
+    local summary
+    summary=$(grep '"event":"summary"' "$WORKDIR/ping.txt" | tail -1)
+    if [ -z "$summary" ]; then
+        check "$name" "ft_ping printed a summary" 0
+        return
+    fi
+
+    local sent received duplicates min avg max stddev
+    sent=$(json_field "$summary" sent)
+    received=$(json_field "$summary" received)
+    duplicates=$(json_field "$summary" duplicates)
+    min=$(json_field "$summary" min_ms)
+    avg=$(json_field "$summary" avg_ms)
+    max=$(json_field "$summary" max_ms)
+    stddev=$(json_field "$summary" stddev_ms)
+
+    # counts: exactly what the responder did (the copy of the very last reply may come in after ft_ping is gone)
+    check "$name" "sent $sent = requests seen by the responder $r_requests" "$sent == $r_requests"
+    check "$name" "received $received = replies sent by the responder $r_replies (loss $loss%, dropped $r_dropped)" \
+        "$received == $r_replies"
+    check "$name" "duplicates $duplicates = copies sent by the responder $r_duplicated" \
+        "$duplicates <= $r_duplicated && $r_duplicated - $duplicates <= 1"
+
+    [ "$received" -gt 0 ] || return
+
+    # RTT: delay + uniform jitter, plus the reorder gap for the replies held back, plus how late the responder actually
+    # let the replies go (it measures that itself: a stall of its process holds every queued reply, whatever the timers do)
+    # (expected stddev: jitter / sqrt(3), the gap's share and the responder's lateness; loopback and ft_ping's own
+    # scheduling add a fraction of a millisecond)
+    local held expected_avg expected_stddev
+    held=$(awk "BEGIN { print $r_replies ? $r_reordered / $r_replies : 0 }")
+    expected_avg=$(awk "BEGIN { print $delay + $gap * $held + $r_late_avg_ms }")
+    expected_stddev=$(awk "BEGIN { print sqrt($jitter * $jitter / 3 + $gap * $gap * $held * (1 - $held) + $r_late_stddev_ms * $r_late_stddev_ms) }")
+
+    check "$name" "min $min ms >= delay - jitter ($delay - $jitter ms)" "$min >= $delay - $jitter - 0.05"
+    # the maximum only has a lower bound (a scheduling hiccup of either process lands there): the held back replies show
+    check "$name" "max $max ms >= delay + jitter / 2 (+ gap when held back)" "$max >= $delay + $jitter / 2 + ($r_reordered ? $gap : 0) - 0.05"
+    check "$name" "avg $avg ms ~ $expected_avg ms" "$avg >= $expected_avg - 0.1 && $avg <= $expected_avg * 1.05 + 0.5"
+    check "$name" "stddev $stddev ms ~ $expected_stddev ms" \
+        "$stddev >= $expected_stddev * 0.8 - 0.05 && $stddev <= $expected_stddev * 1.2 + 0.3"
+}
+
+# @brief text_scenario <name> <loss %> [ft_ping options...]: counts only, from the text summary (modes without --format)
+text_scenario() {
+    local name=$1 loss=$2
+    shift 2
+
+    start_responder -l "$loss"
+    "$@" > "$WORKDIR/ping.txt" 2>&1
+    stop_responder
+
+    local sent received
+    sent=$(sed -n 's/^\([0-9]*\) packets transmitted.*/\1/p' "$WORKDIR/ping.txt" | tail -1)
+    received=$(sed -n 's/.* \([0-9]*\) packets received.*/\1/p' "$WORKDIR/ping.txt" | tail -1)
+
+    check "$name" "sent ${sent:-?} = requests seen by the responder $r_requests" "${sent:-0} == $r_requests"
+    check "$name" "received ${received:-?} = replies sent by the responder $r_replies (loss $loss%)" "${received:--1} == $r_replies"
+}
+
+echo "== impairments (ft_ping -i 0.002, $COUNT probes)"
+BASE="$PING -q --format=jsonl -i 0.002 -c $COUNT $TARGET"
+scenario baseline 0 0 0 0 0 0 $BASE
+scenario delay 10 0 0 0 0 0 $BASE
+scenario jitter 10 4 0 0 0 0 $BASE
+scenario loss 0 0 10 0 0 0 $BASE
+scenario duplication 0 0 0 10 0 0 $BASE
+scenario reorder 1 0 0 0 20 3 $BASE
+scenario combined 5 2 5 5 10 3 $BASE
+
+echo "== modes (combined impairments)"
+IMPAIRED="2 1 5 5 10 3"
+scenario batch $IMPAIRED $PING -q --format=jsonl -i 0.008 --batch 4 -c $COUNT $TARGET
+scenario rate $IMPAIRED $PING -q --format=jsonl --rate 5000 --burst 16 --batch 16 -c $((COUNT * 4)) $TARGET
+scenario recv-thread $IMPAIRED $PING -q --format=jsonl --recv-thread -i 0.002 -c $COUNT $TARGET
+scenario io-uring $IMPAIRED $PING -q --format=jsonl --io-uring -i 0.002 -c $COUNT $TARGET
+scenario packet-ring $IMPAIRED $PING -q --format=jsonl --packet-ring -i 0.002 -c $COUNT $TARGET
+scenario kernel-timestamps $IMPAIRED $PING -q --format=jsonl --kernel-timestamps -i 0.002 -c $COUNT $TARGET
+scenario timeouts $IMPAIRED $PING -q --format=jsonl -W 1 -i 0.002 -c $COUNT $TARGET
+text_scenario workers 5 $PING -q --workers 2 -i 0.002 -c $COUNT $TARGET
+if command -v setpriv > /dev/null; then
+    # unprivileged: SOCK_DGRAM ping socket, 0.2 s interval at least
+    scenario dgram $IMPAIRED setpriv --reuid=65534 --regid=65534 --clear-groups \
+        "$PING" -q --format=jsonl -i 0.2 -c $SLOW_COUNT $TARGET
+fi
+
+# (*) maximum sustained rate: the highest rate (of a doubling ramp) sent at 97% or more of the request, with no loss
+max_rate() {
+    local best=0
+
+    for rate in 10000 20000 50000 100000 200000 400000 800000; do
+        local count=$((rate * 2))
+        [ "$QUICK" -eq 1 ] && count=$rate
+
+        start_responder
+        "$PING" -q "$@" --rate $rate --burst 64 --batch 64 -c $count $TARGET > "$WORKDIR/ping.txt" 2>&1
+        stop_responder
+
+        local achieved received
+        achieved=$(sed -n 's/.* s, \([0-9]*\) packets\/s.*/\1/p' "$WORKDIR/ping.txt")
+        received=$(sed -n 's/.* \([0-9]*\) packets received.*/\1/p' "$WORKDIR/ping.txt")
+
+        if ! awk "BEGIN { exit !(${achieved:-0} >= $rate * 0.97 && ${received:-0} >= $count * 0.999) }"; then
+            echo "   $rate pps: not sustained (achieved ${achieved:-?} pps, ${received:-?}/$count replies)" >&2
+            break
+        fi
+        echo "   $rate pps: sustained (achieved $achieved pps, $received/$count replies)" >&2
+        best=$rate
+    done
+    echo $best
+}
+
+if [ "$SEARCH_RATE" -eq 1 ]; then
+    echo "== maximum sustained rate"
+    echo " sendmmsg/recvmmsg:"
+    SOCKET_MAX=$(max_rate)
+    echo " io_uring:"
+    URING_MAX=$(max_rate --io-uring)
+    echo "max_sustained_pps socket=$SOCKET_MAX io_uring=$URING_MAX"
+fi
+
+echo "== $CHECKS checks, $FAILURES failed"
+[ "$FAILURES" -eq 0 ]
@@ -0,0 +1,419 @@
+// ft_ping_bench: microbenchmarks of the per-packet paths (echo request checksum and building, parse and handling stages
+// of replies, duplicates, noise and ICMP errors) on synthetic packets, for raw and DGRAM sockets and several payload sizes;
+// one row per benchmark, in CSV or JSON lines, so that runs can be compared from a commit to the other
+
+#define _DEFAULT_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+#include "ft_ping.h"
+#include "icmp.h" // before macros.h (its PARSE_* macros would clash with the parse_status_t enum)
+#include "macros.h"
+#include "output.h"
+#include "target.h"
+
+#define BENCH_ROUND SEQUENCE_WINDOW     // packets per round: every reply of a round is in the target's sequence window
+#define BENCH_CHECKSUM_ROUND 64         // full checksums per round (each one sums the whole payload)
+#define BENCH_MAX_SIZES 16
+#define BENCH_DEFAULT_SIZES "0,56,512,1472,8192"
+#define BENCH_DEFAULT_SECONDS 0.2
+#define BENCH_TARGET "127.0.0.1"
+#define BENCH_ROUTER "10.0.0.1"         // sender of the ICMP errors
+#define BENCH_STRANGER "10.9.9.9"       // sender of the noise (DGRAM sockets)
+
+ping_state_t state;
+
+// synthetic packets of a round, as the socket would return them (IP header included with SOCK_RAW)
+static uint8_t *packets = NULL;
+static size_t slot_size = 0;
+static size_t packet_lens[BENCH_ROUND];
+static struct sockaddr_in senders[BENCH_ROUND];
+static icmp_event_t events[BENCH_ROUND];
+static in_addr_t target_addr;
+static in_addr_t router_addr;
+static in_addr_t stranger_addr;
+
+typedef struct benchmark {
+    const char *name;
+    int per_socket;                     // 0: doesn't depend on the socket type (run once per payload size)
+    void (*prepare)(void);              // builds the round's packets (not timed), may be NULL
+    size_t (*round)(void);              // timed: runs a round, returns the number of operations
+} benchmark_t;
+
+// (*) synthetic packets
+
+static size_t ip_header_room(void) {
+    return (state.socket_type == SOCK_RAW ? sizeof(struct ip) : 0);
+}
+
+// @brief writes the IP header the raw socket would return in front of an ICMP message of icmp_len bytes
+static void write_ip_header(uint8_t *packet, in_addr_t src, in_addr_t dst, size_t icmp_len) {
+    struct ip ip;
+
+    memset(&ip, 0, sizeof(ip));
+    ip.ip_v = 4;
+    ip.ip_hl = sizeof(ip) >> 2;
+    ip.ip_len = htons(sizeof(ip) + icmp_len);
+    ip.ip_ttl = 64;
+    ip.ip_p = IPPROTO_ICMP;
+    ip.ip_src.s_addr = src;
+    ip.ip_dst.s_addr = dst;
+    memcpy(packet, &ip, sizeof(ip));
+}
+
+// @brief builds the target's next probe in wire (template copied first) and consumes its sequence, as queueIcmpEchoMessage does
+static void send_probe(uint8_t *wire) {
+    ping_target_t *target = &state.targets[0];
+    uint16_t window_index = target->sequence % SEQUENCE_WINDOW;
+
+    copyIcmpEchoRequestTemplate(wire);
+    createIcmpEchoRequestMessage(target, wire);
+
+    target->received[window_index / 64] &= ~((uint64_t)1 << (window_index % 64));
+    target->sequence += 1;
+    target->probes += 1;
+    target->num_sent += 1;
+    state.num_sent += 1;
+}
+
+static void set_sender(size_t i, in_addr_t addr) {
+    memset(&senders[i], 0, sizeof(senders[i]));
+    senders[i].sin_family = AF_INET;
+    senders[i].sin_addr.s_addr = addr;
+}
+
+// @brief a round of probes and the echo replies to them (sender: the target, or from elsewhere for noise)
+static void build_replies(in_addr_t sender, uint16_t identifier_flip) {
+    size_t room = ip_header_room();
+
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        uint8_t *packet = packets + i * slot_size;
+        icmp_echo_header_t header;
+
+        send_probe(packet + room);
+
+        // the reply is the request sent back, with its type changed (the checksum isn't checked by the parser)
+        memcpy(&header, packet + room, sizeof(header));
+        header.type = ICMP_ECHOREPLY;
+        header.identifier ^= htons(identifier_flip);
+        memcpy(packet + room, &header, sizeof(header));
+
+        if (room) {
+            write_ip_header(packet, sender, inet_addr(BENCH_TARGET), state.packet_size);
+        }
+        packet_lens[i] = room + state.packet_size;
+        set_sender(i, sender);
+    }
+}
+
+// @brief a round of probes and the ICMP error messages about them (original IP header and the first 64 bits of the probe quoted)
+static void build_errors(uint8_t type, uint8_t code) {
+    size_t room = ip_header_room();
+    uint8_t *probe = malloc(state.packet_size);
+
+    if (!probe) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        uint8_t *packet = packets + i * slot_size;
+        uint8_t *icmp = packet + room;
+        size_t icmp_len = sizeof(struct icmphdr) + sizeof(struct ip) + sizeof(struct icmphdr);
+
+        send_probe(probe);
+
+        memset(icmp, 0, sizeof(struct icmphdr));
+        icmp[0] = type;
+        icmp[1] = code;
+        write_ip_header(icmp + sizeof(struct icmphdr), inet_addr(BENCH_TARGET), target_addr, state.packet_size);
+        memcpy(icmp + sizeof(struct icmphdr) + sizeof(struct ip), probe, sizeof(struct icmphdr));
+
+        if (room) {
+            write_ip_header(packet, router_addr, inet_addr(BENCH_TARGET), icmp_len);
+        }
+        packet_lens[i] = room + icmp_len;
+        set_sender(i, router_addr);
+    }
+    free(probe);
+}
+
+static void prepare_replies(void) {
+    build_replies(target_addr, 0);
+}
+
+// @brief replies parsed ahead of time: the handling stage alone is timed
+static void prepare_events(void) {
+    build_replies(target_addr, 0);
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        socklen_t sender_len = sizeof(senders[i]);
+        parseIcmpMessage(packets + i * slot_size, packet_lens[i], (struct sockaddr *)&senders[i], &sender_len, NULL, &events[i]);
+    }
+}
+
+// @brief replies already received once: the timed round gets them a second time
+static void prepare_duplicates(void) {
+    build_replies(target_addr, 0);
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        socklen_t sender_len = sizeof(senders[i]);
+        parseIcmpMessageAndLogResult(packets + i * slot_size, packet_lens[i], (struct sockaddr *)&senders[i], &sender_len, NULL);
+    }
+}
+
+// @brief echo replies of another pinger: another identifier (raw sockets route by identifier), another host (DGRAM sockets)
+static void prepare_noise(void) {
+    if (state.socket_type == SOCK_RAW) {
+        build_replies(target_addr, 0x8000);
+    } else {
+        build_replies(stranger_addr, 0);
+    }
+}
+
+static void prepare_unreachable(void) {
+    build_errors(ICMP_DEST_UNREACH, ICMP_HOST_UNREACH);
+}
+
+static void prepare_time_exceeded(void) {
+    build_errors(ICMP_TIME_EXCEEDED, ICMP_EXC_TTL);
+}
+
+static void prepare_redirect(void) {
+    build_errors(ICMP_REDIRECT, ICMP_REDIR_HOST);
+}
+
+// (*) timed rounds
+
+// @brief the full checksum of a message (RFC 1071 sum of every word): the template's partial sum, over the whole payload
+static size_t round_checksum(void) {
+    for (size_t i = 0; i < BENCH_CHECKSUM_ROUND; i++) {
+        initIcmpEchoRequestTemplate();
+    }
+    return (BENCH_CHECKSUM_ROUND);
+}
+
+static size_t round_build(void) {
+    ping_target_t *target = &state.targets[0];
+
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        createIcmpEchoRequestMessage(target, packets + i * slot_size);
+    }
+    return (BENCH_ROUND);
+}
+
+static size_t round_parse(void) {
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        socklen_t sender_len = sizeof(senders[i]);
+        parseIcmpMessage(packets + i * slot_size, packet_lens[i], (struct sockaddr *)&senders[i], &sender_len, NULL, &events[i]);
+    }
+    return (BENCH_ROUND);
+}
+
+static size_t round_handle(void) {
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        handleIcmpEvent(&events[i]);
+    }
+    return (BENCH_ROUND);
+}
+
+static size_t round_parse_and_log(void) {
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        socklen_t sender_len = sizeof(senders[i]);
+        parseIcmpMessageAndLogResult(packets + i * slot_size, packet_lens[i], (struct sockaddr *)&senders[i], &sender_len, NULL);
+    }
+    return (BENCH_ROUND);
+}
+
+static const benchmark_t benchmarks[] = {
+    { "checksum_full", 0, NULL, round_checksum },
+    { "build_request", 0, NULL, round_build },
+    { "parse_reply", 1, prepare_replies, round_parse },
+    { "handle_reply", 1, prepare_events, round_handle },
+    { "reply", 1, prepare_replies, round_parse_and_log },
+    { "duplicate", 1, prepare_duplicates, round_parse_and_log },
+    { "noise", 1, prepare_noise, round_parse_and_log },
+    { "dest_unreachable", 1, prepare_unreachable, round_parse_and_log },
+    { "time_exceeded", 1, prepare_time_exceeded, round_parse_and_log },
+    { "redirect", 1, prepare_redirect, round_parse_and_log },
+};
+
+// (*) driver
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+// @brief sets up the packet template and a fresh target for the payload size and socket type
+static void setup(size_t payload, int socket_type) {
+    destroyTargets();
+
+    state.socket_type = socket_type;
+    state.useless_identifier = (socket_type == SOCK_DGRAM);
+    state.packet.data_len = payload;
+    state.packet_size = sizeof(icmp_echo_header_t) + payload;
+    state.num_sent = 0;
+    state.num_recv = 0;
+    state.num_rept = 0;
+    state.noise_packets = 0;
+
+    if (createTargets(1) == TARGET_ERROR) {
+        perror("setup");
+        exit(EXIT_FAILURE);
+    }
+    initIcmpEchoRequestTemplate();
+
+    ping_target_t *target = &state.targets[0];
+
+    target->dest_addr.sin_family = AF_INET;
+    target->dest_addr.sin_addr.s_addr = target_addr;
+    snprintf(target->display_address, sizeof(target->display_address), "%s", BENCH_TARGET);
+    target->resolution = RESOLUTION_DONE;
+    registerTargetAddress(0);
+
+    // room for the largest packet of a round: IP header, ICMP header, and the echo payload or the quoted probe
+    slot_size = sizeof(struct ip) + state.packet_size + sizeof(struct ip) + sizeof(struct icmphdr);
+    free(packets);
+    packets = malloc(BENCH_ROUND * slot_size);
+    if (!packets) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < BENCH_ROUND; i++) {
+        copyIcmpEchoRequestTemplate(packets + i * slot_size);
+    }
+}
+
+// @brief runs rounds of the benchmark until at least min_ns of timed work, then prints its row
+static void run_benchmark(const benchmark_t *bench, const char *socket_name, size_t payload, uint64_t min_ns, int format) {
+    uint64_t elapsed = 0;
+    unsigned long ops = 0;
+
+    while (elapsed < min_ns) {
+        if (bench->prepare) {
+            bench->prepare();
+        }
+
+        uint64_t start = now_ns();
+        ops += bench->round();
+        elapsed += now_ns() - start;
+    }
+
+    double ns_per_op = (double)elapsed / ops;
+    double per_second = ns_per_op > 0 ? 1e9 / ns_per_op : 0;
+
+    if (format == OUTPUT_JSONL) {
+        printf("{\"benchmark\":\"%s\",\"socket\":\"%s\",\"payload\":%zu,\"ops\":%lu,\"ns_per_op\":%.2f,\"ops_per_s\":%.0f}\n",
+               bench->name, socket_name, payload, ops, ns_per_op, per_second);
+    } else {
+        printf("%s,%s,%zu,%lu,%.2f,%.0f\n", bench->name, socket_name, payload, ops, ns_per_op, per_second);
+    }
+    fflush(stdout);
+}
+
+static void usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-t <seconds>] [-s <sizes>] [-f csv|jsonl]\n", program_name);
+    fprintf(stderr, "  -t <seconds>  timed work per benchmark (default %.1f)\n", BENCH_DEFAULT_SECONDS);
+    fprintf(stderr, "  -s <list>     payload sizes, in bytes (default %s)\n", BENCH_DEFAULT_SIZES);
+    fprintf(stderr, "  -f <format>   output format: csv (default) or jsonl\n");
+}
+
+static int parse_size_list(char *list, size_t *sizes, size_t *num_sizes) {
+    *num_sizes = 0;
+
+    while (1) {
+        char *endptr;
+        long value = strtol(list, &endptr, 10);
+
+        if (endptr == list || (*endptr != ',' && *endptr != '\0') || value < 0 || value > MAX_DATALEN_OPTION
+            || *num_sizes == BENCH_MAX_SIZES) {
+            return (-1);
+        }
+        sizes[(*num_sizes)++] = value;
+
+        if (*endptr == '\0') {
+            return (0);
+        }
+        list = endptr + 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    double seconds = BENCH_DEFAULT_SECONDS;
+    int format = OUTPUT_CSV;
+    size_t sizes[BENCH_MAX_SIZES];
+    size_t num_sizes = 0;
+    char default_sizes[] = BENCH_DEFAULT_SIZES;
+    int opt;
+
+    parse_size_list(default_sizes, sizes, &num_sizes);
+
+    while ((opt = getopt(argc, argv, "t:s:f:h")) != -1) {
+        if (opt == 't') {
+            seconds = strtod(optarg, NULL);
+            if (seconds <= 0) {
+                usage(argv[0]);
+                return (EX_USAGE);
+            }
+        } else if (opt == 's') {
+            if (parse_size_list(optarg, sizes, &num_sizes) < 0) {
+                usage(argv[0]);
+                return (EX_USAGE);
+            }
+        } else if (opt == 'f' && strcmp(optarg, "csv") == 0) {
+            format = OUTPUT_CSV;
+        } else if (opt == 'f' && strcmp(optarg, "jsonl") == 0) {
+            format = OUTPUT_JSONL;
+        } else {
+            usage(argv[0]);
+            return (opt == 'h' ? EXIT_SUCCESS : EX_USAGE);
+        }
+    }
+
+    // nothing is printed per packet (replies and errors are accounted for, as with -q)
+    state.program_name = argv[0];
+    state.identifier = getpid() & 0xFFFF;
+    state.quiet = 1;
+    state.output_format = OUTPUT_TEXT;
+    state.burst = 1;
+    state.workers = 1;
+    target_addr = inet_addr(BENCH_TARGET);
+    router_addr = inet_addr(BENCH_ROUTER);
+    stranger_addr = inet_addr(BENCH_STRANGER);
+
+    if (format == OUTPUT_CSV) {
+        printf("benchmark,socket,payload,ops,ns_per_op,ops_per_s\n");
+    }
+
+    uint64_t min_ns = (uint64_t)(seconds * 1e9);
+    size_t num_benchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+    for (size_t s = 0; s < num_sizes; s++) {
+        for (size_t b = 0; b < num_benchmarks; b++) {
+            if (!benchmarks[b].per_socket) {
+                setup(sizes[s], SOCK_RAW);
+                run_benchmark(&benchmarks[b], "any", sizes[s], min_ns, format);
+                continue;
+            }
+
+            setup(sizes[s], SOCK_RAW);
+            run_benchmark(&benchmarks[b], "raw", sizes[s], min_ns, format);
+            setup(sizes[s], SOCK_DGRAM);
+            run_benchmark(&benchmarks[b], "dgram", sizes[s], min_ns, format);
+        }
+    }
+
+    destroyTargets();
+    free(packets);
+    return (EXIT_SUCCESS);
+}
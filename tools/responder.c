@@ -0,0 +1,370 @@
+// ft_ping_responder: userspace ICMP echo responder with impairments (delay, jitter, loss, duplication, reordering),
+// for the load test harness (tools/loadtest.sh): it answers the echo requests the host receives in place of the kernel
+// (net.ipv4.icmp_echo_ignore_all must be set, in a network namespace of its own), and counts exactly what it did to them
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RESPONDER_PACKET_SIZE 65536
+#define RESPONDER_SOCKET_BUFFER (8 << 20)
+#define RESPONDER_DEFAULT_GAP_MS 5.0    // extra delay of a reordered reply: the replies behind it overtake it
+#define RESPONDER_SPIN_NS 100000        // a delayed reply is waited for by spinning over its last 100 us (the wake up
+                                        // from ppoll is late by a scheduling latency, which would add up to the RTT's spread)
+
+// a reply waiting for its departure time (min heap ordered by due_ns, then by arrival order)
+typedef struct pending_reply {
+    uint64_t due_ns;
+    uint64_t order;
+    struct sockaddr_in to;
+    size_t len;
+    uint8_t *data;
+} pending_reply_t;
+
+typedef struct impairments {
+    double delay_ms;
+    double jitter_ms;                   // uniform in [-jitter, +jitter] around the delay
+    double loss_pct;
+    double dup_pct;
+    double reorder_pct;
+    double gap_ms;
+} impairments_t;
+
+typedef struct responder_stats {
+    unsigned long requests;             // echo requests received
+    unsigned long replies;              // replies sent (first copies)
+    unsigned long dropped;              // requests left unanswered (loss)
+    unsigned long duplicated;           // extra copies sent
+    unsigned long reordered;            // replies held back by the reorder gap
+    unsigned long send_errors;
+    unsigned long released;             // replies (and copies) sent, straight back or after their delay
+    double late_sum_ms;                 // how late they left after their departure time (the responder's own scheduling noise)
+    double late_sum_sq_ms;
+} responder_stats_t;
+
+static volatile sig_atomic_t stop = 0;
+static pending_reply_t *heap = NULL;
+static size_t heap_len = 0;
+static size_t heap_capacity = 0;
+static uint64_t next_order = 0;
+static unsigned short random_state[3];
+static responder_stats_t stats;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+// @brief returns 1 with the given probability (percent)
+static int happens(double pct) {
+    return (pct > 0 && erand48(random_state) * 100.0 < pct);
+}
+
+// (*) pending replies heap
+
+static int before(const pending_reply_t *a, const pending_reply_t *b) {
+    return (a->due_ns < b->due_ns || (a->due_ns == b->due_ns && a->order < b->order));
+}
+
+static int heap_push(pending_reply_t reply) {
+    if (heap_len == heap_capacity) {
+        size_t capacity = heap_capacity ? heap_capacity * 2 : 1024;
+        pending_reply_t *grown = realloc(heap, capacity * sizeof(pending_reply_t));
+
+        if (!grown) {
+            return (-1);
+        }
+        heap = grown;
+        heap_capacity = capacity;
+    }
+
+    size_t i = heap_len++;
+
+    reply.order = next_order++;
+    while (i > 0 && before(&reply, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = reply;
+    return (0);
+}
+
+static pending_reply_t heap_pop(void) {
+    pending_reply_t top = heap[0];
+    pending_reply_t last = heap[--heap_len];
+    size_t i = 0;
+
+    while (2 * i + 1 < heap_len) {
+        size_t child = 2 * i + 1;
+
+        if (child + 1 < heap_len && before(&heap[child + 1], &heap[child])) {
+            child += 1;
+        }
+        if (!before(&heap[child], &last)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (heap_len) {
+        heap[i] = last;
+    }
+    return (top);
+}
+
+// (*) replies
+
+static uint16_t checksum(const uint8_t *bytes, size_t len) {
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (bytes[i] << 8) + bytes[i + 1];
+    }
+    if (len & 1) {
+        sum += bytes[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (htons(~sum));
+}
+
+// @param late_ns how late the reply leaves after its departure time (0 when it goes straight back)
+static void send_reply(int fd, const uint8_t *data, size_t len, const struct sockaddr_in *to, uint64_t late_ns) {
+    if (sendto(fd, data, len, 0, (const struct sockaddr *)to, sizeof(*to)) < 0) {
+        stats.send_errors += 1;
+        return ;
+    }
+    stats.released += 1;
+    stats.late_sum_ms += late_ns / 1e6;
+    stats.late_sum_sq_ms += (late_ns / 1e6) * (late_ns / 1e6);
+}
+
+// @brief answers (or not) an echo request: the reply is the request sent back with its type changed
+static void answer(int fd, const impairments_t *impairments, uint8_t *icmp, size_t len, const struct sockaddr_in *from) {
+    stats.requests += 1;
+
+    if (happens(impairments->loss_pct)) {
+        stats.dropped += 1;
+        return ;
+    }
+
+    icmp[0] = ICMP_ECHOREPLY;
+    icmp[2] = 0;
+    icmp[3] = 0;
+    memcpy(icmp + 2, &(uint16_t){ checksum(icmp, len) }, sizeof(uint16_t));
+
+    int copies = 1 + happens(impairments->dup_pct);
+    double delay_ms = impairments->delay_ms;
+
+    if (impairments->jitter_ms > 0) {
+        delay_ms += (erand48(random_state) * 2.0 - 1.0) * impairments->jitter_ms;
+    }
+    if (happens(impairments->reorder_pct)) {
+        delay_ms += impairments->gap_ms;
+        stats.reordered += 1;
+    }
+    if (delay_ms < 0) {
+        delay_ms = 0;
+    }
+
+    stats.replies += 1;
+    stats.duplicated += copies - 1;
+
+    // no delay at all: straight back
+    if (delay_ms == 0 && heap_len == 0) {
+        for (int i = 0; i < copies; i++) {
+            send_reply(fd, icmp, len, from, 0);
+        }
+        return ;
+    }
+
+    uint64_t due = now_ns() + (uint64_t)(delay_ms * 1e6);
+
+    for (int i = 0; i < copies; i++) {
+        pending_reply_t reply = { .due_ns = due, .to = *from, .len = len, .data = malloc(len) };
+
+        if (!reply.data || heap_push(reply) < 0) {
+            free(reply.data);
+            stats.send_errors += 1;
+            continue;
+        }
+        memcpy(reply.data, icmp, len);
+    }
+}
+
+// @brief sends the replies whose time has come, spinning for those due within RESPONDER_SPIN_NS
+static void send_due_replies(int fd) {
+    uint64_t now = now_ns();
+
+    while (heap_len && heap[0].due_ns <= now + RESPONDER_SPIN_NS) {
+        while (now < heap[0].due_ns) {
+            now = now_ns();
+        }
+
+        pending_reply_t reply = heap_pop();
+
+        send_reply(fd, reply.data, reply.len, &reply.to, now - reply.due_ns);
+        free(reply.data);
+        now = now_ns();
+    }
+}
+
+// @brief reads every packet waiting on the socket (non blocking) and answers the echo requests
+static void drain(int fd, const impairments_t *impairments) {
+    static uint8_t packet[RESPONDER_PACKET_SIZE];
+
+    while (1) {
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        ssize_t len = recvfrom(fd, packet, sizeof(packet), MSG_DONTWAIT, (struct sockaddr *)&from, &from_len);
+
+        if (len < 0) {
+            return ;
+        }
+        if ((size_t)len < sizeof(struct ip)) {
+            continue;
+        }
+
+        size_t header_len = ((struct ip *)packet)->ip_hl << 2;
+
+        // only echo requests (our own replies come back to this socket too)
+        if ((size_t)len < header_len + sizeof(struct icmphdr) || packet[header_len] != ICMP_ECHO || packet[header_len + 1] != 0) {
+            continue;
+        }
+        answer(fd, impairments, packet + header_len, len - header_len, &from);
+    }
+}
+
+static void write_stats(const char *path) {
+    FILE *out = path ? fopen(path, "w") : stderr;
+
+    if (!out) {
+        perror(path);
+        return ;
+    }
+    double late_avg_ms = stats.released ? stats.late_sum_ms / stats.released : 0.0;
+    double late_variance = stats.released ? stats.late_sum_sq_ms / stats.released - late_avg_ms * late_avg_ms : 0.0;
+
+    fprintf(out, "requests=%lu replies=%lu dropped=%lu duplicated=%lu reordered=%lu pending=%zu send_errors=%lu "
+            "late_avg_ms=%.4f late_stddev_ms=%.4f\n",
+            stats.requests, stats.replies, stats.dropped, stats.duplicated, stats.reordered, heap_len, stats.send_errors,
+            late_avg_ms, sqrt(late_variance > 0 ? late_variance : 0.0));
+    if (out != stderr) {
+        fclose(out);
+    }
+}
+
+static void usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-d ms] [-j ms] [-l %%] [-D %%] [-r %%] [-g ms] [-S seed] [-o stats file]\n", program_name);
+    fprintf(stderr, "  -d <ms>       delay of every reply\n");
+    fprintf(stderr, "  -j <ms>       jitter: uniform in [-ms, +ms] around the delay\n");
+    fprintf(stderr, "  -l <%%>        requests left unanswered\n");
+    fprintf(stderr, "  -D <%%>        replies sent twice\n");
+    fprintf(stderr, "  -r <%%>        replies held back by the reorder gap (the next ones overtake them)\n");
+    fprintf(stderr, "  -g <ms>       reorder gap (default %.0f)\n", RESPONDER_DEFAULT_GAP_MS);
+    fprintf(stderr, "  -S <seed>     random seed (default: the pid)\n");
+    fprintf(stderr, "  -o <file>     where the counters are written on exit (SIGINT, SIGTERM), default stderr\n");
+}
+
+int main(int argc, char **argv) {
+    impairments_t impairments = { .gap_ms = RESPONDER_DEFAULT_GAP_MS };
+    const char *stats_path = NULL;
+    long seed = getpid();
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:j:l:D:r:g:S:o:h")) != -1) {
+        if (opt == 'd') {
+            impairments.delay_ms = strtod(optarg, NULL);
+        } else if (opt == 'j') {
+            impairments.jitter_ms = strtod(optarg, NULL);
+        } else if (opt == 'l') {
+            impairments.loss_pct = strtod(optarg, NULL);
+        } else if (opt == 'D') {
+            impairments.dup_pct = strtod(optarg, NULL);
+        } else if (opt == 'r') {
+            impairments.reorder_pct = strtod(optarg, NULL);
+        } else if (opt == 'g') {
+            impairments.gap_ms = strtod(optarg, NULL);
+        } else if (opt == 'S') {
+            seed = strtol(optarg, NULL, 10);
+        } else if (opt == 'o') {
+            stats_path = optarg;
+        } else {
+            usage(argv[0]);
+            return (opt == 'h' ? EXIT_SUCCESS : EX_USAGE);
+        }
+    }
+
+    random_state[0] = 0x330E;
+    random_state[1] = seed & 0xFFFF;
+    random_state[2] = (seed >> 16) & 0xFFFF;
+
+    int fd = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+    if (fd < 0) {
+        perror("socket");
+        return (EX_NOPERM);
+    }
+
+    int buffer_size = RESPONDER_SOCKET_BUFFER;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &buffer_size, sizeof(buffer_size));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &buffer_size, sizeof(buffer_size));
+
+    // no timer slack: ppoll wakes up when asked to, not up to 50 us later
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+    struct sigaction action = { .sa_handler = on_signal };
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    while (!stop) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        struct timespec timeout = { .tv_sec = 0, .tv_nsec = 100000000 }; // wakes up now and then to notice a signal
+
+        // wakes up ahead of the next reply, send_due_replies spins the rest of the way
+        if (heap_len) {
+            uint64_t now = now_ns();
+            uint64_t wait = (heap[0].due_ns > now + RESPONDER_SPIN_NS) ? heap[0].due_ns - now - RESPONDER_SPIN_NS : 0;
+
+            if (wait < 100000000ULL) {
+                timeout.tv_nsec = wait;
+            }
+        }
+
+        if (ppoll(&pfd, 1, &timeout, NULL) < 0 && errno != EINTR) {
+            perror("ppoll");
+            break;
+        }
+
+        if (pfd.revents & POLLIN) {
+            drain(fd, &impairments);
+        }
+        send_due_replies(fd);
+    }
+
+    write_stats(stats_path);
+    close(fd);
+    return (EXIT_SUCCESS);
+}